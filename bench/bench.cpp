@@ -0,0 +1,252 @@
+/*
+
+Copyright (C) 2014-2018 Nicolas Brown
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is furnished
+to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+*/
+
+/*
+runs every script in the corpus and prints the results as json
+
+	loris_bench [--filter name] [--min-time seconds] [--scripts dir] [--out file]
+
+each script has a run() function that returns how many operations it did,
+times are reported per operation
+*/
+
+#include "../include/loris/loris.hpp"
+#include "../include/loris/libs/utils.hpp"
+#include "bench_common.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+#ifndef LORIS_BENCH_SCRIPTS
+#define LORIS_BENCH_SCRIPTS "bench/scripts"
+#endif
+
+using namespace loris;
+
+/* NATIVE FUNCTIONS USED BY THE CORPUS */
+
+static double Multiply(double a, double b)
+{
+	return a * b;
+}
+
+static Value AddNative(VirtualMachine* vm, Object* self)
+{
+	return Value::CreateNumber(vm->GetArg(0).AsNumber() + vm->GetArg(1).AsNumber());
+}
+
+/* BENCHMARKS */
+
+static bool ReadFile(const std::string& path, std::string& contents)
+{
+	std::ifstream file(path, std::ios::in | std::ios::binary);
+	if (!file)
+		return false;
+
+	std::stringstream stream;
+	stream << file.rdbuf();
+	contents = stream.str();
+
+	return true;
+}
+
+static const char* corpus[] = {
+	"fib",
+	"loops",
+	"methods",
+	"strings",
+	"arrays",
+	"alloc",
+	"gc",
+	"natives"
+};
+
+struct BenchResult
+{
+	string name;
+	double ops;//operations per run
+	int runs;
+	double nsPerOp;//median
+	double minNsPerOp;
+	double allocsPerOp;
+	double bytesPerOp;
+	long long peakHeapBytes;//most the benchmark had allocated at once, on top of what was live before it
+};
+
+static bool RunBenchmark(const string& dir, const string& name, double minTime, BenchResult& result)
+{
+	//peak rss only ever grows, so each benchmark gets its own heap high-water mark instead
+	long long baseBytes = liveBytes;
+	peakLiveBytes = liveBytes;
+
+	string filename = name + ".ls";
+	string source;
+	if (!ReadFile(dir + "/" + filename, source))
+	{
+		std::cerr << "cant read " << dir << "/" << filename << std::endl;
+		return false;
+	}
+
+	Loris loris;
+	loris.AddSource(filename, source);
+	loris.AddFunction("array", DSUtilsLib::NativeArray);
+	loris.AddFunction("multiply", Def(Multiply));
+	loris.AddFunction("add_native", AddNative);
+
+	if (!loris.Compile())
+	{
+		std::cerr << filename << ": " << loris.GetError().message << " on line " << loris.GetError().line << std::endl;
+		return false;
+	}
+
+	//the first run warms up the caches and the vm's frame pool
+	Value ret = loris.ExecuteFunction("run");
+	if (loris.HasError() || ret.type != ValueType::Number)
+	{
+		std::cerr << filename << ": " << (loris.HasError() ? loris.GetError().message : "run() should return the number of operations") << std::endl;
+		return false;
+	}
+
+	double ops = ret.AsNumber();
+	vector<double> times;
+	double totalTime = 0;
+	unsigned long long allocs = numAllocs;
+	unsigned long long bytes = allocBytes;
+
+	while (times.size() < 3 || totalTime < minTime)
+	{
+		auto start = std::chrono::steady_clock::now();
+		loris.ExecuteFunction("run");
+		std::chrono::duration<double> time = std::chrono::steady_clock::now() - start;
+
+		if (loris.HasError())
+		{
+			std::cerr << filename << ": " << loris.GetError().message << std::endl;
+			return false;
+		}
+
+		times.push_back(time.count());
+		totalTime += time.count();
+	}
+
+	double runs = (double)times.size();
+	std::sort(times.begin(), times.end());
+
+	result.name = name;
+	result.ops = ops;
+	result.runs = (int)times.size();
+	result.nsPerOp = times[times.size() / 2] * 1e9 / ops;
+	result.minNsPerOp = times[0] * 1e9 / ops;
+	result.allocsPerOp = (numAllocs - allocs) / runs / ops;
+	result.bytesPerOp = (allocBytes - bytes) / runs / ops;
+	result.peakHeapBytes = peakLiveBytes - baseBytes;
+
+	return true;
+}
+
+static void WriteJson(std::ostream& out, const vector<BenchResult>& results)
+{
+	char buffer[64];
+
+	out << "{\n";
+	out << "\t\"benchmarks\": [";
+	for (size_t i = 0; i < results.size(); i++)
+	{
+		const BenchResult& result = results[i];
+
+		out << (i == 0 ? "" : ",") << "\n\t\t{";
+		out << "\"name\": \"" << result.name << "\"";
+		out << ", \"ops\": " << (long long)result.ops;
+		out << ", \"runs\": " << result.runs;
+		snprintf(buffer, sizeof(buffer), "%.2f", result.nsPerOp);
+		out << ", \"ns_per_op\": " << buffer;
+		snprintf(buffer, sizeof(buffer), "%.2f", result.minNsPerOp);
+		out << ", \"min_ns_per_op\": " << buffer;
+		snprintf(buffer, sizeof(buffer), "%.3f", result.allocsPerOp);
+		out << ", \"allocs_per_op\": " << buffer;
+		snprintf(buffer, sizeof(buffer), "%.1f", result.bytesPerOp);
+		out << ", \"bytes_per_op\": " << buffer;
+		out << ", \"peak_heap_kb\": " << result.peakHeapBytes / 1024;
+		out << "}";
+	}
+	out << "\n\t],\n";
+	out << "\t\"peak_rss_kb\": " << GetPeakRSS() << "\n";
+	out << "}\n";
+}
+
+int main(int argc, char** argv)
+{
+	string filter;
+	string dir = LORIS_BENCH_SCRIPTS;
+	string outFile;
+	double minTime = 0.5;
+
+	for (int i = 1; i < argc; i++)
+	{
+		string arg = argv[i];
+		if (i + 1 < argc && arg == "--filter")
+			filter = argv[++i];
+		else if (i + 1 < argc && arg == "--min-time")
+			minTime = atof(argv[++i]);
+		else if (i + 1 < argc && arg == "--scripts")
+			dir = argv[++i];
+		else if (i + 1 < argc && arg == "--out")
+			outFile = argv[++i];
+		else
+		{
+			std::cerr << "usage: loris_bench [--filter name] [--min-time seconds] [--scripts dir] [--out file]" << std::endl;
+			return 1;
+		}
+	}
+
+	vector<BenchResult> results;
+	for (auto name : corpus)
+	{
+		if (!filter.empty() && strstr(name, filter.c_str()) == nullptr)
+			continue;
+
+		BenchResult result;
+		if (!RunBenchmark(dir, name, minTime, result))
+			return 1;
+
+		results.push_back(result);
+	}
+
+	if (outFile.empty())
+	{
+		WriteJson(std::cout, results);
+	}
+	else
+	{
+		std::ofstream out(outFile);
+		WriteJson(out, results);
+	}
+
+	return 0;
+}
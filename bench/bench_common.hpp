@@ -0,0 +1,113 @@
+/*
+
+Copyright (C) 2014-2018 Nicolas Brown
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is furnished
+to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+*/
+
+/*
+shared by the benchmark runners, include it from exactly one file per executable
+since it replaces the global operator new and delete
+*/
+#pragma once
+
+#include <cstdlib>
+#include <new>
+#include <string>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+/* ALLOCATION COUNTING */
+
+//every allocation gets a header holding its size so live bytes can be tracked
+static const size_t allocHeaderSize = 16;
+
+static unsigned long long numAllocs = 0;
+static unsigned long long allocBytes = 0;//total ever allocated
+static long long liveBytes = 0;
+static long long peakLiveBytes = 0;
+
+void* operator new(size_t size)
+{
+	numAllocs++;
+	allocBytes += size;
+	liveBytes += size;
+	if (liveBytes > peakLiveBytes)
+		peakLiveBytes = liveBytes;
+
+	char* ptr = (char*)malloc(size + allocHeaderSize);
+	if (ptr == nullptr)
+		throw std::bad_alloc();
+
+	*(size_t*)ptr = size;
+	return ptr + allocHeaderSize;
+}
+
+void* operator new[](size_t size)
+{
+	return operator new(size);
+}
+
+void operator delete(void* ptr) noexcept
+{
+	if (ptr == nullptr)
+		return;
+
+	char* block = (char*)ptr - allocHeaderSize;
+	liveBytes -= *(size_t*)block;
+	free(block);
+}
+
+void operator delete[](void* ptr) noexcept
+{
+	operator delete(ptr);
+}
+
+void operator delete(void* ptr, size_t) noexcept
+{
+	operator delete(ptr);
+}
+
+void operator delete[](void* ptr, size_t) noexcept
+{
+	operator delete(ptr);
+}
+
+//peak resident set size of the whole process in kilobytes
+static long long GetPeakRSS()
+{
+#ifdef _WIN32
+	PROCESS_MEMORY_COUNTERS counters;
+	GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters));
+	return (long long)counters.PeakWorkingSetSize / 1024;
+#else
+	struct rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+#ifdef __APPLE__
+	return (long long)usage.ru_maxrss / 1024;
+#else
+	return (long long)usage.ru_maxrss;
+#endif
+#endif
+}
@@ -0,0 +1,665 @@
+/*
+
+Copyright (C) 2014-2018 Nicolas Brown
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is furnished
+to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+*/
+
+/*
+measures the lexer, parser and compiler on a generated script bundle and prints
+the results as json
+
+	loris_frontend_bench [--size megabytes] [--file-size kilobytes] [--runs n] [--dump dir] [--out file] [--check]
+
+Parser::Parse lexes and Compiler::Compile parses, so the parse and compile
+phases are measured by taking the earlier phases away from the total.
+single_pass is the whole front end again with Compiler::SetSinglePass, to compare with total,
+and lazy is with Compiler::SetLazy, where none of the function bodies get compiled
+
+--check compiles the bundle with each front end instead of timing them, and fails
+if the single pass or lazy bytecode differs from the ast compiler's in any way
+*/
+
+#include "../include/loris/loris.hpp"
+#include "bench_common.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sstream>
+
+using namespace loris;
+
+/* CORPUS GENERATION */
+
+class CorpusGenerator
+{
+	unsigned int seed;
+	std::stringstream out;
+	int fileIndex;
+	int indent;
+
+	//deterministic so every run measures the same code
+	int Random(int max)
+	{
+		seed = seed * 1103515245 + 12345;
+		return (int)((seed >> 16) % max);
+	}
+
+	void Line(const string& text)
+	{
+		for (int i = 0; i < indent; i++)
+			out << '\t';
+		out << text << '\n';
+	}
+
+	string Local()
+	{
+		return "v" + to_string(Random(5));
+	}
+
+	string Leaf()
+	{
+		switch (Random(5))
+		{
+		case 0:
+			return to_string(Random(1000));
+		case 1:
+			return to_string(Random(100)) + "." + to_string(Random(100));
+		case 2:
+			return "\"s" + to_string(Random(100)) + "\"";
+		default:
+			return Local();
+		}
+	}
+
+	string Expr(int depth)
+	{
+		if (depth <= 0)
+			return Leaf();
+
+		static const char* ops[] = { "+", "-", "*", "/", "<", ">", "<=", ">=", "==", "!=", "&&", "||" };
+
+		switch (Random(6))
+		{
+		case 0:
+			return "(" + Expr(depth - 1) + " " + ops[Random(12)] + " " + Expr(depth - 1) + ")";
+		case 1:
+			return "f" + to_string(fileIndex) + "_" + to_string(Random(50)) + "(" + Expr(depth / 2) + ", " + Leaf() + ")";
+		case 2:
+			return Local() + ".get(" + Expr(depth - 1) + ")";
+		case 3:
+			return "-" + Expr(depth - 1);
+		default:
+			return Expr(depth - 1) + " " + ops[Random(4)] + " " + Leaf();
+		}
+	}
+
+	void Statement(int depth)
+	{
+		switch (Random(depth > 0 ? 8 : 4))
+		{
+		case 0:
+		case 1:
+			Line(Local() + " = " + Expr(6) + ";");
+			break;
+		case 2:
+			Line(Local() + ".add(" + Expr(3) + ");");
+			break;
+		case 3:
+			Line("var t" + to_string(Random(1000)) + " = {\"a\": " + Expr(2) + ", \"b\": " + Leaf() + "};");
+			break;
+		case 4:
+			Line("if(" + Expr(3) + ")");
+			Block(depth - 1, 3);
+			Line("else");
+			Block(depth - 1, 2);
+			break;
+		case 5:
+			Line("while(" + Local() + " < " + Leaf() + ")");
+			Block(depth - 1, 3);
+			break;
+		case 6:
+			Line("for(i in 0.." + to_string(Random(100)) + ")");
+			Block(depth - 1, 3);
+			break;
+		default:
+			Line("v0 = new C" + to_string(fileIndex) + "_" + to_string(Random(10)) + "(" + Leaf() + ");");
+			break;
+		}
+	}
+
+	void Block(int depth, int statements)
+	{
+		Line("{");
+		indent++;
+		for (int i = 0; i < statements; i++)
+			Statement(depth);
+		indent--;
+		Line("}");
+	}
+
+	void FunctionBody(int statements)
+	{
+		Line("{");
+		indent++;
+		for (int i = 0; i < 5; i++)
+			Line("var v" + to_string(i) + " = " + Leaf() + ";");
+		for (int i = 0; i < statements; i++)
+			Statement(2);
+		Line("return " + Expr(4) + ";");
+		indent--;
+		Line("}");
+	}
+
+	void Class(int index)
+	{
+		string name = "C" + to_string(fileIndex) + "_" + to_string(index);
+		if (index > 0 && Random(2) == 0)
+			Line("class " + name + " extends C" + to_string(fileIndex) + "_" + to_string(Random(index)));
+		else
+			Line("class " + name);
+
+		Line("{");
+		indent++;
+		for (int i = 0; i < 4; i++)
+			Line("var a" + to_string(i) + ";");
+
+		Line(name + "(x)");
+		FunctionBody(3);
+
+		for (int i = 0; i < 5; i++)
+		{
+			Line("def m" + to_string(i) + "(x, y)");
+			FunctionBody(10);
+		}
+		indent--;
+		Line("}");
+	}
+
+public:
+	CorpusGenerator()
+	{
+		seed = 1;
+		fileIndex = 0;
+		indent = 0;
+	}
+
+	//one file of roughly size bytes: a few classes then long functions until its big enough
+	string GenerateFile(size_t size)
+	{
+		out.str("");
+		out << "// generated by loris_frontend_bench\n";
+		indent = 0;
+
+		for (int c = 0; c < 10; c++)
+			Class(c);
+
+		for (int f = 0; (size_t)out.tellp() < size; f++)
+		{
+			Line("def f" + to_string(fileIndex) + "_" + to_string(f) + "(a, b, c)");
+			FunctionBody(60);
+		}
+
+		fileIndex++;
+		return out.str();
+	}
+};
+
+/* PHASES */
+
+struct PhaseResult
+{
+	string name;
+	double time;//fastest run in seconds
+	unsigned long long allocs;
+	unsigned long long bytes;
+};
+
+//the compiler leaves the assembly to whoever asked for it
+static void FreeAssembly(Assembly* assembly)
+{
+	for (auto& func : assembly->functions)
+		delete func.second;
+
+	for (auto& cls : assembly->classes)
+	{
+		for (auto& method : cls.second->methods)
+			delete method.second;
+		for (auto& attrib : cls.second->attribs)
+			delete attrib.init;
+		delete cls.second;
+	}
+
+	delete assembly;
+}
+
+static bool Lex(const vector<string>& files)
+{
+	for (auto& file : files)
+	{
+		Lexer lexer;
+		if (!lexer.Parse(file))
+			return false;
+	}
+
+	return true;
+}
+
+static bool Parse(const vector<string>& files)
+{
+	Parser parser;
+	for (auto& file : files)
+	{
+		if (!parser.Parse(file))
+		{
+			std::cerr << "parse error: " << parser.GetError().message << " on line " << parser.GetError().line << std::endl;
+			return false;
+		}
+	}
+
+	return true;
+}
+
+static bool Compile(const vector<string>& files, bool singlePass, bool lazy)
+{
+	Compiler compiler;
+	compiler.SetSinglePass(singlePass);
+	compiler.SetLazy(lazy);
+	for (size_t i = 0; i < files.size(); i++)
+		compiler.AddSource("file" + to_string(i) + ".ls", files[i]);
+
+	Assembly* assembly = new Assembly;
+	bool ok = compiler.Compile(assembly);
+	if (!ok)
+		std::cerr << "compile error: " << compiler.GetError().message << " on line " << compiler.GetError().line << std::endl;
+
+	FreeAssembly(assembly);
+	return ok;
+}
+
+static bool CompileAST(const vector<string>& files)
+{
+	return Compile(files, false, false);
+}
+
+static bool CompileSinglePass(const vector<string>& files)
+{
+	return Compile(files, true, false);
+}
+
+static bool CompileLazy(const vector<string>& files)
+{
+	return Compile(files, false, true);
+}
+
+static bool RunPhase(const string& name, bool(*phase)(const vector<string>&), const vector<string>& files, int runs, PhaseResult& result)
+{
+	result.name = name;
+	result.time = 0;
+
+	for (int i = 0; i < runs; i++)
+	{
+		unsigned long long allocs = numAllocs;
+		unsigned long long bytes = allocBytes;
+
+		auto start = std::chrono::steady_clock::now();
+		if (!phase(files))
+			return false;
+		std::chrono::duration<double> time = std::chrono::steady_clock::now() - start;
+
+		if (i == 0 || time.count() < result.time)
+			result.time = time.count();
+
+		result.allocs = numAllocs - allocs;
+		result.bytes = allocBytes - bytes;
+	}
+
+	return true;
+}
+
+//memory held by the biggest ast, with the lexer's tokens taken away
+//the parser only holds one file's ast at a time
+static long long MeasureAST(const vector<string>& files, size_t& sourceSize)
+{
+	long long largest = 0;
+	sourceSize = 0;
+	for (auto& file : files)
+	{
+		long long before = liveBytes;
+		long long withTokens;
+		{
+			Lexer lexer;
+			lexer.Parse(file);
+			withTokens = liveBytes - before;
+		}
+
+		Parser parser;
+		parser.Parse(file);
+		long long withAST = liveBytes - before;
+
+		if (withAST - withTokens > largest)
+		{
+			largest = withAST - withTokens;
+			sourceSize = file.size();
+		}
+	}
+
+	return largest;
+}
+
+/* FRONT END CHECK */
+
+//the compilers leave whatever was last in val for ops without an operand, so those vals arent compared
+static bool HasOperand(OpCode op)
+{
+	switch (op)
+	{
+	case OpCode::Add:
+	case OpCode::Sub:
+	case OpCode::Mul:
+	case OpCode::Div:
+	case OpCode::Neg:
+	case OpCode::LoadIndex:
+	case OpCode::StoreIndex:
+	case OpCode::LoadNull:
+	case OpCode::Pop:
+	case OpCode::AddArg:
+	case OpCode::IsEqual:
+	case OpCode::IsLessThan:
+	case OpCode::IsLessThanOrEqual:
+	case OpCode::IsGreaterThan:
+	case OpCode::IsGreaterThanOrEqual:
+	case OpCode::IsNotEqual:
+	case OpCode::Not:
+	case OpCode::Return:
+	case OpCode::Yield:
+	case OpCode::Nop:
+		return false;
+	default:
+		return true;
+	}
+}
+
+static void DescribeFunction(std::ostream& out, Function* func)
+{
+	if (func == nullptr)
+	{
+		out << "none\n";
+		return;
+	}
+
+	out << "function " << func->name << " static " << func->isStatic << " source " << func->sourceIndex << " args";
+	for (auto& arg : func->args)
+		out << " " << arg;
+	out << "\n";
+
+	for (size_t i = 0; i < func->instr.size(); i++)
+	{
+		OpCode op = func->instr[i].op;
+		out << i << " " << GetOpCodeName(op);
+		if (HasOperand(op))
+			out << " " << func->instr[i].val;
+		out << " line " << func->GetLine((int)i) << "\n";
+	}
+
+	out << "strings";
+	for (auto& str : func->strings)
+		out << " \"" << str << "\"";
+	out << "\nconstants";
+	for (auto& constant : func->constants)
+	{
+		if (constant.type == ValueType::String)
+			out << " \"" << constant.val.str << "\"";
+		else if (constant.type == ValueType::Bool)
+			out << " " << (constant.val.b ? "true" : "false");
+		else
+			out << " " << constant.AsNumber();
+	}
+	out << "\n";
+}
+
+//every function and class by name, with the bodies left by a lazy compile compiled first
+static bool DescribeAssembly(Assembly* assembly, std::map<string, string>& definitions)
+{
+	for (auto& func : assembly->functions)
+	{
+		Error error;
+		if (!SinglePassCompiler::CompileBody(func.second, error))
+		{
+			std::cerr << "compile error: " << error.message << " on line " << error.line << std::endl;
+			return false;
+		}
+
+		std::ostringstream out;
+		DescribeFunction(out, func.second);
+		definitions["function " + func.first] = out.str();
+	}
+
+	for (auto& pair : assembly->classes)
+	{
+		Class* cls = pair.second;
+		std::ostringstream out;
+		out << "class " << cls->name << " extends " << cls->parentName << " source " << cls->sourceIndex << "\n";
+
+		for (auto& attrib : cls->attribs)
+		{
+			out << "attrib " << attrib.name << " static " << attrib.isStatic << "\n";
+			DescribeFunction(out, attrib.init);
+		}
+
+		std::map<string, Function*> methods(cls->methods.begin(), cls->methods.end());
+		for (auto& method : methods)
+		{
+			Error error;
+			if (!SinglePassCompiler::CompileBody(method.second, error))
+			{
+				std::cerr << "compile error: " << error.message << " on line " << error.line << std::endl;
+				return false;
+			}
+
+			out << "method " << method.first << "\n";
+			DescribeFunction(out, method.second);
+		}
+
+		definitions["class " + pair.first] = out.str();
+	}
+
+	return true;
+}
+
+static bool Describe(const vector<string>& files, bool singlePass, bool lazy, std::map<string, string>& definitions)
+{
+	Compiler compiler;
+	compiler.SetSinglePass(singlePass);
+	compiler.SetLazy(lazy);
+	for (size_t i = 0; i < files.size(); i++)
+		compiler.AddSource("file" + to_string(i) + ".ls", files[i]);
+
+	Assembly* assembly = new Assembly;
+	bool ok = compiler.Compile(assembly);
+	if (!ok)
+		std::cerr << "compile error: " << compiler.GetError().message << " on line " << compiler.GetError().line << std::endl;
+	else
+		ok = DescribeAssembly(assembly, definitions);
+
+	FreeAssembly(assembly);
+	return ok;
+}
+
+//the single pass compiler, eager or lazy, has to emit exactly what the ast compiler does
+static bool CheckFrontEnds(const vector<string>& files)
+{
+	std::map<string, string> expected, singlePass, lazy;
+	if (!Describe(files, false, false, expected) ||
+		!Describe(files, true, false, singlePass) ||
+		!Describe(files, false, true, lazy))
+		return false;
+
+	int mismatches = 0;
+	for (auto result : { std::make_pair("single_pass", &singlePass), std::make_pair("lazy", &lazy) })
+	{
+		for (auto& def : expected)
+		{
+			auto found = result.second->find(def.first);
+			if (found == result.second->end())
+			{
+				std::cerr << result.first << " is missing " << def.first << std::endl;
+				mismatches++;
+			}
+			else if (found->second != def.second)
+			{
+				std::cerr << result.first << " differs on " << def.first << ":\n" << def.second << "---\n" << found->second << std::endl;
+				mismatches++;
+			}
+		}
+
+		if (result.second->size() != expected.size())
+		{
+			std::cerr << result.first << " has " << result.second->size() << " definitions, expected " << expected.size() << std::endl;
+			mismatches++;
+		}
+	}
+
+	std::cout << "{\"check\": {\"definitions\": " << expected.size() << ", \"mismatches\": " << mismatches << "}}" << std::endl;
+	return mismatches == 0;
+}
+
+static void WritePhase(std::ostream& out, const PhaseResult& phase, double megabytes, bool last)
+{
+	char buffer[64];
+
+	out << "\t\t{\"name\": \"" << phase.name << "\"";
+	snprintf(buffer, sizeof(buffer), "%.3f", phase.time * 1000);
+	out << ", \"ms\": " << buffer;
+	snprintf(buffer, sizeof(buffer), "%.2f", phase.time > 0 ? megabytes / phase.time : 0.0);
+	out << ", \"mb_per_s\": " << buffer;
+	out << ", \"allocs\": " << phase.allocs;
+	out << ", \"alloc_bytes\": " << phase.bytes;
+	out << "}" << (last ? "\n" : ",\n");
+}
+
+//later phases include the earlier ones, take those away
+static PhaseResult Subtract(const string& name, const PhaseResult& total, const PhaseResult& earlier)
+{
+	PhaseResult result;
+	result.name = name;
+	result.time = std::max(0.0, total.time - earlier.time);
+	result.allocs = total.allocs - earlier.allocs;
+	result.bytes = total.bytes - earlier.bytes;
+
+	return result;
+}
+
+int main(int argc, char** argv)
+{
+	double sizeMB = 4;
+	size_t fileSize = 64 * 1024;
+	int runs = 3;
+	string dumpDir;
+	string outFile;
+	bool check = false;
+
+	for (int i = 1; i < argc; i++)
+	{
+		string arg = argv[i];
+		if (i + 1 < argc && arg == "--size")
+			sizeMB = atof(argv[++i]);
+		else if (i + 1 < argc && arg == "--file-size")
+			fileSize = (size_t)(atof(argv[++i]) * 1024);
+		else if (i + 1 < argc && arg == "--runs")
+			runs = std::max(1, atoi(argv[++i]));
+		else if (i + 1 < argc && arg == "--dump")
+			dumpDir = argv[++i];
+		else if (i + 1 < argc && arg == "--out")
+			outFile = argv[++i];
+		else if (arg == "--check")
+			check = true;
+		else
+		{
+			std::cerr << "usage: loris_frontend_bench [--size megabytes] [--file-size kilobytes] [--runs n] [--dump dir] [--out file] [--check]" << std::endl;
+			return 1;
+		}
+	}
+
+	//generate the bundle
+	CorpusGenerator generator;
+	vector<string> files;
+	size_t totalBytes = 0;
+	size_t totalLines = 0;
+	while (totalBytes < sizeMB * 1024 * 1024)
+	{
+		files.push_back(generator.GenerateFile(fileSize));
+		totalBytes += files.back().size();
+		totalLines += std::count(files.back().begin(), files.back().end(), '\n');
+	}
+
+	//handy for feeding the same bundle to other tools
+	if (!dumpDir.empty())
+	{
+		for (size_t i = 0; i < files.size(); i++)
+		{
+			std::ofstream file(dumpDir + "/file" + to_string(i) + ".ls", std::ios::binary);
+			file << files[i];
+		}
+	}
+
+	if (check)
+		return CheckFrontEnds(files) ? 0 : 1;
+
+	double megabytes = totalBytes / (1024.0 * 1024.0);
+
+	PhaseResult lex, lexParse, all, singlePass, lazy;
+	if (!RunPhase("lex", Lex, files, runs, lex) ||
+		!RunPhase("lex+parse", Parse, files, runs, lexParse) ||
+		!RunPhase("total", CompileAST, files, runs, all) ||
+		!RunPhase("single_pass", CompileSinglePass, files, runs, singlePass) ||
+		!RunPhase("lazy", CompileLazy, files, runs, lazy))
+		return 1;
+
+	size_t astSourceSize;
+	long long astBytes = MeasureAST(files, astSourceSize);
+
+	std::ofstream fileOut;
+	if (!outFile.empty())
+		fileOut.open(outFile);
+	std::ostream& out = outFile.empty() ? std::cout : fileOut;
+
+	char buffer[64];
+	out << "{\n";
+	out << "\t\"corpus\": {\"files\": " << files.size() << ", \"bytes\": " << totalBytes << ", \"lines\": " << totalLines << "},\n";
+	out << "\t\"phases\": [\n";
+	WritePhase(out, lex, megabytes, false);
+	WritePhase(out, Subtract("parse", lexParse, lex), megabytes, false);
+	WritePhase(out, Subtract("compile", all, lexParse), megabytes, false);
+	WritePhase(out, all, megabytes, false);
+	WritePhase(out, singlePass, megabytes, false);
+	WritePhase(out, lazy, megabytes, true);
+	out << "\t],\n";
+	snprintf(buffer, sizeof(buffer), "%.1f", (double)astBytes / std::max((size_t)1, astSourceSize));
+	out << "\t\"ast\": {\"peak_bytes\": " << astBytes << ", \"bytes_per_source_byte\": " << buffer << "},\n";
+	out << "\t\"peak_rss_kb\": " << GetPeakRSS() << "\n";
+	out << "}\n";
+
+	return 0;
+}
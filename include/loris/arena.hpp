@@ -0,0 +1,257 @@
+/*
+
+Copyright (C) 2014-2018 Nicolas Brown
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is furnished
+to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+*/
+#pragma once
+
+#include <cstddef>
+#include <cstring>
+#include <new>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace loris
+{
+
+/*
+bump allocator for things that all die at the same time, like the ast of a source
+allocations are never freed one by one, Reset throws everything away in one go.
+only types that need no destructor can live here
+*/
+class Arena
+{
+	struct Block
+	{
+		char* data;
+		size_t size;
+	};
+
+	std::vector<Block> blocks;
+	size_t current;//index of the block being filled
+	char* pos;
+	char* end;
+
+	//big allocations get a block of their own, kept apart so Reset can drop them
+	std::vector<char*> largeAllocs;
+
+	static const size_t blockSize = 64 * 1024;
+
+	void* AllocateSlow(size_t size, size_t align);
+public:
+	Arena();
+	~Arena();
+
+	Arena(const Arena&) = delete;
+	Arena& operator=(const Arena&) = delete;
+
+	void* Allocate(size_t size, size_t align = alignof(std::max_align_t))
+	{
+		char* ptr = (char*)(((size_t)pos + align - 1) & ~(align - 1));
+		if (ptr + size > end)
+			return AllocateSlow(size, align);
+
+		pos = ptr + size;
+		return ptr;
+	}
+
+	template<typename T, typename... Args>
+	T* New(Args&&... args)
+	{
+		static_assert(std::is_trivially_destructible<T>::value, "arena objects are never destroyed");
+		return new (Allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+	}
+
+	//frees everything allocated so far. the first block is kept for reuse
+	void Reset();
+
+	//frees everything, including the first block
+	void Release();
+};
+
+/*
+characters owned by someone else, like the source code a token came from
+not null terminated
+*/
+class StringRef
+{
+	const char* data;
+	unsigned int length;
+public:
+	StringRef()
+	{
+		data = "";
+		length = 0;
+	}
+
+	StringRef(const char* str, size_t len)
+	{
+		data = str;
+		length = (unsigned int)len;
+	}
+
+	//string literals live forever, no need to copy them
+	template<size_t N>
+	StringRef(const char (&str)[N])
+	{
+		data = str;
+		length = N - 1;
+	}
+
+	const char* Data() const
+	{
+		return data;
+	}
+
+	size_t size() const
+	{
+		return length;
+	}
+
+	bool empty() const
+	{
+		return length == 0;
+	}
+
+	std::string str() const
+	{
+		return std::string(data, length);
+	}
+
+	operator std::string() const
+	{
+		return str();
+	}
+
+	bool operator==(const StringRef& other) const
+	{
+		return length == other.length && memcmp(data, other.data, length) == 0;
+	}
+
+	bool operator==(const std::string& other) const
+	{
+		return length == other.size() && memcmp(data, other.data(), length) == 0;
+	}
+
+	bool operator!=(const std::string& other) const
+	{
+		return !(*this == other);
+	}
+
+	template<size_t N>
+	bool operator==(const char (&str)[N]) const
+	{
+		return length == N - 1 && memcmp(data, str, N - 1) == 0;
+	}
+};
+
+inline bool operator==(const std::string& a, const StringRef& b)
+{
+	return b == a;
+}
+
+inline bool operator!=(const std::string& a, const StringRef& b)
+{
+	return !(b == a);
+}
+
+/*
+growable array that lives in an arena
+when it grows the old items are left behind in the arena
+*/
+template<typename T>
+class ArenaList
+{
+	static_assert(std::is_trivially_copyable<T>::value, "items are moved with memcpy");
+
+	T* items;
+	unsigned int count;
+	unsigned int capacity;
+public:
+	ArenaList()
+	{
+		items = nullptr;
+		count = 0;
+		capacity = 0;
+	}
+
+	void push_back(Arena* arena, const T& item)
+	{
+		if (count == capacity)
+		{
+			capacity = capacity == 0 ? 4 : capacity * 2;
+			T* grown = (T*)arena->Allocate(sizeof(T) * capacity, alignof(T));
+			if (count > 0)
+				memcpy(grown, items, sizeof(T) * count);
+			items = grown;
+		}
+
+		items[count++] = item;
+	}
+
+	size_t size() const
+	{
+		return count;
+	}
+
+	bool empty() const
+	{
+		return count == 0;
+	}
+
+	T& operator[](size_t index)
+	{
+		return items[index];
+	}
+
+	const T& operator[](size_t index) const
+	{
+		return items[index];
+	}
+
+	T& back()
+	{
+		return items[count - 1];
+	}
+
+	T* begin()
+	{
+		return items;
+	}
+
+	T* end()
+	{
+		return items + count;
+	}
+
+	const T* begin() const
+	{
+		return items;
+	}
+
+	const T* end() const
+	{
+		return items + count;
+	}
+};
+
+}
@@ -58,6 +58,9 @@ public:
 
 	Class* GetClass(string name);
 	Function* GetFunction(string name);
+
+	//functions and methods that havent been called since a lazy compile, see Compiler::SetLazy
+	size_t CountUncompiled();
 };
 
 }
\ No newline at end of file
@@ -27,17 +27,19 @@ WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 
 using namespace std;
 #include "lexer.hpp"
+#include "arena.hpp"
 
 namespace loris
 {
 
+/*
+nodes are allocated from the parser's arena and are all freed together once the
+source is compiled, so they cant own anything that needs a destructor.
+strings are StringRefs into the source code and lists are ArenaLists
+*/
 class ASTNode
 {
 public:
-	virtual ~ASTNode()
-	{
-	}
-
 	enum Type
 	{
 		//expressions
@@ -52,13 +54,17 @@ public:
 		//itentifiers and expressions
 		Iden,
 		PropAccess,
+		IndexAccess,
+		MapLiteral,
 		FunctionCall,
 		New,
 		Var,
 		//statements
 		IfStmt,
 		ReturnStmt,
+		YieldStmt,
 		WhileStmt,
+		ForStmt,
 		///definitions
 		Enum,
 		FunctionDef,
@@ -66,7 +72,8 @@ public:
 
 		//other
 		BlockStmt,
-		Neg
+		Neg,
+		Not
 	};
 
 	Type type;
@@ -79,16 +86,16 @@ class Statement:public ASTNode{
 class Block:public Statement
 {
 public:
-	vector<Statement*> statements;
+	ArenaList<Statement*> statements;
 
 	Block()
 	{
 		type = Type::BlockStmt;
 	}
 
-	void AddStatement(Statement *stmt)
+	void AddStatement(Arena* arena,Statement *stmt)
 	{
-		statements.push_back(stmt);
+		statements.push_back(arena,stmt);
 	}
 };
 
@@ -98,17 +105,17 @@ class FunctionDefinition;
 class Program:public ASTNode
 {
 public:
-	vector<ClassDefinition*> classes;
-	vector<FunctionDefinition*> functions;
+	ArenaList<ClassDefinition*> classes;
+	ArenaList<FunctionDefinition*> functions;
 
-	void AddClass(ClassDefinition* def)
+	void AddClass(Arena* arena,ClassDefinition* def)
 	{
-		classes.push_back(def);
+		classes.push_back(arena,def);
 	}
 
-	void AddFunction(FunctionDefinition* func)
+	void AddFunction(Arena* arena,FunctionDefinition* func)
 	{
-		functions.push_back(func);
+		functions.push_back(arena,func);
 	}
 
 };
@@ -116,19 +123,19 @@ public:
 class ImportStatement:public Statement
 {
 public:
-	vector<string> path;
+	ArenaList<StringRef> path;
 
-	void AddToPath(string part)
+	void AddToPath(Arena* arena,StringRef part)
 	{
-		path.push_back(part);
+		path.push_back(arena,part);
 	}
 };
 
 class ClassAttribDefinition:public ASTNode
 {
 public:
-	string name;
-	string type;
+	StringRef name;
+	StringRef type;
 	bool isStatic;
 	FunctionDefinition* init;//initialization expression enclosed in a function
 
@@ -142,12 +149,12 @@ public:
 		isStatic = stat;
 	}
 
-	void SetName(string name)
+	void SetName(StringRef name)
 	{
 		this->name = name;
 	}
 
-	void SetType(string type)
+	void SetType(StringRef type)
 	{
 		this->type = type;
 	}
@@ -158,44 +165,44 @@ class FunctionDefinition;
 class ClassDefinition:public ASTNode
 {
 public:
-	string name;
-	string superClass;
-	vector<ClassAttribDefinition*> attribs;
-	vector<FunctionDefinition*> functions;
+	StringRef name;
+	StringRef superClass;
+	ArenaList<ClassAttribDefinition*> attribs;
+	ArenaList<FunctionDefinition*> functions;
 
-	void SetName(string name)
+	void SetName(StringRef name)
 	{
 		this->name = name;
 	}
 
-	void SetSuperClass(string name)
+	void SetSuperClass(StringRef name)
 	{
 		this->superClass = name;
 	}
  
-	void AddAttrib(ClassAttribDefinition* attrib)
+	void AddAttrib(Arena* arena,ClassAttribDefinition* attrib)
 	{
-		attribs.push_back(attrib);
+		attribs.push_back(arena,attrib);
 	}
 
-	void AddFunction(FunctionDefinition* func)
+	void AddFunction(Arena* arena,FunctionDefinition* func)
 	{
-		functions.push_back(func);
+		functions.push_back(arena,func);
 	}
 };
 
 class FunctionParameter:public ASTNode
 {
 public:
-	string name;
-	string type;
+	StringRef name;
+	StringRef type;
 
-	void SetName(string name)
+	void SetName(StringRef name)
 	{
 		this->name = name;
 	}
 
-	void SetType(string type)
+	void SetType(StringRef type)
 	{
 		this->type = type;
 	}
@@ -204,20 +211,22 @@ public:
 class FunctionDefinition:public Statement
 {
 public:
-	vector<FunctionParameter*> params;
-	vector<Statement*> statements;
+	ArenaList<FunctionParameter*> params;
+	ArenaList<Statement*> statements;
 	//Block *block;
-	string name;
-	string returnType;
+	StringRef name;
+	StringRef returnType;
 	bool isStatic;
 	bool isConstructor;
 
 	FunctionDefinition()
 	{
 		type = ASTNode::FunctionDef;
+		isStatic = false;
+		isConstructor = false;
 	}
 
-	void SetName(string name)
+	void SetName(StringRef name)
 	{
 		this->name = name;
 	}
@@ -227,20 +236,20 @@ public:
 		isStatic = stat;
 	}
 
-	void SetReturnType(string type)
+	void SetReturnType(StringRef type)
 	{
 		this->returnType = type;
 	}
 
-	void AddParam(FunctionParameter* param)
+	void AddParam(Arena* arena,FunctionParameter* param)
 	{
-		params.push_back(param);
+		params.push_back(arena,param);
 	}
 
-	void AddStatement(Statement *stmt)
+	void AddStatement(Arena* arena,Statement *stmt)
 	{
 		//block->AddStatement(stmt);
-		statements.push_back(stmt);
+		statements.push_back(arena,stmt);
 	}
 };
 
@@ -268,9 +277,9 @@ public:
 class Identifier:public Expression
 {
 public:
-	string name;
+	StringRef name;
 
-	Identifier(string name)
+	Identifier(StringRef name)
 	{
 		this->name = name;
 		type = ASTNode::Iden;
@@ -306,9 +315,9 @@ public:
 		type = ASTNode::NumberLiteral;
 	}
 
-	NumberLiteral(string val)
+	NumberLiteral(StringRef val)
 	{
-		value = (float)atof(val.c_str());
+		value = Token::ToNumber(val);
 		type = ASTNode::NumberLiteral;
 	}
 };
@@ -316,9 +325,9 @@ public:
 class StringLiteral:public Expression
 {
 public:
-	std::string value;
+	StringRef value;
 
-	StringLiteral(std::string val)
+	StringLiteral(StringRef val)
 	{
 		value = val;
 		type = ASTNode::StringLiteral;
@@ -357,13 +366,23 @@ public:
 	}
 };
 
+class NotExpr:public Expression
+{
+public:
+	Expression* child;
+	NotExpr()
+	{
+		type = ASTNode::Not;
+	}
+};
+
 class PropertyAccess:public Expression
 {
 public:
 	Expression *obj;
-	string name;
+	StringRef name;
 
-	PropertyAccess(Expression *lhs,string rhs)
+	PropertyAccess(Expression *lhs,StringRef rhs)
 	{
 		obj = lhs;
 		name = rhs;
@@ -372,6 +391,41 @@ public:
 	}
 };
 
+//obj[index]
+class IndexAccess:public Expression
+{
+public:
+	Expression *obj;
+	Expression *index;
+
+	IndexAccess(Expression *lhs,Expression *idx)
+	{
+		obj = lhs;
+		index = idx;
+
+		type = ASTNode::IndexAccess;
+	}
+};
+
+//{ key: value, ... }
+class MapLiteral:public Expression
+{
+public:
+	ArenaList<Expression*> keys;
+	ArenaList<Expression*> values;
+
+	MapLiteral()
+	{
+		type = ASTNode::MapLiteral;
+	}
+
+	void AddPair(Arena* arena,Expression* key,Expression* value)
+	{
+		keys.push_back(arena,key);
+		values.push_back(arena,value);
+	}
+};
+
 class Arguments;
 
 class CallExpr:public Expression
@@ -392,10 +446,10 @@ public:
 class NewExpr:public Expression
 {
 public:
-	string name;
+	StringRef name;
 	Arguments* args;
 
-	NewExpr(string n,Arguments* rhs)
+	NewExpr(StringRef n,Arguments* rhs)
 	{
 		name = n;
 		args = rhs;
@@ -407,10 +461,10 @@ public:
 class VarExpr:public Expression
 {
 public:
-	string name;
-	string typeName;
+	StringRef name;
+	StringRef typeName;
 
-	VarExpr(string n,string t)
+	VarExpr(StringRef n,StringRef t)
 	{
 		name = n;
 		typeName = t;
@@ -422,11 +476,11 @@ public:
 class Arguments:public Expression
 {
 public:
-	vector<Expression*> args;
+	ArenaList<Expression*> args;
 
-	void AddArg(Expression* expr)
+	void AddArg(Arena* arena,Expression* expr)
 	{
-		args.push_back(expr);
+		args.push_back(arena,expr);
 	}
 };
 
@@ -461,6 +515,28 @@ public:
 	}
 };
 
+/*
+for(i in start..end) - counts from start up to but not including end
+for(x in expr) - iterates over the elements of an array or the keys of a map
+*/
+class ForStatement:public Statement
+{
+public:
+	StringRef name;
+	Expression* expr;//start of the range or the array/map being iterated
+	Expression* end;//null if not a range
+	Block* block;
+
+	ForStatement(StringRef n,Expression* e,Expression* rangeEnd,Block* b)
+	{
+		type = ASTNode::ForStmt;
+		name = n;
+		expr = e;
+		end = rangeEnd;
+		block = b;
+	}
+};
+
 class ReturnStatement:public Statement
 {
 public:
@@ -472,21 +548,33 @@ public:
 	}
 };
 
+class YieldStatement:public Statement
+{
+public:
+	Expression* expr;//null for a bare yield
+
+	YieldStatement()
+	{
+		type = ASTNode::YieldStmt;
+		expr = nullptr;
+	}
+};
+
 class EnumStatement:public Statement
 {
 public:
-	string name;
-	vector<string> values;
+	StringRef name;
+	ArenaList<StringRef> values;
 
-	EnumStatement(string n)
+	EnumStatement(StringRef n)
 	{
 		name = n;
 		type = ASTNode::Enum;
 	}
 
-	void AddValue(string val)
+	void AddValue(Arena* arena,StringRef val)
 	{
-		values.push_back(val);
+		values.push_back(arena,val);
 	}
 };
 
@@ -23,7 +23,7 @@ WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 
 #pragma once
 
-#include "loris\loris.hpp"
+#include "loris.hpp"
 
 namespace loris {
 
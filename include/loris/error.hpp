@@ -34,13 +34,16 @@ public:
 		NONE,
 		UNKOWN_CHAR,
 		UNEXPECTED_TOKEN,
-		INVALID_OPERATION
+		INVALID_OPERATION,
+		BUDGET_EXCEEDED,
+		FILE_ERROR
 	};
 
 	Type code;
 	std::string message;
 	int line;
 	std::string filename;
+	std::string stackTrace;//one frame per line, innermost first. only for runtime errors
 
 	Error()
 	{
@@ -26,17 +26,20 @@ WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 #include <string>
 #include <vector>
 #include "error.hpp"
+#include "arena.hpp"
 
 using namespace std;
 
 namespace loris
 {
 
+//the text of a token is a range of the source, see TokenStream::GetText
 struct Token
 {
 	enum Type
 	{
 		Dot,
+		Range,// ..
 		//keywords
 		Import,
 		Iden,
@@ -54,9 +57,11 @@ struct Token
 		Else,
 		Elif,
 		For,
+		In,
 		While,
 		Break,
 		Return,
+		Yield,
 		OpenBracket,
 		CloseBracket,
 		OpenParen,
@@ -97,7 +102,8 @@ struct Token
 	};
 
 	Type type;
-	string token;
+	unsigned int offset;//where the text starts in the source
+	unsigned int length;
 	int line;
 
 	static string GetTokenName(Token::Type type)
@@ -118,7 +124,10 @@ struct Token
 		TOKEN_MAP_NAME(Token::Comma,",");
 		TOKEN_MAP_NAME(Token::If,"if");
 		TOKEN_MAP_NAME(Token::For,"for");
+		TOKEN_MAP_NAME(Token::In,"in");
+		TOKEN_MAP_NAME(Token::Range,"..");
 		TOKEN_MAP_NAME(Token::While,"while");
+		TOKEN_MAP_NAME(Token::Yield,"yield");
 		TOKEN_MAP_NAME(Token::OpenParen,"(");
 		TOKEN_MAP_NAME(Token::CloseParen,")");
 		TOKEN_MAP_NAME(Token::OpenBracket,"[");
@@ -126,6 +135,10 @@ struct Token
 		TOKEN_MAP_NAME(Token::OpenCurlyBrace,"{");
 		TOKEN_MAP_NAME(Token::CloseCurlyBrace,"}");
 		TOKEN_MAP_NAME(Token::Assign,"=");
+		TOKEN_MAP_NAME(Token::Colon,":");
+		TOKEN_MAP_NAME(Token::And,"&&");
+		TOKEN_MAP_NAME(Token::Or,"||");
+		TOKEN_MAP_NAME(Token::Not,"!");
 
 		TOKEN_MAP_NAME(Token::EOS,"End of Stream");
 		
@@ -141,13 +154,12 @@ struct Token
 		return "";
 	}
 
+	//value of an Integer or Float token's text, the same as atof gives
+	static float ToNumber(StringRef text);
+
 	static Token EOSToken()
 	{
-		Token token;
-		token.line=-1;
-		token.type = Token::EOS;
-
-		return token;
+		return EOSToken(-1);
 	}
 
 	static Token EOSToken(int line)
@@ -155,6 +167,8 @@ struct Token
 		Token token;
 		token.line=line;
 		token.type = Token::EOS;
+		token.offset = 0;
+		token.length = 0;
 
 		return token;
 	}
@@ -165,26 +179,69 @@ class TokenStream
 public:
 	vector<Token> tokens;
 	unsigned int index;
+	const char* source;//the code that was lexed, owned by whoever lexed it
 
 	TokenStream();
-	void AddToken(Token t);
-	void AddToken(Token::Type type,string tok,int line);
+	void AddToken(Token::Type type,unsigned int offset,unsigned int length,int line);
 
-	Token NextToken();
-	Token::Type PeekTokenType(unsigned int look_ahead=0);
-	Token PeekToken(unsigned int look_ahead=0);
-	void Advance();
+	//points into the source, so it only lives as long as the source does
+	StringRef GetText(const Token& token)
+	{
+		return StringRef(source+token.offset,token.length);
+	}
+
+	//the parsers call these for almost every token, so they're kept inline
+	Token NextToken()
+	{
+		if(index<tokens.size())
+			return tokens[index++];
+
+		index+=1;
+		return Token::EOSToken();
+	}
+
+	Token::Type PeekTokenType(unsigned int look_ahead=0)
+	{
+		if(tokens.size()<=index+look_ahead)
+			return Token::EOS;
+
+		return tokens[index+look_ahead].type;
+	}
+
+	Token PeekToken(unsigned int look_ahead=0)
+	{
+		if(tokens.size()<=index+look_ahead)
+		{
+			//return line of previous token if there's any available
+			if(index>0)
+				return Token::EOSToken(tokens[index-1].line);
+			else
+				return Token::EOSToken(1);
+		}
+
+		return tokens[index+look_ahead];
+	}
+
+	void Advance()
+	{
+		index+=1;
+	}
 	
-	bool HasMore();
+	bool HasMore()
+	{
+		return index<tokens.size();
+	}
 };
 
+//reads the source in place, no copy is made
 class CharStream
 {
 public:
-	string chars;
+	const char* chars;
+	unsigned int size;
 	unsigned int index;
 
-	CharStream(string code);
+	CharStream(const char* code,size_t size);
 	int NextChar();
 	void Advance();
 	int PeekChar(unsigned int look_ahead=0);
@@ -198,7 +255,16 @@ public:
 	TokenStream *tokens;
 	CharStream *stream;
 	int line;
-	bool Parse(string code);
+
+	//the tokens point into code, so it has to outlive them
+	//firstLine is the line code starts on when it's only part of a source
+	bool Parse(const char* code,size_t size,int firstLine=1);
+	bool Parse(const string& code)
+	{
+		return Parse(code.data(),code.size());
+	}
+	//a temporary would be gone before the tokens are used
+	bool Parse(string&& code) = delete;
 
 	Lexer();
 	~Lexer();
@@ -215,10 +281,11 @@ private:
 	bool IsNumber();
 	void ReadNumber();
 
-	void ReadSingleQuotedString();
-	void ReadDoubleQuotedString();
+	void ReadString(char quote);
 
-	string StripComments(string);
+	//comments run from // to the end of the line
+	bool IsComment();
+	void ReadComment();
 
 	void AddToken(Token::Type type,bool advance=true);
 };
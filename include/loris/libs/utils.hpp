@@ -66,14 +66,49 @@ Value NativeArray(VirtualMachine* vm,Object* self)
 	auto arrayObj = arrayVar.AsArray();
 	for (int i = 0; i < vm->NumArgs(); i++)
 		arrayObj->elements.push_back(vm->GetArg(i));
+	LORIS_STATS(vm->GetStats().allocations[arrayObj->typeName]++);
 
 	//ignore args at the moment
 	return arrayVar;
 }
 
+//coroutine(name,args...)
+Value NativeCoroutine(VirtualMachine* vm,Object* self)
+{
+	Value name = vm->GetArg(0);
+	if (name.type != ValueType::String)
+	{
+		vm->RaiseError("coroutine expects the name of a function");
+		return Value::CreateNull();
+	}
+
+	Function* func = vm->GetAssembly()->GetFunction(name.AsString());
+	if (func == nullptr)
+	{
+		vm->RaiseError(std::string("function ") + name.AsString() + " not found");
+		return Value::CreateNull();
+	}
+
+	//pass the remaining args on, script functions expect them in reverse
+	std::vector<Value> params;
+	for (int i = vm->NumArgs() - 1; i > 0; i--)
+		params.push_back(vm->GetArg(i));
+
+	vm->ClearArgs();
+	for (auto& param : params)
+		vm->AddArg(param);
+
+	CoroutineObject* co = vm->CreateCoroutine(func, nullptr, true);
+	if (co == nullptr)
+		return Value::CreateNull();
+
+	return Value::CreateObject(co);
+}
+
 void Install(Assembly* lib)
 {
 	lib->AddFunction("str",NativeStr);
 	lib->AddFunction("array",NativeArray);
+	lib->AddFunction("coroutine",NativeCoroutine);
 }
 }
\ No newline at end of file
@@ -27,6 +27,9 @@ WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 #include "compiler.hpp"
 #include "error.hpp"
 #include "bind.hpp"
+#include "runtime.hpp"
+#include "profiler.hpp"
+#include "snapshot.hpp"
 
 
 namespace loris
@@ -43,7 +46,18 @@ public:
 
 	void AddSource(string source);
 	void AddSource(string filename, string source);
-	void AddFileSource(string filename);
+	//returns false if the file cant be read, Compile fails too
+	bool AddFileSource(const string& filename);
+	//loads the files concurrently, see Compiler::AddFileSources
+	bool AddFileSources(const vector<string>& filenames);
+	bool AddSourceDirectory(const string& dir, const string& pattern = "*.ls");
+
+	//skips building an ast, see Compiler::SetSinglePass
+	void SetSinglePass(bool singlePass);
+	//compiles each function on its first call, see Compiler::SetLazy
+	void SetLazy(bool lazy);
+	//reuses what was compiled from unchanged sources, see Compiler::SetCacheDirectory
+	void SetCacheDirectory(const string& dir);
 
 	bool HasError();
 
@@ -51,6 +65,16 @@ public:
 
 	bool Compile();
 
+	//see Assembly::CountUncompiled
+	size_t CountUncompiled();
+
+	//saves the compiled scripts and the heap, eg after running the init code. see Snapshot
+	bool SaveSnapshot(const string& filename);
+
+	//loads a saved snapshot instead of compiling
+	//native functions and classes have to be added first
+	bool LoadSnapshot(const string& filename);
+
 	Value ExecuteFunction(const string& name);
 
 	Value ExecuteFunction(Function* func);
@@ -67,14 +91,30 @@ public:
 		return (T)ExecuteFunction(name);
 	}
 
+	//looks the function up once for calling it many times, see VirtualMachine::InvokeBatch
+	CallSite Prepare(const string& name, int arity);
+
+	Value Invoke(const CallSite& site, const Value* args);
+
+	bool InvokeBatch(const CallSite& site, const Value* args, size_t count, Value* results = nullptr);
+
+	//creates a suspended coroutine for the script function, null if it doesnt exist
+	//coroutines created here are owned by the host, see DestroyCoroutine
+	CoroutineObject* CreateCoroutine(const string& name);
+
+	//runs the coroutine until its next yield or until it returns
+	Value Resume(CoroutineObject* co);
+
+	void DestroyCoroutine(CoroutineObject* co);
+
+	//counters filled in when built with LORIS_INSTRUMENT, see VMStats
+	VMStats& GetStats();
+
 	void AddFunction(const string& name, NativeFunction func);
 	void AddFunction(const string& name, std::function<Value(VirtualMachine*, Object*)> func);
 	void AddClass(Class* cls);
 
 	~Loris();
-
-private:
-	string ReadFile(const char *filename);
 };
 
 }
\ No newline at end of file
@@ -50,10 +50,8 @@ struct Op
 
 class Parser
 {
-	/*
-	holds node for cleaning up if parsing fails somewhere
-	*/
-	vector<ASTNode*> nodes;
+	//the ast and its strings, reset on every Parse
+	Arena arena;
 
 	Lexer* lex;
 	TokenStream* tokens;
@@ -64,9 +62,17 @@ public:
 	Expression* expr;//just for testing expression parsing
 
 	Parser();
+	~Parser();
 	Program *GetProgram();
 	
-	bool Parse(string code);
+	//the ast points into code, so it has to outlive the ast
+	bool Parse(const char* code,size_t size);
+	bool Parse(const string& code)
+	{
+		return Parse(code.data(),code.size());
+	}
+	//a temporary would be gone before the tokens are used
+	bool Parse(string&& code) = delete;
 
 	Program* ParseProgram(bool *ok);
 
@@ -79,7 +85,8 @@ public:
 	//	'class' iden ('extends' iden)? '{' (ClassAttribDefinition|functiondefinition)* '}'
 	ClassDefinition* ParseClassDefinition(bool* ok);
 
-	bool ParseExpr(string code);
+	bool ParseExpr(const string& code);
+	bool ParseExpr(string&& code) = delete;
 
 	Expression* ParseExpr(bool *ok);
 
@@ -94,6 +101,9 @@ public:
 
 	Op ParseOp(bool *ok);
 
+	//precedence and associativity of a binary operator, prec is 0 for anything else
+	static Op GetOp(Token::Type type);
+
 	//only numbers for now
 	Expression* ParsePrimary(bool *ok);
 
@@ -101,9 +111,15 @@ public:
 
 	Expression* ParseNegExpr(bool* ok);
 
+	//'!' primary
+	Expression* ParseNotExpr(bool* ok);
+
 	//'new' iden '(' args ')'
 	Expression* ParseNewExpr(bool *ok);
 
+	//'{' (expr ':' expr (',' expr ':' expr)*)? '}'
+	Expression* ParseMapLiteral(bool *ok);
+
 	/*
 	iden expr_suffix?
 	*/
@@ -153,6 +169,9 @@ public:
 
 	WhileStatement* ParseWhileStatement(bool *ok);
 
+	//'for' '(' 'var'? iden 'in' expr ('..' expr)? ')' block
+	ForStatement* ParseForStatement(bool *ok);
+
 	/*
 	'enum' EnumName '{' (EnumValue ('=' literal )? )*  '}'
 	}
@@ -160,6 +179,7 @@ public:
 	EnumStatement* ParseEnumStatement(bool *ok);
 
 	ReturnStatement* ParseReturnStatement(bool* ok);
+	YieldStatement* ParseYieldStatement(bool* ok);
 
 	Block* ParseBlock(bool *ok);
 
@@ -169,6 +189,9 @@ public:
 
 	Error GetError();
 
+	//frees the last ast and the lexer's tokens, the program is gone after this
+	void Release();
+
 private:
 	/*
 	Expects a token
@@ -182,8 +205,14 @@ private:
 	*/
 	void Consume(Token::Type type,bool *ok);
 
-	template<class T>
-	T* AddNode(T* node);
+	template<class T,typename... Args>
+	T* NewNode(Args&&... args)
+	{
+		return arena.New<T>(std::forward<Args>(args)...);
+	}
+
+	//consumes the next token and returns its text
+	StringRef NextText();
 
 	void Cleanup();
 };
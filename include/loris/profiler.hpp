@@ -0,0 +1,93 @@
+/*
+
+Copyright (C) 2014-2018 Nicolas Brown
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is furnished
+to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+*/
+#pragma once
+
+#include <map>
+#include <vector>
+#include <string>
+#include <ostream>
+
+#include "virtualmachine.hpp"
+
+namespace loris
+{
+
+/*
+sampling profiler for script code
+
+while it's set on a vm, the vm takes a sample every interval ticks (loop iterations
+and calls, see VirtualMachine::SetBudget). samples land on back edges and calls
+rather than on any instruction, but profiling costs nothing on the hot path and
+works in release builds since lines come from each function's line table.
+a profiler should only be set on one vm at a time
+*/
+class Profiler
+{
+public:
+	struct StackEntry
+	{
+		Function* function;
+		int pc;
+
+		bool operator<(const StackEntry& other) const
+		{
+			if (function != other.function)
+				return function < other.function;
+			return pc < other.pc;
+		}
+	};
+
+private:
+	long long interval;
+	Assembly* assembly;
+
+	//sample count for each unique call stack, outermost frame first
+	std::map<vector<StackEntry>, size_t> stacks;
+	size_t numSamples;
+
+	//reused between samples
+	vector<StackEntry> scratch;
+
+public:
+	Profiler(long long interval = 1000);
+
+	long long GetInterval();
+
+	//records the vm's current call stack
+	void Sample(VirtualMachine* vm, const deque<StackFrame*>& frames);
+
+	size_t GetNumSamples();
+
+	void Clear();
+
+	//one line per unique stack, outermost frame first, eg
+	//main.ls:main:12;main.ls:update:30 42
+	//flamegraph.pl, speedscope and pprof's folded importer all read this format
+	void WriteFoldedStacks(ostream& out);
+	string GetFoldedStacks();
+
+private:
+	string DescribeFrame(const StackEntry& entry);
+};
+
+}
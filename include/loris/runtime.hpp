@@ -0,0 +1,165 @@
+/*
+
+Copyright (C) 2014-2018 Nicolas Brown
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is furnished
+to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+*/
+#pragma once
+
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+
+#include "virtualmachine.hpp"
+#include "compiler.hpp"
+#include "error.hpp"
+
+
+namespace loris
+{
+
+struct ParallelBatch;
+
+/*
+compiles scripts once and hands out vms (contexts) that all run the same assembly
+
+the assembly isnt touched after Compile, so any number of threads can run it at
+once (with SetLazy functions are compiled on their first call, under a lock).
+each context has its own heap, globals and call stack, so a context must only be
+used by one thread at a time. native functions added here are shared by every
+context and have to be safe to call from several threads
+*/
+class LorisRuntime
+{
+	Compiler compiler;
+	Error error;
+	Assembly* assembly;
+	bool compiled;
+
+	//guards the pool, the contexts themselves arent locked
+	std::mutex poolMutex;
+	vector<VirtualMachine*> contexts;//every context created, owned by the runtime
+	vector<VirtualMachine*> idleContexts;
+
+	//threads for ForEachParallel, each with its own context. started on first use
+	size_t workerCount;
+	vector<std::thread> workers;
+	vector<VirtualMachine*> workerContexts;
+
+	std::mutex batchMutex;//one parallel batch runs at a time
+	std::mutex workMutex;//guards everything below
+	std::condition_variable workReady;
+	std::condition_variable workDone;
+	ParallelBatch* batch;
+	size_t batchId;
+	size_t pendingWorkers;
+	bool stopping;
+public:
+	LorisRuntime();
+
+	void AddSource(string source);
+	void AddSource(string filename, string source);
+	//returns false if the file cant be read, Compile fails too
+	bool AddFileSource(const string& filename);
+	//loads the files concurrently, see Compiler::AddFileSources
+	bool AddFileSources(const vector<string>& filenames);
+	bool AddSourceDirectory(const string& dir, const string& pattern = "*.ls");
+
+	//skips building an ast, see Compiler::SetSinglePass
+	void SetSinglePass(bool singlePass);
+	//compiles each function on its first call, see Compiler::SetLazy
+	void SetLazy(bool lazy);
+	//reuses what was compiled from unchanged sources, see Compiler::SetCacheDirectory
+	void SetCacheDirectory(const string& dir);
+
+	//functions and classes have to be added before Compile
+	void AddFunction(const string& name, NativeFunction func);
+	void AddFunction(const string& name, std::function<Value(VirtualMachine*, Object*)> func);
+	void AddClass(Class* cls);
+
+	bool Compile();
+
+	bool HasError();
+
+	Error GetError();
+
+	Assembly* GetAssembly();
+
+	//creates contexts up front, eg one per worker thread
+	void Reserve(size_t count);
+
+	//takes an idle context from the pool, creating one if none are free
+	//returns null if the scripts havent been compiled
+	VirtualMachine* AcquireContext();
+
+	//hands the context back to the pool. its heap is kept for the next user
+	void ReleaseContext(VirtualMachine* vm);
+
+	size_t NumContexts();
+
+	//number of threads ForEachParallel uses besides the calling one
+	//defaults to one less than the number of cores, must be set before the first batch
+	void SetWorkerCount(size_t count);
+	size_t GetWorkerCount();
+
+	/*
+	calls the method on every object, spreading them over the worker threads
+	idle threads steal objects from busy ones, so uneven methods still balance out
+
+	isolation rule: a call may only write to its own object (self) and to objects
+	it creates. reading other objects is fine as long as nothing writes to them
+	during the batch. static attribs are per context, so they shouldnt be written
+	to either. native functions called along the way have to be thread safe
+
+	gc is paused on vm and the workers for the duration of the batch, and objects
+	created by the workers are moved onto vm's heap once it's done
+	returns false and sets the error on vm if any call failed
+	*/
+	bool ForEachParallel(VirtualMachine* vm, const vector<Object*>& objects, const string& name, const vector<Value>& callArgs);
+
+	~LorisRuntime();
+
+private:
+	VirtualMachine* CreateContext();
+
+	void StartWorkers();
+	void WorkerLoop(size_t index);
+
+	//runs objects from the batch on vm until there are none left to take
+	void RunBatch(ParallelBatch* work, VirtualMachine* vm, size_t participant);
+};
+
+//holds onto a context for as long as it's in scope
+class RuntimeContext
+{
+	LorisRuntime* runtime;
+	VirtualMachine* vm;
+public:
+	RuntimeContext(LorisRuntime& runtime);
+	~RuntimeContext();
+
+	RuntimeContext(const RuntimeContext&) = delete;
+	RuntimeContext& operator=(const RuntimeContext&) = delete;
+
+	VirtualMachine* Get();
+
+	VirtualMachine* operator->();
+};
+
+}
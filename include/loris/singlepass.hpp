@@ -0,0 +1,196 @@
+/*
+
+Copyright (C) 2014-2018 Nicolas Brown
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is furnished
+to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+*/
+
+#pragma once
+
+#include <vector>
+#include <memory>
+
+#include "lexer.hpp"
+#include "parser.hpp"
+#include "virtualmachine.hpp"
+#include "assembly.hpp"
+
+namespace loris
+{
+
+/*
+what the single pass compiler knows about an expression once its code is emitted.
+it stands in for the ast node, with just enough of it to pick the instructions
+Compiler::CompileExpression would have picked for that node
+*/
+struct ExprDesc
+{
+	enum Kind
+	{
+		Value,//anything not listed below
+		Iden,//a lone identifier, a single LoadLocal
+		Number,//a number literal, a single LoadConstant
+		Var,//var x, emits nothing
+		PropAccess,//ends in LoadProp
+		IndexAccess,//ends in LoadIndex
+		Call,//ends in CallFunction or CallMethod
+		LocalPlusConstant,//ends in LoadLocalAddConstant and its Operand
+		Compare,//ends in one of the Is* ops
+		Assign
+	};
+
+	Kind kind;
+	StringRef name;//Iden, Var and LocalPlusConstant
+	float number;//Number, same precision as NumberLiteral
+
+	ExprDesc()
+	{
+		kind = Value;
+		number = 0;
+	}
+};
+
+/*
+a condition being compiled into jumps, see Compiler::CompileConditionalJump
+the jumps already emitted are kept in two lists until their target is known.
+the last part of the condition always has its code emitted but not its jump,
+since that depends on whether && or || comes next
+*/
+struct CondDesc
+{
+	vector<int> trueJumps;//taken when the condition is true
+	vector<int> falseJumps;
+	bool compare;//the last part ends in an Is* op, which becomes a compare and jump
+	bool negated;//the last part is under an odd number of !s
+
+	CondDesc()
+	{
+		compare = false;
+		negated = false;
+	}
+};
+
+/*
+compiles a source straight from its tokens into functions, without building an ast.
+it emits the same instructions as the parser and Compiler together would, so the
+two can be swapped freely. assignments and conditions need to know what comes after
+an expression, those parts are parsed twice or rewound and parsed again
+see Compiler::SetSinglePass
+*/
+class SinglePassCompiler
+{
+	Lexer lex;
+	TokenStream* tokens;
+	Assembly* assembly;
+	Function* func;//function being compiled
+	Function skipped;//code that gets thrown away goes here, see SkipBlock
+	int sourceIndex;
+	Error error;
+	Error callError;//first call of something that isnt a function or method
+
+	//set by CompileLazy, function bodies are only checked for matching braces
+	std::shared_ptr<const SourceBuffer> lazySource;
+
+	//where to go back to when an expression has to be compiled again
+	struct Mark
+	{
+		unsigned int token;
+		size_t instr;
+		size_t strings;
+		size_t constants;
+	};
+
+public:
+	SinglePassCompiler();
+
+	//adds the classes and functions in code to assembly
+	bool Compile(const char* code,size_t size,int sourceIndex,Assembly* assembly);
+
+	//same as Compile but leaves the function bodies for CompileBody,
+	//the functions keep source alive until then, a mapped source is copied first
+	bool CompileLazy(std::shared_ptr<const SourceBuffer> source,int sourceIndex,Assembly* assembly);
+
+	//compiles a body left by CompileLazy. safe to call from any thread
+	//on failure the function stays uncompiled and error says why
+	static bool CompileBody(Function* func,Error& error);
+
+	Error GetError();
+
+private:
+	bool CompileSource(const char* code,size_t size);
+
+	void* ParseClassDefinition(bool *ok);
+	void* ParseClassAttrib(Class* cls,bool isStatic,bool *ok);
+	Function* ParseFunctionDefinition(bool isConstructor,bool *ok);
+	void* ParseFunctionBody(bool *ok);
+	void* SkipFunctionBody(bool *ok);
+	void* ParseImportStatement(bool *ok);
+
+	//statements at the top of a function body are compiled a little differently,
+	//their values arent popped and blocks are skipped. see Compiler::CompileFunction
+	void* ParseStatement(bool topLevel,bool *ok);
+	void* ParseBlock(bool *ok);
+	void* ParseIfStatement(bool *ok);
+	void* ParseWhileStatement(bool *ok);
+	void* ParseForStatement(bool *ok);
+	void* ParseReturnStatement(bool *ok);
+	void* ParseYieldStatement(bool *ok);
+
+	//parses the next part of the source into a function that gets thrown away
+	void* SkipBlock(bool *ok);
+	void* SkipExpr(bool *ok);
+	void ClearSkipped();
+
+	void* ParseExpr(ExprDesc& expr,bool *ok);
+	void* ParseBinaryExpr(int minPrec,ExprDesc& expr,bool *ok);
+	void* ParsePrimary(ExprDesc& expr,bool *ok);
+	void* ParseVarExpr(ExprDesc& expr,bool *ok);
+	void* ParseNewExpr(ExprDesc& expr,bool *ok);
+	void* ParseMapLiteral(ExprDesc& expr,bool *ok);
+	void* ParseMemberExprSuffix(ExprDesc& expr,bool *ok);
+	void* ParseArgs(int* count,bool *ok);
+
+	//the condition's jumps that are taken when it is jumpIfTrue are added to jumps,
+	//the others go to the instruction after the condition
+	void* ParseConditionalJump(bool jumpIfTrue,vector<int>& jumps,bool *ok);
+	void* ParseOrCondition(CondDesc& cond,bool *ok);
+	void* ParseAndCondition(CondDesc& cond,bool *ok);
+	void* ParseConditionPart(CondDesc& cond,bool *ok);
+	void* ParseConditionPrimary(CondDesc& cond,bool *ok);
+
+	//emits the jump for the last part of the condition, taken when the condition is whenTrue
+	void EmitConditionJump(CondDesc& cond,bool whenTrue);
+
+	int Emit(OpCode op,int val=0);
+	int AddString(StringRef str);
+	int AddConstant(Value val);
+	void EmitLocalConstantOp(OpCode op,StringRef local,double amount);
+	void PatchJumps(vector<int>& jumps);
+	void AddLine(int line);
+
+	Mark GetMark();
+	void Rewind(const Mark& mark);
+
+	void Expect(Token::Type type,bool *ok);
+	void Consume(Token::Type type,bool *ok);
+	void ReportUnexpectTokenError(Token token);
+	StringRef NextText();
+};
+
+}
@@ -0,0 +1,136 @@
+/*
+
+Copyright (C) 2014-2018 Nicolas Brown
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is furnished
+to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+*/
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+#include "virtualmachine.hpp"
+#include "assembly.hpp"
+#include "error.hpp"
+
+namespace loris
+{
+
+/*
+a vm's heap and the assembly it runs, saved to a file so a process can skip
+compiling the scripts and running their init code
+
+the heap is everything reachable from the class objects: static attribs and
+whatever they point to. stack frames, pending args and coroutines arent saved,
+so snapshots are taken between calls. objects holding native data cant be saved
+
+native functions and classes are saved by name only, the host has to add them
+to the assembly again before reading. the file is only meant to be read back
+by the same build of loris on the same kind of machine. a damaged file is
+caught, but the code in it isnt checked, so only read snapshots you wrote
+*/
+class Snapshot
+{
+	//writing
+	std::string out;
+	vector<Function*> functions;
+	unordered_map<Function*,int> functionIds;
+	vector<Object*> objects;
+	unordered_map<Object*,int> objectIds;
+
+	//reading
+	const char* in;
+	size_t size;
+	size_t pos;
+	vector<Function*> readFunctions;
+	vector<Object*> readObjects;
+	int sourceIndex;//what the functions and classes read get, -1 to keep the saved one
+	Assembly* host;//holds the natives, and classes the file refers to but doesnt have
+
+	Error error;
+
+	Snapshot();
+public:
+	//functions left by a lazy compile are compiled first
+	static bool Write(VirtualMachine* vm,const string& filename,Error& error);
+
+	//adds the snapshot's functions and classes to assembly, sets vm to run it and
+	//puts the heap back. assembly should already hold the natives
+	//the snapshot's sources go after any already in assembly. nothing changes if it fails
+	static bool Read(const string& filename,Assembly* assembly,VirtualMachine* vm,Error& error);
+
+	//just the classes and functions compiled from one source, no heap. used by
+	//Compiler::SetCacheDirectory, the file is replaced atomically
+	static bool WriteSource(Assembly* assembly,int sourceIndex,const string& filename);
+
+	//adds the classes and functions to assembly as if they'd been compiled from
+	//source sourceIndex. parent classes are left for the compiler to resolve
+	//nothing is added if the file is missing or damaged
+	static bool ReadSource(const string& filename,Assembly* assembly,int sourceIndex);
+
+	//changes whenever the opcodes or the size of what's saved change, files from
+	//a build with a different fingerprint are refused
+	static unsigned long long GetFingerprint();
+
+	//fnv-1a, adds size bytes of data to hash
+	static void Hash(unsigned long long& hash,const void* data,size_t size);
+
+private:
+	bool Fail(const string& message);
+
+	void WriteHeader(const char* magic);
+	//source -1 writes everything
+	bool WriteAssembly(Assembly* assembly,int source);
+	bool AddFunction(Function* func);
+	void WriteFunctionRef(Function* func);
+	void WriteFunction(Function* func);
+	void WriteClass(Class* cls);
+	bool WriteHeap(VirtualMachine* vm);
+	bool AddObject(Object* obj);
+	bool AddValue(const Value& val);
+	void WriteValue(const Value& val);
+	void WriteObject(Object* obj);
+
+	void WriteInt(unsigned int val);
+	void WriteNumber(double val);
+	void WriteString(const string& str);
+
+	bool ReadHeader(const char* magic,const string& filename);
+	//reads into a scratch assembly, Merge hands it over and Discard frees it
+	bool ReadAssembly(Assembly* assembly);
+	void Merge(Assembly* scratch,Assembly* assembly);
+	void Discard(Assembly* scratch);
+	Class* FindClass(Assembly* scratch,const string& name);
+	bool ResolveParents(Assembly* assembly);
+	bool ReadFunction(Function*& func);
+	bool ReadFunctionRef(Function*& func);
+	bool ReadClass(Assembly* assembly);
+	bool ReadHeap(Assembly* assembly,unordered_map<string,Value>& globals);
+	bool ReadValue(Value& val);
+	bool ReadObject(Object* obj);
+
+	bool ReadInt(unsigned int& val);
+	bool ReadCount(unsigned int& count);
+	bool ReadNumber(double& val);
+	bool ReadString(string& str);
+};
+
+}
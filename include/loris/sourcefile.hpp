@@ -0,0 +1,94 @@
+/*
+
+Copyright (C) 2014-2018 Nicolas Brown
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is furnished
+to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+*/
+
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+namespace loris
+{
+
+/*
+the text of a script. either owns a string or a file mapped into memory,
+so a file can go to the lexer without being copied
+not null terminated
+*/
+class SourceBuffer
+{
+	std::string text;//the source when it isnt mapped
+	const char* data;
+	size_t size;
+
+	void* mapping;
+	size_t mappingSize;
+
+	void Unmap();
+public:
+	SourceBuffer();
+	explicit SourceBuffer(std::string text);
+	~SourceBuffer();
+
+	SourceBuffer(SourceBuffer&& other);
+	SourceBuffer& operator=(SourceBuffer&& other);
+
+	SourceBuffer(const SourceBuffer&) = delete;
+	SourceBuffer& operator=(const SourceBuffer&) = delete;
+
+	//big files are mapped, small ones are read in one go since a mapping costs more than the copy
+	//returns false if the file cant be read
+	bool Load(const std::string& filename);
+
+	const char* Data() const
+	{
+		return data;
+	}
+
+	size_t Size() const
+	{
+		return size;
+	}
+
+	//a mapped file sees later changes to the file, and a truncated one faults when read
+	bool IsMapped() const
+	{
+		return mapping != nullptr;
+	}
+};
+
+//* matches any run of chars and ? any single char
+bool MatchGlob(const char* pattern, const char* name);
+
+//adds dir/name to files for every file in dir matching pattern, sorted by name
+//returns false if the directory cant be opened
+bool ListFiles(const std::string& dir, const std::string& pattern, std::vector<std::string>& files);
+
+//loads the files on up to threads threads at once, buffers[i] holds filenames[i]
+//returns the index of a file that couldnt be read, or filenames.size() if all of them were
+size_t LoadFiles(const std::vector<std::string>& filenames, std::vector<SourceBuffer>& buffers, size_t threads);
+
+//writes data to a temp file and renames it over filename, so readers see the old file or the whole new one
+bool WriteFileAtomic(const std::string& filename, const std::string& data);
+
+}
@@ -26,14 +26,19 @@ WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 
 #include <string>
 #include <vector>
+#include <atomic>
+#include <memory>
 #include <stack>
 #include <deque>
 #include <unordered_map>
+#include <unordered_set>
+#include <chrono>
 #include <assert.h>
 #include <iostream>
 #include "string.h"
 #include "assembly.hpp"
 #include "error.hpp"
+#include "sourcefile.hpp"
 
 namespace loris
 {
@@ -47,10 +52,14 @@ typedef char byte;
 struct DSInstr;
 class Object;
 struct ArrayObject;
+struct MapObject;
 struct Function;
 class VirtualMachine;
 class Value;
 class Class;
+class LorisRuntime;
+class Profiler;
+class Snapshot;
 
 struct ValueType
 {
@@ -61,6 +70,7 @@ struct ValueType
 		String,
 		Object,
 		Array,
+		Map,
 		Null,
 	};
 };
@@ -79,6 +89,7 @@ public:
 		void* data;
 		Object* obj;
 		ArrayObject* arr;
+		MapObject* map;
 	}val;
 
 	bool marked;//for mark and sweep
@@ -86,6 +97,9 @@ public:
 	
 	Value(const Value& other);
 	Value& operator=(const Value& other);
+	//moving hands the string over instead of copying it, so growing a vector of values doesnt copy every string
+	Value(Value&& other) noexcept;
+	Value& operator=(Value&& other) noexcept;
 	Value();
 
 	//conversions
@@ -99,6 +113,8 @@ public:
 
 	ArrayObject* AsArray();
 
+	MapObject* AsMap();
+
 	//display
 	void Print(bool newLine=true);
 	~Value();
@@ -109,11 +125,15 @@ public:
 
 	static Value CreateNumber(double val);
 	static Value CreateString(const char* val);
+	//val doesnt have to be null terminated
+	static Value CreateString(const char* val,size_t length);
 
 	static Value CreateObject(Object* obj);
 
 	static Value CreateArray();
 
+	static Value CreateMap();
+
 	static Value CreateClass(VirtualMachine* vm,Class* cls);
 
 	template<typename T>
@@ -131,11 +151,16 @@ class Object
 {
 protected:
 	friend class GC;
+	friend class VirtualMachine;
+	friend class Snapshot;
 
 	unordered_map<string,Value> vars;
 	unordered_map<string,Function*> methods;
 
 	bool isArray;
+	bool isMap;
+	bool isCoroutine;
+	bool isClass;
 	
 	bool marked;//for gc, mark and sweep
 
@@ -157,6 +182,8 @@ public:
 	Function* destructor;
 
 	Object();
+	//arrays and maps are deleted through Object pointers by the gc
+	virtual ~Object(){}
 	bool HasAttrib(string name);
 	Value GetAttrib(string name);
 	void SetAttrib(string name,Value value);
@@ -187,21 +214,158 @@ struct ArrayObject:public Object
 	static Value RemoveAt(VirtualMachine* vm,Object* self);
 };
 
+struct MapEntry
+{
+	enum State
+	{
+		Empty,
+		Used,
+		Deleted//tombstone, keeps probe chains intact after a removal
+	};
+
+	Value key;
+	Value value;
+	unsigned int hash;
+	State state;
+
+	MapEntry()
+	{
+		hash = 0;
+		state = Empty;
+	}
+};
+
+/*
+hash map keyed by numbers, strings, bools or object identity
+uses open addressing with linear probing so lookups walk a single contiguous
+array instead of chasing buckets. the capacity is always a power of two
+*/
+struct MapObject:public Object
+{
+	vector<MapEntry> entries;
+	size_t count;//live entries
+	size_t used;//live entries + tombstones
+
+	MapObject();
+
+	//returns false if key cant be used as a map key
+	static bool IsValidKey(const Value& key);
+	static unsigned int Hash(const Value& key);
+	static bool KeysEqual(const Value& a,const Value& b);
+
+	//returns null if the key isnt in the map
+	Value* Find(const Value& key);
+	void Set(const Value& key,const Value& value);
+	bool Remove(const Value& key);
+	void Clear();
+
+	//def size()
+	static Value GetSize(VirtualMachine* vm,Object* self);
+
+	//def get(key)
+	static Value GetEl(VirtualMachine* vm,Object* self);
+
+	//def set(key,val)
+	static Value SetEl(VirtualMachine* vm,Object* self);
+
+	//def has(key)
+	static Value HasEl(VirtualMachine* vm,Object* self);
+
+	//def remove(key)
+	static Value RemoveEl(VirtualMachine* vm,Object* self);
+
+	//def keys()
+	static Value GetKeys(VirtualMachine* vm,Object* self);
+
+	//def values()
+	static Value GetValues(VirtualMachine* vm,Object* self);
+
+	//def clear()
+	static Value ClearEls(VirtualMachine* vm,Object* self);
+
+private:
+	size_t FindSlot(const Value& key,unsigned int hash);
+	void Grow();
+};
+
+/*
+the object a class's name refers to, holding its static attribs and methods
+made the first time the name is used, see VirtualMachine::LoadLocal
+a static attrib's init runs the first time the attrib is read. one that's
+written first never runs it
+*/
+struct ClassObject:public Object
+{
+	Class* cls;
+
+	//static attribs whose init hasnt run yet, or failed and runs again on the next read
+	unordered_map<string,Function*> pendingInits;
+
+	//static attribs whose init is running, an init reading its own attrib gets null
+	unordered_set<string> runningInits;
+
+	ClassObject(Class* cls);
+};
+
+struct StackFrame;
+
+/*
+a script function that can be paused with yield and resumed later
+its frames are kept here while it's suspended instead of on the native stack,
+so a waiting coroutine costs no more than the frames themselves
+*/
+struct CoroutineObject:public Object
+{
+	enum Status
+	{
+		Suspended,//not started yet or paused by a yield
+		Running,
+		Done//returned or failed, resuming it does nothing
+	};
+
+	Status status;
+
+	//the suspended call's frames, outermost first. empty while it runs
+	vector<StackFrame*> frames;
+
+	//depth of the coroutine's first frame on the vm's frame stack while it runs
+	size_t baseDepth;
+
+	//coroutine that resumed this one, null if it was resumed from outside any coroutine
+	CoroutineObject* resumer;
+
+	//args of the call it was suspended at for running out of budget, given back on resume
+	vector<Value> args;
+
+	CoroutineObject();
+	~CoroutineObject();
+
+	bool IsDone();
+
+	//def resume()
+	static Value Resume(VirtualMachine* vm,Object* self);
+
+	//def done()
+	static Value GetDone(VirtualMachine* vm,Object* self);
+};
+
 /*
 Garbage Collector
 */
 class GC
 {
-	//not ideal for this kinda thing
-	//but it's quick, dirty and gets the job done
-	static vector<Object*> objects;
 public:
+	//objects are tracked by the vm that created them, each vm has its own heap
 	static void AddObject(VirtualMachine* vm,Object* obj,bool doGC=true);
 
 	static void Collect(VirtualMachine* vm);
 
-	static void MarkObject(Object* obj);
-	static void MarkArray(ArrayObject* obj);
+	static void MarkValue(VirtualMachine* vm,const Value& val);
+	static void MarkObject(VirtualMachine* vm,Object* obj);
+	static void MarkArray(VirtualMachine* vm,ArrayObject* obj);
+	static void MarkMap(VirtualMachine* vm,MapObject* obj);
+	static void MarkCoroutine(VirtualMachine* vm,CoroutineObject* obj);
+	static void MarkFrame(VirtualMachine* vm,StackFrame* frame);
 
 	static void Sweep(VirtualMachine* vm);
 };
@@ -241,11 +405,68 @@ public:
 
 	Function* GetMethod(string name)
 	{
-		//todo: check if method exists
-		return methods[name];
+		//lookups dont insert, classes are shared by every vm running the assembly
+		auto iter = methods.find(name);
+		if(iter!=methods.end())
+			return iter->second;
+		return nullptr;
 	}
 };
 
+/*
+maps instructions back to the source lines they came from
+each run of instructions from the same line is stored as the change in pc and
+line from the previous run, as variable length ints, so most runs take 2 bytes
+*/
+class LineTable
+{
+	vector<unsigned char> data;
+
+	//start of the last run, so it can be rewritten
+	size_t lastOffset;
+	int lastPc;
+	int lastLine;
+	int prevPc;//pc and line of the run before the last one
+	int prevLine;
+
+	void WriteRun(int pc,int line);
+
+	friend class Snapshot;
+public:
+	LineTable()
+	{
+		Clear();
+	}
+
+	//instructions from pc onwards came from line. pc never goes down
+	void Add(int pc,int line);
+
+	//line of the instruction at pc, -1 if unknown
+	int GetLine(int pc) const;
+
+	bool IsEmpty() const
+	{
+		return data.empty();
+	}
+
+	//bytes used by the encoded table
+	size_t GetSize() const
+	{
+		return data.size();
+	}
+
+	void Clear();
+};
+
+//where to find the body of a function that hasnt been compiled yet, see Compiler::SetLazy
+struct LazyBody
+{
+	std::shared_ptr<const SourceBuffer> source;
+	size_t start;//offset of the body's '{'
+	size_t end;//offset just past its '}'
+	int line;//line of the '{'
+};
+
 struct Function
 {
 	string name;
@@ -257,6 +478,9 @@ struct Function
 	vector<string> args;
 	vector<DSInstr> instr;//instructions
 
+	//filled in by the compiler, used for error lines, stack traces and the profiler
+	LineTable lines;
+
 	bool isNative;
 	std::function<Value(VirtualMachine*, Object*)> nativeFunction;
 
@@ -264,6 +488,10 @@ struct Function
 
 	int sourceIndex;
 
+	//set until the first call compiles the body, see SinglePassCompiler::CompileBody
+	//the args and everything above are filled in either way
+	std::atomic<LazyBody*> lazy;
+
 	Function()
 	{
 		isNative = false;
@@ -271,6 +499,23 @@ struct Function
 
 		sourceIndex = 1;
 		isStatic = false;
+		lazy = nullptr;
+	}
+
+	~Function()
+	{
+		delete lazy.load();
+	}
+
+	bool IsCompiled() const
+	{
+		return lazy.load(std::memory_order_acquire)==nullptr;
+	}
+
+	//line of the instruction at pc, -1 if unknown
+	int GetLine(int pc) const
+	{
+		return lines.GetLine(pc);
 	}
 };
 
@@ -290,16 +535,27 @@ enum class OpCode:byte
 	StoreLocal,
 	LoadProp,//value = prop name string index, stack top = object, stack top -1 = value
 	StoreProp,
+	LoadIndex,//stack top = index, stack top -1 = array or map
+	StoreIndex,//stack top = index, stack top -1 = array or map, stack top -2 = value
 	LoadBool,
 	LoadNull,
 	//unconditionally remove top var, used for lhs expressions those returned values dont get used
 	Pop,
 
+	//superinstructions for common sequences, both are followed by an Operand
+	//holding the constant's index
+	IncrementLocal,//value = local name string index. local = local + constant
+	LoadLocalAddConstant,//value = local name string index. pushes local + constant
+	Operand,//extra operand for the instruction before it, never executed
+
 	//objects
 	CreateInstance,
+	CreateMap,//value = number of key/value pairs on the stack
 	CallMethod,
 	CallStaticMethod,
 	CallFunction,
+	TailCall,//same as CallFunction but replaces the current frame and returns the result
+	TailCallMethod,//same as CallMethod but replaces the current frame and returns the result
 	AddArg,
 
 	//comparison
@@ -310,15 +566,38 @@ enum class OpCode:byte
 	IsGreaterThanOrEqual,
 	IsNotEqual,
 
+	//logical
+	Not,
+
 	//jumps
 	JumpIfTrue,
 	JumpIfFalse,
+	JumpIfTrueOrPop,//jumps if stack top is true and leaves it there, otherwise pops it. used by ||
+	JumpIfFalseOrPop,//used by &&
 	Jump,
 
+	//compare and jump, no bool is pushed
+	//stack top = right operand, stack top -1 = left operand, both get popped
+	JumpIfEqual,
+	JumpIfNotEqual,
+	JumpIfLessThan,
+	JumpIfLessThanOrEqual,
+	JumpIfGreaterThan,
+	JumpIfGreaterThanOrEqual,
+	JumpIfNotLessThan,
+	JumpIfNotLessThanOrEqual,
+	JumpIfNotGreaterThan,
+	JumpIfNotGreaterThanOrEqual,
+
+	//loops
+	ForPrep,//value = loop var string index, stack top = range end, stack top -1 = range start
+	ForIterPrep,//value = loop var string index, stack top = array or map
+	ForLoop,//value = index of the first instruction of the loop body
+
 	//return
 	Return,
+	Yield,//stack top = value handed to the resumer, suspends the running coroutine
 
-	Line,//for debugging
 	Nop,//(no operation) does nothing, helps with generating if,while and for statements
 
 };
@@ -329,6 +608,73 @@ struct DSInstr
 	short val;
 };
 
+//instrumentation code is only compiled in with LORIS_INSTRUMENT defined
+#ifdef LORIS_INSTRUMENT
+#define LORIS_STATS(x) x
+#else
+#define LORIS_STATS(x)
+#endif
+
+//Nop is always the last opcode
+const int NUM_OPCODES = (int)OpCode::Nop+1;
+
+const char* GetOpCodeName(OpCode op);
+
+struct FunctionStats
+{
+	unsigned long long calls;
+	double time;//seconds spent in the function and everything it called, recursive calls are counted at every level
+
+	FunctionStats()
+	{
+		calls = 0;
+		time = 0;
+	}
+};
+
+/*
+counters the vm fills in when built with LORIS_INSTRUMENT
+without it everything stays at 0
+*/
+struct VMStats
+{
+	unsigned long long opCounts[NUM_OPCODES];
+
+	//script and native functions. time includes time spent suspended in a coroutine
+	unordered_map<Function*,FunctionStats> functions;
+
+	//objects created, by class name
+	unordered_map<string,unsigned long long> allocations;
+
+	unsigned long long nativeCalls;
+
+	unsigned long long gcCollections;
+	double gcPauseTime;//seconds, all collections together
+	double gcMaxPause;
+
+	VMStats()
+	{
+		Reset();
+	}
+
+	void Reset();
+
+	//true if the library was built with LORIS_INSTRUMENT
+	static bool IsEnabled();
+
+	string ToJson() const;
+};
+
+//state of a running for loop
+//the counter is kept as a raw double here instead of a boxed local
+struct LoopState
+{
+	double counter;//current value for ranges, current index for arrays and maps
+	double limit;
+	Value iterable;//array or map being iterated, null for ranges
+	Value* var;//loop variable's slot in the frame's locals
+};
+
 struct StackFrame
 {
 	Function* function;
@@ -336,10 +682,48 @@ struct StackFrame
 	
 	deque<Value> stack;
 
+	//active for loops, innermost last
+	vector<LoopState> loops;
+
+	//index of the instruction being executed, saved while this frame waits on a call
+	int cp;
+
+	//set if this frame is running a constructor
+	//the object is returned to the caller instead of the function's return value
+	Object* constructed;
+
+	//pinned frames belong to whoever pushed them and arent returned to the pool when popped
+	bool pinned;
+
+	//when the call started, only set with LORIS_INSTRUMENT
+	chrono::steady_clock::time_point callStart;
+
 public:
 	StackFrame()
 	{
 		function=nullptr;
+		cp = -1;
+		constructed = nullptr;
+		pinned = false;
+	}
+};
+
+//a function looked up once so the host can call it many times
+//without going through the assembly or AddArg
+struct CallSite
+{
+	Function* function;
+	int arity;//number of args each call takes
+
+	CallSite()
+	{
+		function = nullptr;
+		arity = 0;
+	}
+
+	bool IsValid() const
+	{
+		return function!=nullptr;
 	}
 };
 
@@ -350,22 +734,71 @@ class VirtualMachine
 
 	Value ret;
 
-	int lineNo;//line for debugging
+	//set by RaiseError until Execute fills in the error's line and stack trace
+	bool errorTracePending;
 	Error error;
+
+	//script calls dont use the native stack, so this is what stops runaway recursion
+	int maxCallDepth;
 	vector<Value> args;
 
 	//contains classes and function definitions
 	Assembly* assembly;
 
-	//is this even being used?
+	//class objects, added the first time their class is used
 	unordered_map<string,Value> globals;
 
 	Value nullVal;
 	Value selfVal;
 
+	//innermost coroutine being resumed, null if none
+	CoroutineObject* runningCoroutine;
+
+	//coroutines owned by the host, these are gc roots until they're destroyed
+	vector<CoroutineObject*> hostCoroutines;
+
+	//results of the InvokeBatch calls still running and how many are filled in,
+	//these are gc roots until the batch returns
+	vector<std::pair<Value*,size_t>> batchResults;
+
+	//every object the gc is tracking for this vm
+	//not ideal for this kinda thing
+	//but it's quick, dirty and gets the job done
+	vector<Object*> gcObjects;
+
+	//everything marked during a collection, so it can be unmarked afterwards
+	vector<Object*> gcVisited;
+
+	//collections dont run while this is false, used while other threads touch the heap
+	bool gcEnabled;
+
+	//heap size that triggers the next collection
+	size_t gcThreshold;
+
+	//runtime this vm is a context of, null for standalone vms
+	LorisRuntime* runtime;
+
+	//execution budget, a tick is spent on every loop iteration and every call
+	//only the countdown is touched on the hot path, the rest is looked at once it hits 0
+	long long budgetCountdown;
+	long long budgetTicks;//ticks not handed to the countdown yet
+	bool budgetLimited;
+	bool hasDeadline;
+	chrono::steady_clock::time_point deadline;
+	long long budgetRefill;//size of the countdown's last refill
+
+	//samples the call stack every so many ticks while set
+	Profiler* profiler;
+	long long profileTicks;//ticks since the last sample
+
+	VMStats stats;
+
 	friend class GC;
+	friend class Snapshot;
 public:
 	VirtualMachine();
+	//frees the heap, class objects and any coroutines the host didnt destroy
+	~VirtualMachine();
 
 	StackFrame* GetStackFrame();
 	void ReturnStackFrame(StackFrame* frame);
@@ -379,6 +812,40 @@ public:
 	int GetErrorLine();
 
 	void SetAssembly(Assembly* assem);
+	Assembly* GetAssembly();
+
+	void SetMaxCallDepth(int depth);
+	int GetMaxCallDepth();
+
+	//stops scripts after this many ticks, counting loop iterations and calls
+	//running out inside a coroutine suspends it instead, so it can be resumed
+	//once the budget is topped up. 0 removes the limit
+	void SetBudget(long long ticks);
+
+	//same as SetBudget but counts time from now. 0 removes the limit
+	void SetTimeBudget(double milliseconds);
+
+	//-1 if there's no tick limit
+	long long GetBudgetLeft();
+	bool IsBudgetExhausted();
+
+	//null turns profiling off. the profiler isnt owned by the vm
+	void SetProfiler(Profiler* prof);
+	Profiler* GetProfiler();
+
+	//see VMStats
+	VMStats& GetStats();
+	void ResetStats();
+
+	void SetGCEnabled(bool enabled);
+	bool IsGCEnabled();
+
+	//moves the objects on other's heap from index start onwards to this vm's heap
+	void AdoptHeap(VirtualMachine* other,size_t start = 0);
+	size_t GetHeapSize();
+
+	void SetRuntime(LorisRuntime* rt);
+	LorisRuntime* GetRuntime();
 
 	//wth this, objects being created from c++ dont risk the chance of being GC'ed while being instantiated
 	Object* CreateNativeObject(Class* cls,bool addToGC = true);
@@ -396,28 +863,134 @@ public:
 	
 	Value ExecuteMemberFunction(Object* obj,string name);
 
+	//calls the method on every object, args are given in declaration order
+	//returns false and stops at the first call that raises an error
+	bool ForEach(const vector<Object*>& objects,const string& name,const vector<Value>& callArgs = vector<Value>());
+
+	//same as ForEach, but contexts of a LorisRuntime spread the objects across the
+	//runtime's worker threads. see LorisRuntime::ForEachParallel for what the method
+	//is allowed to touch
+	bool ForEachParallel(const vector<Object*>& objects,const string& name,const vector<Value>& callArgs = vector<Value>());
+
 	Value ExecuteFunction(Function* func);
 
+	//returns an invalid call site if the function doesnt exist
+	CallSite Prepare(const string& name,int arity);
+
+	//callArgs holds site.arity values in declaration order
+	Value Invoke(const CallSite& site,const Value* callArgs,Object* self = nullptr);
+
+	//calls the function count times, call i takes its args from callArgs[i*site.arity]
+	//script functions reuse a single frame for every call. results is optional and
+	//gets one value per call. stops and returns false at the first error
+	bool InvokeBatch(const CallSite& site,const Value* callArgs,size_t count,Value* results = nullptr,Object* self = nullptr);
+
 	Value ExecuteNativeFunction(Object* self,Function* func);
 
 	Value ExecuteScriptFunction(Object* self,Function* func);
 
+	//creates a suspended coroutine that runs func, the pending args are bound to it
+	//if addToGC is false the host owns it and has to call DestroyCoroutine
+	//returns null if func doesnt compile
+	CoroutineObject* CreateCoroutine(Function* func,Object* self = nullptr,bool addToGC = false);
+
+	//runs the coroutine until it yields or returns
+	//gives back the yielded or returned value, null if it's already done
+	Value Resume(CoroutineObject* co);
+
+	void DestroyCoroutine(CoroutineObject* co);
+
+	//the loops behind InvokeBatch, results go to batchResults[slot]
+	bool InvokeNativeBatch(Function* func,size_t arity,const Value* callArgs,size_t count,size_t slot,Object* self);
+	bool InvokeScriptBatch(Function* func,size_t arity,const Value* callArgs,size_t count,size_t slot,Object* self);
+
+	//pushes a frame for func, fails if the call depth limit is reached
+	bool PushFrame(Object* self,Function* func);
+
+	//pops the finished frame and pushes ret onto the caller's stack
+	//returns false if the popped frame was the one at baseDepth
+	bool PopFrame(size_t baseDepth,Value& ret);
+
+	//runs frames until the one at baseDepth returns
+	Value Execute(size_t baseDepth);
+
+	//sets up frame to run func, moving the pending args into its locals
+	void BindArgs(StackFrame* frame,Object* self,Function* func);
+
+	//runs the init of a static attrib if it hasnt been run yet
+	void InitStatic(ClassObject* cls,const string& name);
+
+	//compiles func if it was left for its first call
+	//raises an error and returns false if its body doesnt compile
+	bool EnsureCompiled(Function* func);
+
+	//looks up the function or method being called, popping the object for methods
+	//raises an error and returns null if it cant be found
+	Function* GetCallee(StackFrame* frame,bool isMethod,const string& name,Object*& self);
+
+	//called when the countdown runs out, refills it if there's any budget left
+	//returns false once the budget is exhausted
+	bool CheckBudget();
+	void RefillBudget();
+
+	//suspends the coroutine running frame if it's running at baseDepth, otherwise
+	//raises an error. returns true if it was suspended
+	bool StopForBudget(StackFrame* frame,int resumeCp,size_t baseDepth);
+
+	//moves the running coroutine's frames off the frame stack
+	void SuspendCoroutine(size_t baseDepth);
+
+	//start and end of a script call, for VMStats
+	void StartCall(StackFrame* frame);
+	void EndCall(StackFrame* frame);
+
+	inline void LoadLocal(StackFrame* frame,const string& name);
+
+	inline void IncrementLocal(StackFrame* frame,const string& name,const Value& amount);
+
 	inline void Negate(StackFrame* frame);
 
 	inline void OpArithmetic(StackFrame* frame,OpCode opcode);
 
-	//todo: compare other values
+	//compares the two values at the top of the stack and pops them
+	//returns false if they cant be compared
+	inline bool CompareTop(StackFrame* frame,OpCode opcode,bool& result);
+
 	inline void Comparison(StackFrame* frame,OpCode opcode);
 
-	inline void CreateInstance(StackFrame* frame,string className);
+	//returns true if the jump should be taken
+	inline bool CompareAndJump(StackFrame* frame,OpCode opcode);
 
-	inline void CallMethod(StackFrame* frame,string methodName);
-	
-	inline void CallFunction(StackFrame* frame,string funcName);
+	inline void Not(StackFrame* frame);
+
+	//creates the object and runs a native constructor, pushing the object if done
+	//returns the script constructor if there is one, which the caller has to run
+	inline Function* CreateInstance(StackFrame* frame,const string& className,Object*& obj);
+
+	inline void CreateMap(StackFrame* frame,int numPairs);
+
+	inline void ForPrep(StackFrame* frame,const string& varName);
+
+	inline void ForIterPrep(StackFrame* frame,const string& varName);
+
+	//returns true if the loop should run another iteration
+	inline bool ForLoop(StackFrame* frame);
+
+	inline void LoadIndex(StackFrame* frame);
+
+	inline void StoreIndex(StackFrame* frame);
 
 	void RaiseError(string msg);
 	void RaiseError(StackFrame* frame,string msg);
+	void SetError(const Error& err);
 	void ClearError();
+
+	//file:function:line of every frame, innermost first
+	string GetStackTrace();
+	string DescribeFrame(StackFrame* frame);
+
+	//sets the error's line and stack trace from the frame that raised it
+	void SetErrorTrace(StackFrame* frame);
 	
 };
 
@@ -0,0 +1,102 @@
+/*
+
+Copyright (C) 2014-2018 Nicolas Brown
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is furnished
+to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+*/
+
+#include "../include/loris/arena.hpp"
+
+using namespace loris;
+
+Arena::Arena()
+{
+	current = 0;
+	pos = end = nullptr;
+}
+
+Arena::~Arena()
+{
+	Release();
+}
+
+void* Arena::AllocateSlow(size_t size, size_t align)
+{
+	//too big to share a block, a quarter block at most goes to waste this way
+	if (size + align > blockSize / 4)
+	{
+		char* data = new char[size + align];
+		largeAllocs.push_back(data);
+
+		return (char*)(((size_t)data + align - 1) & ~(align - 1));
+	}
+
+	//move on to the next block, reusing the ones kept from before a Reset
+	if (!blocks.empty() && pos != nullptr)
+		current++;
+
+	if (current >= blocks.size())
+	{
+		Block block;
+		block.size = blockSize;
+		block.data = new char[blockSize];
+		blocks.push_back(block);
+		current = blocks.size() - 1;
+	}
+
+	pos = blocks[current].data;
+	end = pos + blocks[current].size;
+
+	return Allocate(size, align);
+}
+
+void Arena::Reset()
+{
+	for (auto data : largeAllocs)
+		delete[] data;
+	largeAllocs.clear();
+
+	//keep one block around, the next source is likely to need it
+	for (size_t i = 1; i < blocks.size(); i++)
+		delete[] blocks[i].data;
+	if (blocks.size() > 1)
+		blocks.resize(1);
+
+	current = 0;
+	if (blocks.empty())
+	{
+		pos = end = nullptr;
+	}
+	else
+	{
+		pos = blocks[0].data;
+		end = pos + blocks[0].size;
+	}
+}
+
+void Arena::Release()
+{
+	Reset();
+
+	for (auto& block : blocks)
+		delete[] block.data;
+	blocks.clear();
+
+	pos = end = nullptr;
+}
@@ -89,4 +89,19 @@ void Assembly::AddFunction(string name, std::function<Value(VirtualMachine*, Obj
 
 	//functions.push_back(f);
 	functions[f->name] = f;
+}
+
+size_t Assembly::CountUncompiled()
+{
+	size_t count = 0;
+	for(auto& pair:functions)
+		if(!pair.second->IsCompiled())
+			count++;
+
+	for(auto& pair:classes)
+		for(auto& method:pair.second->methods)
+			if(!method.second->IsCompiled())
+				count++;
+
+	return count;
 }
\ No newline at end of file
@@ -22,9 +22,18 @@ WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 */
 
 #include "../include/loris/compiler.hpp"
+#include "../include/loris/snapshot.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <thread>
 
 using namespace loris;
 
+//bump whenever the compilers change the code they emit without changing the opcodes,
+//so old cache entries are skipped. see Snapshot::GetFingerprint
+static const unsigned int CACHE_VERSION = 1;
+
 Assembly* Compiler::GetAssembly()
 {
 	return assembly;
@@ -32,97 +41,146 @@ Assembly* Compiler::GetAssembly()
 
 void Compiler::AddSource(string filename,string code)
 {
-	SourceCode src = {filename,code};
-	sources.push_back(src);
+	sources.push_back(SourceCode{filename,std::make_shared<SourceBuffer>(std::move(code))});
 }
 
-//todo: figure out how to return assembly when compilation is done
-bool Compiler::Compile(bool debug)
+bool Compiler::AddFileSource(const string& filename)
 {
-	auto assembly = new Assembly;
-	return Compile(assembly, debug);
+	SourceBuffer buffer;
+	if(!buffer.Load(filename))
+	{
+		SetLoadError(filename);
+		return false;
+	}
+
+	sources.push_back(SourceCode{filename,std::make_shared<SourceBuffer>(std::move(buffer))});
+	return true;
 }
 
-bool Compiler::Compile(Assembly* assembly, bool debug)
+bool Compiler::AddFileSources(const vector<string>& filenames)
 {
-	this->debug = debug;
+	//reading is mostly waiting on the disk, so a few more threads than cores is fine
+	size_t threads = std::min<size_t>(std::max(std::thread::hardware_concurrency(),4u),16);
 
-	this->assembly = assembly;
+	vector<SourceBuffer> buffers;
+	size_t failed = LoadFiles(filenames,buffers,threads);
+	if(failed<filenames.size())
+	{
+		SetLoadError(filenames[failed]);
+		return false;
+	}
 
-	for(size_t i=0;i<sources.size();i++)
+	sources.reserve(sources.size()+filenames.size());
+	for(size_t i=0;i<filenames.size();i++)
+		sources.push_back(SourceCode{filenames[i],std::make_shared<SourceBuffer>(std::move(buffers[i]))});
+
+	return true;
+}
+
+bool Compiler::AddSourceDirectory(const string& dir,const string& pattern)
+{
+	vector<string> filenames;
+	if(!ListFiles(dir,pattern,filenames))
 	{
-		SourceCode src = sources[i];
-		assembly->sourceNames.push_back(src.filename);
+		SetLoadError(dir);
+		return false;
+	}
 
-		if(!parser.Parse(src.source))
-		{
-			error = parser.GetError();
-			error.filename = src.filename;
-			return false;
-		}
-		src.program = parser.GetProgram();
+	return AddFileSources(filenames);
+}
 
-		/* CLASS EXTRACTION */
-		//loop through each class
-		Program* program = parser.GetProgram();
-		for(size_t c=0;c<program->classes.size();c++)
-		{
-			ClassDefinition* classDef = program->classes[c];
-			Class* cls = new Class;
+void Compiler::SetLoadError(const string& filename)
+{
+	error.code = Error::FILE_ERROR;
+	error.message = "cant read "+filename;
+	error.filename = filename;
 
-			//set name
-			cls->sourceIndex = i;
-			cls->name = classDef->name;
-			cls->parentName = classDef->superClass;
+	if(loadError.code==Error::NONE)
+		loadError = error;
+}
 
-			//extract attributes
-			for(size_t a=0;a<classDef->attribs.size();a++)
-			{
-				ClassAttribDefinition* attr = classDef->attribs[a];
-				ClassAttrib classAttr = {attr->name,attr->isStatic};
-				if(attr->isStatic && attr->init)
-				{
-					//add init func if static
-					classAttr.init = CompileFunction(attr->init);
+void Compiler::SetSinglePass(bool singlePass)
+{
+	this->singlePass = singlePass;
+}
 
-					//add 'return' at end of init so a value can be returned
-					DSInstr i = {OpCode::Return};
-					classAttr.init->instr.push_back(i);
-				}
+void Compiler::SetLazy(bool lazy)
+{
+	this->lazy = lazy;
+}
 
-				cls->attribs.push_back(classAttr);
-			}
+void Compiler::SetCacheDirectory(const string& dir)
+{
+	cacheDirectory = dir;
+}
 
-			//extract functions
-			for(size_t j=0;j<classDef->functions.size();j++)
-			{
-				FunctionDefinition* funcDefNode = classDef->functions[j];
+size_t Compiler::GetCacheHits()
+{
+	return cacheHits;
+}
 
+string Compiler::GetCacheFilename(const SourceCode& src)
+{
+	//the fingerprint changes with the opcodes and the layout of what's saved
+	unsigned long long hash = Snapshot::GetFingerprint();
+	Snapshot::Hash(hash,src.filename.c_str(),src.filename.size()+1);
+	Snapshot::Hash(hash,src.source->Data(),src.source->Size());
+	Snapshot::Hash(hash,&CACHE_VERSION,sizeof(CACHE_VERSION));
+	Snapshot::Hash(hash,&debug,sizeof(debug));
+
+	char name[32];
+	snprintf(name,sizeof(name),"%016llx.lsc",hash);
+	return cacheDirectory+"/"+name;
+}
 
-				Function* func = CompileFunction(funcDefNode);
-				func->name = funcDefNode->name;
-				func->sourceIndex = i;
-				func->isStatic = funcDefNode->isStatic;
+//todo: figure out how to return assembly when compilation is done
+bool Compiler::Compile(bool debug)
+{
+	auto assembly = new Assembly;
+	return Compile(assembly, debug);
+}
 
-				cls->methods[funcDefNode->name]=func;
-			}
+bool Compiler::Compile(Assembly* assembly, bool debug)
+{
+	this->debug = debug;
 
-			assembly->AddClass(cls);
-		}
+	if(loadError.code!=Error::NONE)
+	{
+		error = loadError;
+		return false;
+	}
 
-		for(size_t f=0;f<program->functions.size();f++)
-		{
-			FunctionDefinition* funcDefNode = program->functions[f];
+	this->assembly = assembly;
+	cacheHits = 0;
 
-			Function* func = CompileFunction(funcDefNode);
-			func->name = funcDefNode->name;
-			func->sourceIndex = i;
+	for(size_t i=0;i<sources.size();i++)
+	{
+		const SourceCode& src = sources[i];
+		assembly->sourceNames.push_back(src.filename);
 
-			assembly->AddFunction(func);
+		string cacheFile;
+		if(!cacheDirectory.empty())
+		{
+			cacheFile = GetCacheFilename(src);
+			if(Snapshot::ReadSource(cacheFile,assembly,i))
+			{
+				cacheHits++;
+				continue;
+			}
 		}
 
+		if(!CompileSource(i))
+			return false;
+
+		//lazy functions arent compiled yet, saving them would compile them all
+		//a failed write only costs a compile next time
+		if(!cacheFile.empty() && !lazy)
+			Snapshot::WriteSource(assembly,i,cacheFile);
 	}
 
+	//everything is bytecode now
+	parser.Release();
+
 	//todo:
 	//resolve parent class at instance creation
 	//this allows for classes to be defined in other
@@ -158,6 +216,100 @@ bool Compiler::Compile(Assembly* assembly, bool debug)
 	return true;
 }
 
+bool Compiler::CompileSource(size_t i)
+{
+	const SourceCode& src = sources[i];
+
+	if(singlePass || lazy)
+	{
+		bool compiled;
+		if(lazy)
+			compiled = singlePassCompiler.CompileLazy(src.source,i,assembly);
+		else
+			compiled = singlePassCompiler.Compile(src.source->Data(),src.source->Size(),i,assembly);
+
+		if(!compiled)
+		{
+			error = singlePassCompiler.GetError();
+			error.filename = src.filename;
+			return false;
+		}
+
+		return true;
+	}
+
+	//the parser reuses its arena for each source, so only one ast is around at a time
+	if(!parser.Parse(src.source->Data(),src.source->Size()))
+	{
+		error = parser.GetError();
+		error.filename = src.filename;
+		parser.Release();
+		return false;
+	}
+
+	/* CLASS EXTRACTION */
+	//loop through each class
+	Program* program = parser.GetProgram();
+	for(size_t c=0;c<program->classes.size();c++)
+	{
+		ClassDefinition* classDef = program->classes[c];
+		Class* cls = new Class;
+
+		//set name
+		cls->sourceIndex = i;
+		cls->name = classDef->name;
+		cls->parentName = classDef->superClass;
+
+		//extract attributes
+		for(size_t a=0;a<classDef->attribs.size();a++)
+		{
+			ClassAttribDefinition* attr = classDef->attribs[a];
+			ClassAttrib classAttr = {attr->name,attr->isStatic};
+			if(attr->isStatic && attr->init)
+			{
+				//add init func if static
+				classAttr.init = CompileFunction(attr->init);
+				classAttr.init->sourceIndex = i;
+
+				//add 'return' at end of init so a value can be returned
+				DSInstr i = {OpCode::Return};
+				classAttr.init->instr.push_back(i);
+			}
+
+			cls->attribs.push_back(classAttr);
+		}
+
+		//extract functions
+		for(size_t j=0;j<classDef->functions.size();j++)
+		{
+			FunctionDefinition* funcDefNode = classDef->functions[j];
+
+
+			Function* func = CompileFunction(funcDefNode);
+			func->name = funcDefNode->name;
+			func->sourceIndex = i;
+			func->isStatic = funcDefNode->isStatic;
+
+			cls->methods[funcDefNode->name]=func;
+		}
+
+		assembly->AddClass(cls);
+	}
+
+	for(size_t f=0;f<program->functions.size();f++)
+	{
+		FunctionDefinition* funcDefNode = program->functions[f];
+
+		Function* func = CompileFunction(funcDefNode);
+		func->name = funcDefNode->name;
+		func->sourceIndex = i;
+
+		assembly->AddFunction(func);
+	}
+
+	return true;
+}
+
 //compiles function node into instructions
 Function* Compiler::CompileFunction(FunctionDefinition* funcDef)
 {
@@ -179,8 +331,7 @@ Function* Compiler::CompileFunction(FunctionDefinition* funcDef)
 	{
 		Statement* stmt = funcDef->statements[i];
 
-		//can safely push line here
-		PushLineOp(func,stmt->line);
+		AddLine(func,stmt->line);
 
 		switch (stmt->type)
 		{
@@ -194,10 +345,14 @@ Function* Compiler::CompileFunction(FunctionDefinition* funcDef)
 		case ASTNode::WhileStmt:
 			CompileWhileStatement(func,(WhileStatement*)stmt);
 			break;
+		case ASTNode::ForStmt:
+			CompileForStatement(func,(ForStatement*)stmt);
+			break;
 		case ASTNode::ReturnStmt:
-			CompileExpression(func,((ReturnStatement*)stmt)->expr);
-			instr.op = OpCode::Return;
-			func->instr.push_back(instr);
+			CompileReturnStatement(func,(ReturnStatement*)stmt);
+			break;
+		case ASTNode::YieldStmt:
+			CompileYieldStatement(func,(YieldStatement*)stmt);
 			break;
 		default:
 			break;
@@ -207,17 +362,9 @@ Function* Compiler::CompileFunction(FunctionDefinition* funcDef)
 	return func;
 }
 
-void Compiler::PushLineOp(Function* func,int line)
+void Compiler::AddLine(Function* func,int line)
 {
-	//this is only done in debug mode
-	if(!debug)
-		return;
-
-	DSInstr instr;
-	instr.op = OpCode::Line;
-	instr.val = line;
-
-	func->instr.push_back(instr);
+	func->lines.Add(func->instr.size(),line);
 }
 
 void Compiler::CompileBlock(Function* func,Block* block)
@@ -235,6 +382,9 @@ void Compiler::CompileStatement(Function* func,Statement* stmt)
 {
 	DSInstr instr;
 
+	if(stmt->type!=ASTNode::BlockStmt)
+		AddLine(func,stmt->line);
+
 	switch (stmt->type)
 	{
 	case ASTNode::ExprStmt:
@@ -246,10 +396,14 @@ void Compiler::CompileStatement(Function* func,Statement* stmt)
 	case ASTNode::WhileStmt:
 		CompileWhileStatement(func,(WhileStatement*)stmt);
 		break;
+	case ASTNode::ForStmt:
+		CompileForStatement(func,(ForStatement*)stmt);
+		break;
 	case ASTNode::ReturnStmt:
-		CompileExpression(func,((ReturnStatement*)stmt)->expr);
-		instr.op = OpCode::Return;
-		func->instr.push_back(instr);
+		CompileReturnStatement(func,(ReturnStatement*)stmt);
+		break;
+	case ASTNode::YieldStmt:
+		CompileYieldStatement(func,(YieldStatement*)stmt);
 		break;
 	case ASTNode::BlockStmt:
 		CompileBlock(func,(Block*)stmt);
@@ -304,7 +458,8 @@ void Compiler::CompileExpression(Function* func,Expression* expr)
 	BinaryExpression* binExpr;
 	DSInstr instr;
 	PropertyAccess* propExpr;
-	CallExpr* callExpr;
+	IndexAccess* indexExpr;
+	MapLiteral* mapExpr;
 	NewExpr* newExpr;
 		
 	string strVal = "";
@@ -358,18 +513,34 @@ void Compiler::CompileExpression(Function* func,Expression* expr)
 			instr.op = OpCode::IsNotEqual;
 			func->instr.push_back(instr);
 			break;
+		/* LOGICAL EXPRESSIONS */
+		//the right side is only evaluated if the left doesnt decide the result
+		case Token::And:
+		case Token::Or:
+			{
+				CompileExpression(func,binExpr->left);
+
+				int jumpIndex = func->instr.size();
+				instr.op = binExpr->op==Token::And?OpCode::JumpIfFalseOrPop:OpCode::JumpIfTrueOrPop;
+				func->instr.push_back(instr);
+
+				CompileExpression(func,binExpr->right);
+				func->instr[jumpIndex].val = func->instr.size();
+			}
+			break;
 		/* MATH EXPRESSIONS */
 		case Token::Add:
-			CompileExpression(func,binExpr->left);
-			CompileExpression(func,binExpr->right);
-			instr.op = OpCode::Add;
-			func->instr.push_back(instr);
-			break;
-
 		case Token::Sub:
+			//local + number is done in one instruction
+			if(IsLocalPlusConstant(binExpr,strVal,numVal))
+			{
+				EmitLocalConstantOp(func,OpCode::LoadLocalAddConstant,strVal,numVal);
+				break;
+			}
+
 			CompileExpression(func,binExpr->left);
 			CompileExpression(func,binExpr->right);
-			instr.op = OpCode::Sub;
+			instr.op = binExpr->op==Token::Add?OpCode::Add:OpCode::Sub;
 			func->instr.push_back(instr);
 			break;
 
@@ -391,6 +562,15 @@ void Compiler::CompileExpression(Function* func,Expression* expr)
 				
 			if(binExpr->left->type == ASTNode::Iden)
 			{
+				//i = i + 1 and i = i - 1 update the local in place
+				if(binExpr->right->type == ASTNode::BinaryExpr &&
+					IsLocalPlusConstant((BinaryExpression*)binExpr->right,strVal,numVal) &&
+					strVal == ((Identifier*)binExpr->left)->name)
+				{
+					EmitLocalConstantOp(func,OpCode::IncrementLocal,strVal,numVal);
+					break;
+				}
+
 				//if left node is just an identifier then
 				//calculate right node and assign the value to that local
 
@@ -425,6 +605,16 @@ void Compiler::CompileExpression(Function* func,Expression* expr)
 				instr.op = OpCode::StoreProp;
 				instr.val = func->strings.size()-1;
 				func->instr.push_back(instr);
+			}
+			else if(binExpr->left->type == ASTNode::IndexAccess)
+			{
+				//value, then the array or map, then the index
+				CompileExpression(func,binExpr->right);
+				CompileExpression(func,((IndexAccess*)binExpr->left)->obj);
+				CompileExpression(func,((IndexAccess*)binExpr->left)->index);
+
+				instr.op = OpCode::StoreIndex;
+				func->instr.push_back(instr);
 			}else
 			{
 				//a function call, this actually doesnt make sense being at the top of the
@@ -444,6 +634,12 @@ void Compiler::CompileExpression(Function* func,Expression* expr)
 		instr.op = OpCode::Neg;
 		func->instr.push_back(instr);
 		break;
+	case ASTNode::Not:
+		CompileExpression(func,((NotExpr*)expr)->child);
+
+		instr.op = OpCode::Not;
+		func->instr.push_back(instr);
+		break;
 	case ASTNode::Iden:
 		//load local to top of stack
 		func->strings.push_back(((Identifier*)expr)->name);
@@ -502,16 +698,40 @@ void Compiler::CompileExpression(Function* func,Expression* expr)
 		func->instr.push_back(instr);
 		break;
 
+	case ASTNode::IndexAccess:
+		indexExpr = (IndexAccess*)expr;
+		CompileExpression(func,indexExpr->obj);
+		CompileExpression(func,indexExpr->index);
+
+		instr.op = OpCode::LoadIndex;
+		func->instr.push_back(instr);
+		break;
+
+	case ASTNode::MapLiteral:
+		//push each key followed by its value, CreateMap pops them all
+		mapExpr = (MapLiteral*)expr;
+		for(size_t i=0;i<mapExpr->keys.size();i++)
+		{
+			CompileExpression(func,mapExpr->keys[i]);
+			CompileExpression(func,mapExpr->values[i]);
+		}
+
+		instr.op = OpCode::CreateMap;
+		instr.val = mapExpr->keys.size();
+		func->instr.push_back(instr);
+		break;
+
 	case ASTNode::FunctionCall:
-		callExpr = (CallExpr*)expr;
+		CompileCall(func,(CallExpr*)expr,false);
+		break;
+	case ASTNode::New:
+		newExpr = (NewExpr*)expr;
 			
-		//compile all arguments
-		/*
-		for(size_t i=0;i<callExpr->args->args.size();i++)
+		for(size_t i=0;i<newExpr->args->args.size();i++)
 		{
-			CompileExpression(func,callExpr->args->args[i]);
+			CompileExpression(func,newExpr->args->args[i]);
 		}
-		*/
+			
 		/*
 		IMPORTANT FIX!
 		the args list gets flushed after each function call or object
@@ -526,143 +746,332 @@ void Compiler::CompileExpression(Function* func,Expression* expr)
 		it means that the args will be added in reverse however
 		this needs to be fixed in the appropriate section of code
 		*/
-		/*
-		for(size_t i=0;i<callExpr->args->args.size();i++)
+		for(size_t i=0;i<newExpr->args->args.size();i++)
 		{
 			instr.op = OpCode::AddArg;
 			func->instr.push_back(instr);
 		}
-		*/
 
-		//if callExpr->obj is an Identifier, it is a static function call
-		//else the function is being called from an object
-		if(callExpr->obj->type == ASTNode::Iden)
+		instr.op = OpCode::CreateInstance;
+		func->strings.push_back(newExpr->name);
+		instr.val = func->strings.size()-1;
+		func->instr.push_back(instr);
+
+		break;
+	}
+}
+
+void Compiler::CompileConditionalJump(Function* func,Expression* expr,bool jumpIfTrue,vector<int>& jumps)
+{
+	DSInstr instr;
+
+	if(expr->type == ASTNode::Not)
+	{
+		CompileConditionalJump(func,((NotExpr*)expr)->child,!jumpIfTrue,jumps);
+		return;
+	}
+
+	if(expr->type == ASTNode::BinaryExpr)
+	{
+		BinaryExpression* binExpr = (BinaryExpression*)expr;
+		vector<int> skips;
+
+		switch(binExpr->op)
 		{
-			/* PUSH ARGS START */
-			for(size_t i=0;i<callExpr->args->args.size();i++)
+		case Token::And:
+			if(jumpIfTrue)
 			{
-				CompileExpression(func,callExpr->args->args[i]);
+				//left being false skips the right side and falls through
+				CompileConditionalJump(func,binExpr->left,false,skips);
+				CompileConditionalJump(func,binExpr->right,true,jumps);
+				PatchJumps(func,skips);
 			}
-
-			for(size_t i=0;i<callExpr->args->args.size();i++)
+			else
 			{
-				instr.op = OpCode::AddArg;
-				func->instr.push_back(instr);
+				//either side being false takes the jump
+				CompileConditionalJump(func,binExpr->left,false,jumps);
+				CompileConditionalJump(func,binExpr->right,false,jumps);
 			}
-			/* PUSH ARGS END */
-
-			instr.op = OpCode::CallFunction;
-			func->strings.push_back(((Identifier*)callExpr->obj)->name);
-			instr.val = func->strings.size()-1;
-			func->instr.push_back(instr);
-
-		}
-		else if(callExpr->obj->type == ASTNode::PropAccess)
-		{
-			/*
-			since functions arent first class objects, the PropAccess
-			isnt compiled
-			Its obj property is compiled
-			the CallMethod opcode requires the val to be the index of the function
-			name in the string table
-			*/
-			propExpr = (PropertyAccess*)callExpr->obj;
-
-			CompileExpression(func,propExpr->obj);
-
-			/* PUSH ARGS START */
-			//args are pushed after prop is evaluated in the case of chaining
-			//self.objects.get(0).update(dt);
-			//after 'get' is called, the args will be cleared
-			//it is important that the args be pushed after any previous function calls
-			//are executed
-			for(size_t i=0;i<callExpr->args->args.size();i++)
+			return;
+		case Token::Or:
+			if(jumpIfTrue)
 			{
-				CompileExpression(func,callExpr->args->args[i]);
+				CompileConditionalJump(func,binExpr->left,true,jumps);
+				CompileConditionalJump(func,binExpr->right,true,jumps);
 			}
-
-			for(size_t i=0;i<callExpr->args->args.size();i++)
+			else
 			{
-				instr.op = OpCode::AddArg;
-				func->instr.push_back(instr);
+				CompileConditionalJump(func,binExpr->left,true,skips);
+				CompileConditionalJump(func,binExpr->right,false,jumps);
+				PatchJumps(func,skips);
 			}
-			/* PUSH ARGS END */
+			return;
+		case Token::EQ:
+			instr.op = jumpIfTrue?OpCode::JumpIfEqual:OpCode::JumpIfNotEqual;
+			break;
+		case Token::NEQ:
+			instr.op = jumpIfTrue?OpCode::JumpIfNotEqual:OpCode::JumpIfEqual;
+			break;
+		case Token::LT:
+			instr.op = jumpIfTrue?OpCode::JumpIfLessThan:OpCode::JumpIfNotLessThan;
+			break;
+		case Token::LTE:
+			instr.op = jumpIfTrue?OpCode::JumpIfLessThanOrEqual:OpCode::JumpIfNotLessThanOrEqual;
+			break;
+		case Token::GT:
+			instr.op = jumpIfTrue?OpCode::JumpIfGreaterThan:OpCode::JumpIfNotGreaterThan;
+			break;
+		case Token::GTE:
+			instr.op = jumpIfTrue?OpCode::JumpIfGreaterThanOrEqual:OpCode::JumpIfNotGreaterThanOrEqual;
+			break;
+		default:
+			instr.op = OpCode::Nop;
+			break;
+		}
+
+		//comparisons jump directly instead of pushing a bool
+		if(instr.op != OpCode::Nop)
+		{
+			CompileExpression(func,binExpr->left);
+			CompileExpression(func,binExpr->right);
 
-			instr.op = OpCode::CallMethod;
-			func->strings.push_back(propExpr->name);
-			instr.val = func->strings.size()-1;
+			jumps.push_back(func->instr.size());
 			func->instr.push_back(instr);
+			return;
 		}
-		else
+	}
+
+	//any other expression gets evaluated and tested
+	CompileExpression(func,expr);
+
+	jumps.push_back(func->instr.size());
+	instr.op = jumpIfTrue?OpCode::JumpIfTrue:OpCode::JumpIfFalse;
+	func->instr.push_back(instr);
+}
+
+void Compiler::PatchJumps(Function* func,vector<int>& jumps)
+{
+	for(size_t i=0;i<jumps.size();i++)
+		func->instr[jumps[i]].val = func->instr.size();
+
+	jumps.clear();
+}
+
+void Compiler::CompileCall(Function* func,CallExpr* callExpr,bool isTailCall)
+{
+	DSInstr instr;
+	PropertyAccess* propExpr;
+
+	//compile all arguments
+	/*
+	for(size_t i=0;i<callExpr->args->args.size();i++)
+	{
+		CompileExpression(func,callExpr->args->args[i]);
+	}
+	*/
+	/*
+	IMPORTANT FIX!
+	the args list gets flushed after each function call or object
+	instantiation
+	if an argument is a function call or an object instantiation ten
+	the function will be called using only the latter args
+
+	calling AddArg after all the args have been evaulated fixes this
+	since it's guaranteed that the args will be on the stack no matter
+	what happens between their evaluation
+
+	it means that the args will be added in reverse however
+	this needs to be fixed in the appropriate section of code
+	*/
+	/*
+	for(size_t i=0;i<callExpr->args->args.size();i++)
+	{
+		instr.op = OpCode::AddArg;
+		func->instr.push_back(instr);
+	}
+	*/
+
+	//if callExpr->obj is an Identifier, it is a static function call
+	//else the function is being called from an object
+	if(callExpr->obj->type == ASTNode::Iden)
+	{
+		/* PUSH ARGS START */
+		for(size_t i=0;i<callExpr->args->args.size();i++)
 		{
-			//SHOULD NEVER BE HERE!!
-			assert(false);
+			CompileExpression(func,callExpr->args->args[i]);
 		}
 
-		break;
-	case ASTNode::New:
-		newExpr = (NewExpr*)expr;
-			
-		for(size_t i=0;i<newExpr->args->args.size();i++)
+		for(size_t i=0;i<callExpr->args->args.size();i++)
 		{
-			CompileExpression(func,newExpr->args->args[i]);
+			instr.op = OpCode::AddArg;
+			func->instr.push_back(instr);
 		}
-			
-		/*
-		IMPORTANT FIX!
-		the args list gets flushed after each function call or object
-		instantiation
-		if an argument is a function call or an object instantiation ten
-		the function will be called using only the latter args
+		/* PUSH ARGS END */
 
-		calling AddArg after all the args have been evaulated fixes this
-		since it's guaranteed that the args will be on the stack no matter
-		what happens between their evaluation
+		instr.op = isTailCall?OpCode::TailCall:OpCode::CallFunction;
+		func->strings.push_back(((Identifier*)callExpr->obj)->name);
+		instr.val = func->strings.size()-1;
+		func->instr.push_back(instr);
 
-		it means that the args will be added in reverse however
-		this needs to be fixed in the appropriate section of code
+	}
+	else if(callExpr->obj->type == ASTNode::PropAccess)
+	{
+		/*
+		since functions arent first class objects, the PropAccess
+		isnt compiled
+		Its obj property is compiled
+		the CallMethod opcode requires the val to be the index of the function
+		name in the string table
 		*/
-		for(size_t i=0;i<newExpr->args->args.size();i++)
+		propExpr = (PropertyAccess*)callExpr->obj;
+
+		CompileExpression(func,propExpr->obj);
+
+		/* PUSH ARGS START */
+		//args are pushed after prop is evaluated in the case of chaining
+		//self.objects.get(0).update(dt);
+		//after 'get' is called, the args will be cleared
+		//it is important that the args be pushed after any previous function calls
+		//are executed
+		for(size_t i=0;i<callExpr->args->args.size();i++)
+		{
+			CompileExpression(func,callExpr->args->args[i]);
+		}
+
+		for(size_t i=0;i<callExpr->args->args.size();i++)
 		{
 			instr.op = OpCode::AddArg;
 			func->instr.push_back(instr);
 		}
+		/* PUSH ARGS END */
 
-		instr.op = OpCode::CreateInstance;
-		func->strings.push_back(newExpr->name);
+		instr.op = isTailCall?OpCode::TailCallMethod:OpCode::CallMethod;
+		func->strings.push_back(propExpr->name);
 		instr.val = func->strings.size()-1;
 		func->instr.push_back(instr);
-
-		break;
+	}
+	else
+	{
+		//SHOULD NEVER BE HERE!!
+		assert(false);
 	}
 }
 
-void Compiler::CompileWhileStatement(Function* func,WhileStatement* stmt)
+/*
+return f(x); and return obj.f(x); become tail calls, which replace the
+current function's frame instead of nesting a new one
+*/
+void Compiler::CompileReturnStatement(Function* func,ReturnStatement* stmt)
 {
-	int exprPos = func->instr.size();//index of next stmt which is expr
+	if(stmt->expr->type == ASTNode::FunctionCall)
+	{
+		CompileCall(func,(CallExpr*)stmt->expr,true);
+		return;
+	}
 
-	//compile comparison expression
 	CompileExpression(func,stmt->expr);
 
-	//if expression is false, jump to end of block
-	//we dot know the position of the end of the block as yet so we
-	//store jump op and get index
+	DSInstr instr;
+	instr.op = OpCode::Return;
+	func->instr.push_back(instr);
+}
+
+void Compiler::CompileYieldStatement(Function* func,YieldStatement* stmt)
+{
+	DSInstr instr;
+
+	//a bare yield hands null to whoever resumed the coroutine
+	if(stmt->expr!=nullptr)
+	{
+		CompileExpression(func,stmt->expr);
+	}
+	else
+	{
+		instr.op = OpCode::LoadNull;
+		func->instr.push_back(instr);
+	}
+
+	instr.op = OpCode::Yield;
+	func->instr.push_back(instr);
+}
+
+/*
+format:
+jump to condition
+block
+condition - jumps back to block if true
+nop
+
+testing at the bottom means each iteration only takes one jump
+*/
+void Compiler::CompileWhileStatement(Function* func,WhileStatement* stmt)
+{
+	//the condition's index isnt known yet
 	int jumpOpIndex = func->instr.size();
-	DSInstr instr = {OpCode::JumpIfFalse};
+	DSInstr instr;
+	instr.op = OpCode::Jump;
 	func->instr.push_back(instr);
 
 	//compile block
+	int blockIndex = func->instr.size();
 	CompileBlock(func,stmt->block);
 
-	//jump back to expression
+	//compile comparison expression
+	//if expression is true, jump back to the start of the block
+	func->instr[jumpOpIndex].val = func->instr.size();
+	AddLine(func,stmt->line);
+	vector<int> loopJumps;
+	CompileConditionalJump(func,stmt->expr,true,loopJumps);
+	for(size_t i=0;i<loopJumps.size();i++)
+		func->instr[loopJumps[i]].val = blockIndex;
+
+	instr.op = OpCode::Nop;
+	func->instr.push_back(instr);
+}
+
+/*
+format:
+start expression (or array/map expression)
+end expression (ranges only)
+ForPrep/ForIterPrep - sets up the loop state
+jump to ForLoop
+block
+ForLoop - steps the loop and jumps back to the block if it isnt done
+
+the loop counter lives in the frame's loop state instead of being
+loaded, incremented, stored and compared as a local every iteration
+*/
+void Compiler::CompileForStatement(Function* func,ForStatement* stmt)
+{
+	DSInstr instr;
+
+	CompileExpression(func,stmt->expr);
+	if(stmt->end)
+	{
+		CompileExpression(func,stmt->end);
+		instr.op = OpCode::ForPrep;
+	}
+	else
+	{
+		instr.op = OpCode::ForIterPrep;
+	}
+
+	func->strings.push_back(stmt->name);
+	instr.val = func->strings.size()-1;
+	func->instr.push_back(instr);
+
+	//ForLoop's index isnt known yet
+	int jumpOpIndex = func->instr.size();
 	instr.op = OpCode::Jump;
-	instr.val = exprPos;
 	func->instr.push_back(instr);
 
-	//insert nop expr and get index
-	int nopIndex = func->instr.size();
-	func->instr[jumpOpIndex].val = nopIndex;
-	instr.op = OpCode::Nop;
+	int blockIndex = func->instr.size();
+	CompileBlock(func,stmt->block);
+
+	func->instr[jumpOpIndex].val = func->instr.size();
+	AddLine(func,stmt->line);
+	instr.op = OpCode::ForLoop;
+	instr.val = blockIndex;
 	func->instr.push_back(instr);
 }
 
@@ -688,15 +1097,13 @@ nop
 void Compiler::CompileIfStatement(Function* func,IfStatement* stmt)
 {
 	//IF EXPRESSION
-	CompileExpression(func,stmt->expr);
-
 	//JUMP IF FALSE TO BLOCK END
 	//if expression is false, jump to end of block
-	//we dot know the position of the end of the block as yet so we
-	//store jump op and get index
-	int blockEndIndex = func->instr.size();
-	DSInstr instr = {OpCode::JumpIfFalse};
-	func->instr.push_back(instr);
+	//we dont know the position of the end of the block as yet so we
+	//store the jumps and patch them later
+	vector<int> blockEndJumps;
+	CompileConditionalJump(func,stmt->expr,false,blockEndJumps);
+	DSInstr instr;
 
 	//BLOCK
 	CompileBlock(func,stmt->block);
@@ -710,8 +1117,7 @@ void Compiler::CompileIfStatement(Function* func,IfStatement* stmt)
 	func->instr.push_back(instr);
 
 	//END OF BLOCK
-	int nopIndex = func->instr.size();
-	func->instr[blockEndIndex].val = nopIndex;
+	PatchJumps(func,blockEndJumps);
 	instr.op = OpCode::Nop;
 	func->instr.push_back(instr);
 
@@ -723,7 +1129,7 @@ void Compiler::CompileIfStatement(Function* func,IfStatement* stmt)
 	}
 
 	//NOP
-	nopIndex = func->instr.size();
+	int nopIndex = func->instr.size();
 	func->instr[endChainIndex].val = nopIndex;
 	instr.op = OpCode::Nop;
 	func->instr.push_back(instr);
@@ -732,4 +1138,45 @@ void Compiler::CompileIfStatement(Function* func,IfStatement* stmt)
 Error Compiler::GetError()
 {
 	return error;
+}
+
+bool Compiler::IsLocalPlusConstant(BinaryExpression* expr,string& local,double& amount)
+{
+	if(expr->op != Token::Add && expr->op != Token::Sub)
+		return false;
+
+	Expression* iden = expr->left;
+	Expression* num = expr->right;
+
+	//number + local is fine too, but not number - local
+	if(expr->op == Token::Add && iden->type == ASTNode::NumberLiteral)
+	{
+		iden = expr->right;
+		num = expr->left;
+	}
+
+	if(iden->type != ASTNode::Iden || num->type != ASTNode::NumberLiteral)
+		return false;
+
+	local = ((Identifier*)iden)->name;
+	amount = ((NumberLiteral*)num)->value;
+	if(expr->op == Token::Sub)
+		amount = -amount;
+
+	return true;
+}
+
+void Compiler::EmitLocalConstantOp(Function* func,OpCode op,const string& local,double amount)
+{
+	DSInstr instr;
+
+	func->strings.push_back(local);
+	instr.op = op;
+	instr.val = func->strings.size()-1;
+	func->instr.push_back(instr);
+
+	func->constants.push_back(Value::CreateNumber(amount));
+	instr.op = OpCode::Operand;
+	instr.val = func->constants.size()-1;
+	func->instr.push_back(instr);
 }
\ No newline at end of file
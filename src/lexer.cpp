@@ -23,82 +23,393 @@ WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 
 #include "../include/loris/lexer.hpp"
 #include <iostream>
+#include <cassert>
+#include <cstring>
+#include <cstdlib>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define LORIS_SCAN_AVX2
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define LORIS_SCAN_SSE2
+#endif
 
 using namespace loris;
 
 /*********************
-	TokenStream
+	Scanning
 *********************/
 
-TokenStream::TokenStream()
+/*
+the hot loops of the lexer, vectorized when sse2 or avx2 is available
+each one looks at a whole block of chars at a time and falls back to
+a char at a time for the tail of the source
+*/
+
+enum CharFlags
 {
-	index=0;
+	CHAR_SPACE = 1,
+	CHAR_IDEN_START = 2,
+	CHAR_IDEN = 4,
+	CHAR_DIGIT = 8
+};
+
+struct CharTable
+{
+	unsigned char flags[256];
+
+	CharTable()
+	{
+		memset(flags,0,sizeof(flags));
+		flags[(unsigned char)' '] = CHAR_SPACE;
+		flags[(unsigned char)'\n'] = CHAR_SPACE;
+		flags[(unsigned char)'\t'] = CHAR_SPACE;
+		flags[(unsigned char)'_'] = CHAR_IDEN_START|CHAR_IDEN;
+		for(int c='a';c<='z';c++)
+		{
+			flags[c] = CHAR_IDEN_START|CHAR_IDEN;
+			flags[c-'a'+'A'] = CHAR_IDEN_START|CHAR_IDEN;
+		}
+		for(int c='0';c<='9';c++)
+			flags[c] = CHAR_IDEN|CHAR_DIGIT;
+	}
+
+	unsigned char operator[](char c) const
+	{
+		return flags[(unsigned char)c];
+	}
+};
+
+static const CharTable charTable;
+
+#if defined(LORIS_SCAN_AVX2) || defined(LORIS_SCAN_SSE2)
+#define LORIS_SCAN_SIMD
+
+#ifdef LORIS_SCAN_AVX2
+typedef __m256i Block;
+static const unsigned int BLOCK_SIZE = 32;
+static const unsigned int FULL_MASK = 0xffffffff;
+
+static inline Block Load(const char* p) { return _mm256_loadu_si256((const __m256i*)p); }
+static inline Block Splat(char c) { return _mm256_set1_epi8(c); }
+static inline Block Eq(Block a,char c) { return _mm256_cmpeq_epi8(a,Splat(c)); }
+static inline Block Or(Block a,Block b) { return _mm256_or_si256(a,b); }
+static inline Block Sub(Block a,char c) { return _mm256_sub_epi8(a,Splat(c)); }
+static inline Block Min(Block a,char c) { return _mm256_min_epu8(a,Splat(c)); }
+static inline Block Eq(Block a,Block b) { return _mm256_cmpeq_epi8(a,b); }
+static inline unsigned int Mask(Block a) { return (unsigned int)_mm256_movemask_epi8(a); }
+#else
+typedef __m128i Block;
+static const unsigned int BLOCK_SIZE = 16;
+static const unsigned int FULL_MASK = 0xffff;
+
+static inline Block Load(const char* p) { return _mm_loadu_si128((const __m128i*)p); }
+static inline Block Splat(char c) { return _mm_set1_epi8(c); }
+static inline Block Eq(Block a,char c) { return _mm_cmpeq_epi8(a,Splat(c)); }
+static inline Block Or(Block a,Block b) { return _mm_or_si128(a,b); }
+static inline Block Sub(Block a,char c) { return _mm_sub_epi8(a,Splat(c)); }
+static inline Block Min(Block a,char c) { return _mm_min_epu8(a,Splat(c)); }
+static inline Block Eq(Block a,Block b) { return _mm_cmpeq_epi8(a,b); }
+static inline unsigned int Mask(Block a) { return (unsigned int)_mm_movemask_epi8(a); }
+#endif
+
+//lo <= c <= hi, the subtraction wraps everything below lo past hi
+static inline Block InRange(Block a,char lo,char hi)
+{
+	Block t = Sub(a,lo);
+	return Eq(Min(t,(char)(hi-lo)),t);
 }
 
-void TokenStream::AddToken(Token t)
+//mask must not be 0
+static inline unsigned int FirstBit(unsigned int mask)
 {
-	tokens.push_back(t);
+#if defined(__GNUC__)
+	return (unsigned int)__builtin_ctz(mask);
+#else
+	unsigned int bit = 0;
+	while((mask&1)==0)
+	{
+		mask>>=1;
+		bit++;
+	}
+	return bit;
+#endif
 }
 
-void TokenStream::AddToken(Token::Type type,string tok,int line)
+//without -mpopcnt __builtin_popcount is a library call, so the bit trick is used instead
+static inline int CountBits(unsigned int mask)
 {
-	Token token;
-	token.type = type;
-	token.token = tok;
-	token.line = line;
+#if defined(__POPCNT__)
+	return __builtin_popcount(mask);
+#else
+	mask = mask-((mask>>1)&0x55555555);
+	mask = (mask&0x33333333)+((mask>>2)&0x33333333);
+	return (int)((((mask+(mask>>4))&0x0f0f0f0f)*0x01010101)>>24);
+#endif
+}
 
-	AddToken(token);
+//bits below index
+static inline unsigned int LowBits(unsigned int index)
+{
+	return index>=32?0xffffffff:(1u<<index)-1;
 }
+#endif
 
-Token TokenStream::NextToken()
+//returns the index of the first char that isnt whitespace, counting newlines on the way
+static unsigned int SkipWhiteSpace(const char* chars,unsigned int index,unsigned int size,int& line)
 {
-	size_t size = tokens.size();
-	if(index<size)
-		return tokens[index++];
+	//most runs are a single space between tokens, those arent worth a block
+	if(index+1<size && !(charTable[chars[index+1]]&CHAR_SPACE))
+	{
+		if(chars[index]=='\n')
+			line++;
+		return index+1;
+	}
 
-	index+=1;
-	return Token::EOSToken();
+#ifdef LORIS_SCAN_SIMD
+	while(index+BLOCK_SIZE<=size)
+	{
+		Block block = Load(chars+index);
+		Block newlines = Eq(block,'\n');
+		unsigned int space = Mask(Or(Or(Eq(block,' '),Eq(block,'\t')),newlines));
+		unsigned int lines = Mask(newlines);
+
+		if(space!=FULL_MASK)
+		{
+			unsigned int end = FirstBit(~space);
+			if(lines)
+				line += CountBits(lines&LowBits(end));
+			return index+end;
+		}
+
+		if(lines)
+			line += CountBits(lines);
+		index += BLOCK_SIZE;
+	}
+#endif
+
+	while(index<size && (charTable[chars[index]]&CHAR_SPACE))
+	{
+		if(chars[index]=='\n')
+			line++;
+		index++;
+	}
+
+	return index;
 }
 
-Token::Type TokenStream::PeekTokenType(unsigned int look_ahead)
+//runs shorter than this are scanned a char at a time before a block is loaded,
+//most identifiers and strings are only a few chars long
+static const unsigned int SHORT_RUN = 8;
+
+//returns the index of the first char that cant be part of an identifier
+static unsigned int ScanIdentifier(const char* chars,unsigned int index,unsigned int size)
 {
-	if(tokens.size()<=index+look_ahead)
-		return Token::EOS;
+	unsigned int shortEnd = index+SHORT_RUN<size?index+SHORT_RUN:size;
+	for(;index<shortEnd;index++)
+		if(!(charTable[chars[index]]&CHAR_IDEN))
+			return index;
+
+#ifdef LORIS_SCAN_SIMD
+	while(index+BLOCK_SIZE<=size)
+	{
+		Block block = Load(chars+index);
+		//or-ing in 0x20 lowercases letters and doesnt turn anything else into one
+		Block letters = InRange(Or(block,Splat(0x20)),'a','z');
+		unsigned int iden = Mask(Or(Or(letters,InRange(block,'0','9')),Eq(block,'_')));
 
-	return tokens[index+look_ahead].type;
+		if(iden!=FULL_MASK)
+			return index+FirstBit(~iden);
+
+		index += BLOCK_SIZE;
+	}
+#endif
+
+	while(index<size && (charTable[chars[index]]&CHAR_IDEN))
+		index++;
+
+	return index;
 }
 
-Token TokenStream::PeekToken(unsigned int look_ahead)
+//returns the index of the first c, or size if there isnt one
+static unsigned int FindChar(const char* chars,unsigned int index,unsigned int size,char c)
 {
-	if(tokens.size()<=index+look_ahead)
+	unsigned int shortEnd = index+SHORT_RUN<size?index+SHORT_RUN:size;
+	for(;index<shortEnd;index++)
+		if(chars[index]==c)
+			return index;
+
+#ifdef LORIS_SCAN_SIMD
+	while(index+BLOCK_SIZE<=size)
 	{
-		//return line of previous token if there's any available
-		if(index>0)
-			return Token::EOSToken(tokens[index-1].line);
-		else
-			return Token::EOSToken(1);
+		unsigned int found = Mask(Eq(Load(chars+index),c));
+		if(found)
+			return index+FirstBit(found);
+
+		index += BLOCK_SIZE;
 	}
+#endif
+
+	while(index<size && chars[index]!=c)
+		index++;
 
-	return tokens[index+look_ahead];
+	return index;
 }
 
-bool TokenStream::HasMore()
+static int CountNewLines(const char* chars,unsigned int index,unsigned int end)
 {
-	return index<tokens.size();
+	int count = 0;
+
+#ifdef LORIS_SCAN_SIMD
+	while(index+BLOCK_SIZE<=end)
+	{
+		count += CountBits(Mask(Eq(Load(chars+index),'\n')));
+		index += BLOCK_SIZE;
+	}
+#endif
+
+	for(;index<end;index++)
+		if(chars[index]=='\n')
+			count++;
+
+	return count;
 }
 
-void TokenStream::Advance()
+/*
+keywords are found with a perfect hash of the first char, the last char and the length,
+the multiplier was searched for so none of the keywords share a slot
+*/
+
+static const unsigned int KEYWORD_SLOTS = 64;
+
+static inline unsigned int KeywordHash(const char* text,unsigned int length)
 {
-	index+=1;
+	return ((unsigned char)text[0]+(unsigned char)text[length-1]*23+length)&(KEYWORD_SLOTS-1);
+}
+
+struct KeywordTable
+{
+	struct Keyword
+	{
+		const char* name;
+		unsigned int length;//0 for empty slots
+		Token::Type type;
+	};
+
+	Keyword slots[KEYWORD_SLOTS];
+
+	void Add(const char* name,Token::Type type)
+	{
+		unsigned int length = (unsigned int)strlen(name);
+		Keyword& slot = slots[KeywordHash(name,length)];
+		assert(slot.length==0 && "keyword hash collision, search for a new multiplier");
+
+		slot.name = name;
+		slot.length = length;
+		slot.type = type;
+	}
+
+	KeywordTable()
+	{
+		for(auto& slot:slots)
+		{
+			slot.name = "";
+			slot.length = 0;
+			slot.type = Token::Iden;
+		}
+
+		Add("import",Token::Import);
+		Add("module",Token::Module);
+		Add("new",Token::New);
+		Add("class",Token::Class);
+		Add("function",Token::Function);
+		Add("def",Token::Def);
+		Add("extends",Token::Extends);
+		Add("static",Token::Static);
+		Add("return",Token::Return);
+		Add("yield",Token::Yield);
+		Add("var",Token::Var);
+		Add("enum",Token::Enum);
+		Add("if",Token::If);
+		Add("else",Token::Else);
+		Add("elif",Token::Elif);
+		Add("for",Token::For);
+		Add("in",Token::In);
+		Add("while",Token::While);
+		Add("break",Token::Break);
+		Add("or",Token::Or);
+		Add("and",Token::And);
+		/* literals */
+		Add("true",Token::True);
+		Add("false",Token::False);
+		Add("null",Token::Null);
+	}
+
+	Token::Type Find(const char* text,unsigned int length) const
+	{
+		const Keyword& slot = slots[KeywordHash(text,length)];
+		if(slot.length==length && memcmp(slot.name,text,length)==0)
+			return slot.type;
+
+		return Token::Iden;
+	}
+};
+
+static const KeywordTable keywords;
+
+float Token::ToNumber(StringRef text)
+{
+	//integers that fit in a double exactly come out the same as atof's,
+	//without the copy and the locale aware parsing
+	if(text.size()<=15)
+	{
+		double value = 0;
+		size_t i = 0;
+		for(;i<text.size();i++)
+		{
+			char c = text.Data()[i];
+			if(c<'0' || c>'9')
+				break;
+			value = value*10+(c-'0');
+		}
+
+		if(i==text.size())
+			return (float)value;
+	}
+
+	return (float)atof(text.str().c_str());
+}
+
+/*********************
+	TokenStream
+*********************/
+
+TokenStream::TokenStream()
+{
+	index=0;
+	source="";
+}
+
+void TokenStream::AddToken(Token::Type type,unsigned int offset,unsigned int length,int line)
+{
+	Token token;
+	token.type = type;
+	token.offset = offset;
+	token.length = length;
+	token.line = line;
+
+	tokens.push_back(token);
 }
 
 /*********************
 	CharStream
 *********************/
 
-CharStream::CharStream(string code)
+CharStream::CharStream(const char* code,size_t size)
 {
 	chars = code;
+	this->size = (unsigned int)size;
 	index=0;
 }
 
@@ -107,7 +418,7 @@ returns EOF if out of bounds
 */
 int CharStream::NextChar()
 {
-	if(index<chars.size())
+	if(index<size)
 		return chars[index++];
 
 	index++;
@@ -125,18 +436,17 @@ returns EOF if out of bounds
 */
 int CharStream::PeekChar(unsigned int look_ahead)
 {
-	int size = (int)chars.size();
-	int look =(index+look_ahead);
+	unsigned int look = index+look_ahead;
 
 	if(look<size)
-		return chars[index+look_ahead];
+		return chars[look];
 
 	return EOF;
 }
 
 bool CharStream::HasMore()
 {
-	return index<chars.size();
+	return index<size;
 }
 
 
@@ -151,22 +461,28 @@ Lexer::Lexer()
 }
 
 
-bool Lexer::Parse(string code)
+bool Lexer::Parse(const char* code,size_t size,int firstLine)
 {
 	if(tokens)delete tokens;
 	if(stream)delete stream;
 
 	tokens = new TokenStream();
-	stream = new CharStream(StripComments(code));
+	tokens->source = code;
+	stream = new CharStream(code,size);
 
-	line=1;
+	//a rough guess that saves most of the regrowing
+	tokens->tokens.reserve(size/4);
+
+	line=firstLine;
 
 	while(stream->HasMore())
 	{
-		int chr=stream->PeekChar();
+		int chr=stream->chars[stream->index];
 		
 		if(IsWhiteSpace())
 			ReadWhiteSpace();
+		else if(IsComment())
+			ReadComment();
 		else if(IsIdentifier())
 			ReadIdentifier();
 		else if(IsNumber())
@@ -225,7 +541,13 @@ bool Lexer::Parse(string code)
 				AddToken(Token::Comma);
 				break;
 			case '.':
-				AddToken(Token::Dot);
+				if(stream->PeekChar(1)=='.')
+				{
+					stream->Advance();
+					AddToken(Token::Range);
+				}
+				else
+					AddToken(Token::Dot);
 				break;
 			case '=':
 				stream->Advance();
@@ -241,6 +563,28 @@ bool Lexer::Parse(string code)
 				else
 					AddToken(Token::Not,false);
 				break;
+			case '&':
+				stream->Advance();
+				if(stream->PeekChar()=='&')
+					AddToken(Token::And);
+				else
+				{
+					error.code = Error::UNKOWN_CHAR;
+					error.message = "unknown character &, did you mean &&";
+					return false;
+				}
+				break;
+			case '|':
+				stream->Advance();
+				if(stream->PeekChar()=='|')
+					AddToken(Token::Or);
+				else
+				{
+					error.code = Error::UNKOWN_CHAR;
+					error.message = "unknown character |, did you mean ||";
+					return false;
+				}
+				break;
 			case '<':
 				stream->Advance();
 				if(stream->PeekChar()=='=')
@@ -262,10 +606,8 @@ bool Lexer::Parse(string code)
 				AddToken(Token::SemiColon);
 				break;
 			case '\'':
-				ReadSingleQuotedString();
-				break;
 			case '"':
-				ReadDoubleQuotedString();
+				ReadString((char)chr);
 				break;
 			default:
 				error.code = Error::UNKOWN_CHAR;
@@ -281,121 +623,60 @@ bool Lexer::Parse(string code)
 
 void Lexer::AddToken(Token::Type type,bool advance)
 {
-	Token token;
-	token.type = type;
-	token.line=line;
-
-	tokens->AddToken(token);
+	tokens->AddToken(type,stream->index,0,line);
 
 	if(advance)
 		stream->Advance();
 }
 
+//the Is* checks are only made while the stream HasMore
+
 bool Lexer::IsWhiteSpace()
 {
-	int c = stream->PeekChar();
-	return (c==' '||c=='\n'||c=='\t');
+	return (charTable[stream->chars[stream->index]]&CHAR_SPACE)!=0;
 }
 
 void Lexer::ReadWhiteSpace()
 {
-	int c;
-	while(stream->HasMore())
-	{
-		c = stream->PeekChar();
-		if(c=='\n')
-			line++;
-		if (c==' '||c=='\n'||c=='\t')
-			stream->NextChar();
-		else
-			return;
-	}
+	stream->index = SkipWhiteSpace(stream->chars,stream->index,stream->size,line);
 }
 
 bool Lexer::IsIdentifier()
 {
-	int c = stream->PeekChar();
-	return (c=='_'||isalpha(c));
+	return (charTable[stream->chars[stream->index]]&CHAR_IDEN_START)!=0;
+}
+
+bool Lexer::IsComment()
+{
+	return stream->chars[stream->index]=='/' && stream->PeekChar(1)=='/';
+}
+
+void Lexer::ReadComment()
+{
+	//the newline is left for ReadWhiteSpace to count
+	stream->index = FindChar(stream->chars,stream->index,stream->size,'\n');
 }
 
 void Lexer::ReadIdentifier()
 {
-	int c;
-	string token;
-	while(stream->HasMore())
-	{
-		c = stream->PeekChar();
-		if (c=='_'||isalpha(c) || (token.size()>0 && isdigit(c)))
-		{
-			char chr = stream->NextChar();
-			token+=chr;
-		}
-		else
-			break;
-	}
-	Token::Type type = Token::Iden;
-
-	//check for keywords
-	if(token=="import")
-		type = Token::Import;
-	else if(token=="module")
-		type = Token::Module;
-	else if(token=="new")
-		type = Token::New;
-	else if(token=="class")
-		type = Token::Class;
-	else if(token=="function")
-		type = Token::Function;
-	else if(token=="def")
-		type = Token::Def;
-	else if(token=="extends")
-		type = Token::Extends;
-	else if(token=="static")
-		type = Token::Static;
-	else if(token=="return")
-		type = Token::Return;
-	else if(token=="var")
-		type = Token::Var;
-	else if(token=="enum")
-		type = Token::Enum;
-	else if(token=="if")
-		type = Token::If;
-	else if(token=="else")
-		type = Token::Else;
-	else if(token=="elif")
-		type = Token::Elif;
-	else if(token=="for")
-		type = Token::For;
-	else if(token=="while")
-		type = Token::While;
-	else if(token=="break")
-		type = Token::Break;
-	else if(token=="or")
-		type = Token::Or;
-	else if(token=="and")
-		type = Token::And;
-	/* literals */
-	else if(token=="true")
-		type = Token::True;
-	else if(token=="false")
-		type = Token::False;
-	else if(token=="null")
-		type = Token::Null;
-	
-
-	//todo: check for specific token types
-	tokens->AddToken(type,token,line);
+	unsigned int start = stream->index;
+
+	//IsIdentifier already checked the first char
+	stream->index = ScanIdentifier(stream->chars,start+1,stream->size);
+
+	unsigned int length = stream->index-start;
+	tokens->AddToken(keywords.Find(stream->chars+start,length),start,length,line);
 }
 
 bool Lexer::IsNumber()
 {
-	return isdigit(stream->PeekChar())!=0;
+	return (charTable[stream->chars[stream->index]]&CHAR_DIGIT)!=0;
 }
 
 void Lexer::ReadNumber()
 {
 	bool dot = false;//check if dot is reached
-	string token;
+	unsigned int start = stream->index;
 	while(stream->HasMore())
 	{
 		char c=stream->PeekChar();
@@ -404,7 +685,8 @@ void Lexer::ReadNumber()
 		{
 			stream->Advance();
 		}
-		else if(c=='.' && dot==false)
+		//a dot not followed by a digit isnt part of the number (0..10)
+		else if(c=='.' && dot==false && isdigit(stream->PeekChar(1)))
 		{
 			stream->Advance();
 			dot=true;
@@ -413,8 +695,6 @@ void Lexer::ReadNumber()
 		{
 			break;
 		}
-
-		token+=c;
 	}
 
 	Token::Type type;
@@ -423,113 +703,21 @@ void Lexer::ReadNumber()
 	else
 		type = Token::Integer;
 
-	tokens->AddToken(type,token,line);
-}
-
-void Lexer::ReadSingleQuotedString()
-{
-	stream->Advance();// '
-
-	Token token;
-	token.line = line;
-	token.type = Token::String;
-
-	while(stream->HasMore())
-	{
-		int chr = stream->NextChar();
-		if(chr=='\'')
-		{
-			//stream->Advance();
-			break;
-		}
-		if(chr==EOF)
-		{
-			//error
-
-			break;
-		}
-		token.token+=chr;
-	}
-	tokens->AddToken(token);
+	tokens->AddToken(type,start,stream->index-start,line);
 }
 
-void Lexer::ReadDoubleQuotedString()
+void Lexer::ReadString(char quote)
 {
-	stream->Advance();// "
-
-	Token token;
-	token.line = line;
-	token.type = Token::String;
-
-	while(stream->HasMore())
-	{
-		int chr = stream->NextChar();
-		if(chr=='\"')
-		{
-			//stream->Advance();
-			break;
-		}
-		if(chr==EOF)
-		{
-			//error
-
-			break;
-		}
-		token.token+=chr;
-	}
-	tokens->AddToken(token);
-}
-
-string Lexer::StripComments(string code)
-{
-	char* res = new char[code.size()+1];
-	int resSize = 0;//char limit of max(long)
-
-	bool commentMode = false;
-
-	for(int i=0;i<code.size();i++)
-	{
-		if(commentMode)
-		{
-			
-			if(code[i]=='\n')
-			{
-				//end of comment
-				commentMode = false;
-				res[i] = '\n';
-			}
-			else
-			{
-				//replace with space
-				res[i] = ' ';
-			}
-
-		}
-		else
-		{
-			if(code[i]=='/' && ( i+1<code.size() && code[i+1]=='/')  )
-			{
-				//start of comment
-				commentMode = true;
-				res[i] = ' ';
-			}
-			else
-			{
-				//normal line
-				res[i] = code[i];
-			}
-		}
-
-	}
-
-	res[code.size()]='\0';
-	string result(res);
-	delete res;
+	stream->Advance();// opening quote
 
-	//std::cout<<code.c_str()<<endl;
-	//std::cout<<result.c_str()<<endl;
+	//the text is everything up to the closing quote, or the end of the source
+	unsigned int start = stream->index;
+	int startLine = line;
+	stream->index = FindChar(stream->chars,start,stream->size,quote);
+	line += CountNewLines(stream->chars,start,stream->index);
 
-	return result;
+	tokens->AddToken(Token::String,start,stream->index-start,startLine);
+	stream->Advance();// closing quote
 }
 
 Lexer::~Lexer()
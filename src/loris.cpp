@@ -23,9 +23,6 @@ WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 
 #include "../include/loris/loris.hpp"
 
-#include <fstream>
-#include <sstream>
-
 using namespace loris;
 
 Loris::Loris()
@@ -43,9 +40,52 @@ void Loris::AddSource(string filename, string source)
 	compiler.AddSource(filename, source);
 }
 
-void Loris::AddFileSource(string filename)
+bool Loris::AddFileSource(const string& filename)
+{
+	if (!compiler.AddFileSource(filename))
+	{
+		error = compiler.GetError();
+		return false;
+	}
+
+	return true;
+}
+
+bool Loris::AddFileSources(const vector<string>& filenames)
+{
+	if (!compiler.AddFileSources(filenames))
+	{
+		error = compiler.GetError();
+		return false;
+	}
+
+	return true;
+}
+
+bool Loris::AddSourceDirectory(const string& dir, const string& pattern)
+{
+	if (!compiler.AddSourceDirectory(dir, pattern))
+	{
+		error = compiler.GetError();
+		return false;
+	}
+
+	return true;
+}
+
+void Loris::SetSinglePass(bool singlePass)
+{
+	compiler.SetSinglePass(singlePass);
+}
+
+void Loris::SetLazy(bool lazy)
+{
+	compiler.SetLazy(lazy);
+}
+
+void Loris::SetCacheDirectory(const string& dir)
 {
-	AddSource(filename, ReadFile(filename.c_str()));
+	compiler.SetCacheDirectory(dir);
 }
 
 bool Loris::HasError()
@@ -71,6 +111,21 @@ bool Loris::Compile()
 	return true;
 }
 
+bool Loris::SaveSnapshot(const string& filename)
+{
+	return Snapshot::Write(&vm, filename, error);
+}
+
+bool Loris::LoadSnapshot(const string& filename)
+{
+	return Snapshot::Read(filename, assembly, &vm, error);
+}
+
+size_t Loris::CountUncompiled()
+{
+	return assembly->CountUncompiled();
+}
+
 Value Loris::ExecuteFunction(const string& name)
 {
 	//bad! find a way to return an error instead
@@ -99,6 +154,66 @@ Value Loris::ExecuteFunction(Function* func)
 	return ret;
 }
 
+CallSite Loris::Prepare(const string& name, int arity)
+{
+	if (assembly == NULL)
+		return CallSite();
+
+	return vm.Prepare(name, arity);
+}
+
+Value Loris::Invoke(const CallSite& site, const Value* args)
+{
+	Value ret = vm.Invoke(site, args);
+
+	if (vm.HasError())
+		error = vm.GetError();
+
+	return ret;
+}
+
+bool Loris::InvokeBatch(const CallSite& site, const Value* args, size_t count, Value* results)
+{
+	bool ok = vm.InvokeBatch(site, args, count, results);
+
+	if (vm.HasError())
+		error = vm.GetError();
+
+	return ok;
+}
+
+CoroutineObject* Loris::CreateCoroutine(const string& name)
+{
+	if (assembly == NULL)
+		return nullptr;
+
+	Function* func = assembly->GetFunction(name);
+	if (func == NULL)
+		return nullptr;
+
+	return vm.CreateCoroutine(func);
+}
+
+Value Loris::Resume(CoroutineObject* co)
+{
+	Value ret = vm.Resume(co);
+
+	if (vm.HasError())
+		error = vm.GetError();
+
+	return ret;
+}
+
+void Loris::DestroyCoroutine(CoroutineObject* co)
+{
+	vm.DestroyCoroutine(co);
+}
+
+VMStats& Loris::GetStats()
+{
+	return vm.GetStats();
+}
+
 void Loris::AddFunction(const string& name, NativeFunction func)
 {
 	assembly->AddFunction(name, func);
@@ -118,20 +233,3 @@ Loris::~Loris()
 {
 	delete assembly;
 }
-
-string Loris::ReadFile(const char *filename)
-{
-	ifstream file(filename);
-	stringstream stream;
-	string line;
-
-	while (file.good())
-	{
-		getline(file, line);
-		stream << line << endl;
-	}
-
-	cout << stream.str() << endl;
-
-	return stream.str();
-}
\ No newline at end of file
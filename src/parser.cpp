@@ -36,7 +36,13 @@ Parser::Parser()
 	tokens=NULL;
 	program=NULL;
 }
-bool Parser::Parse(string code)
+
+Parser::~Parser()
+{
+	Release();
+}
+
+bool Parser::Parse(const char* code,size_t size)
 {
 	if(lex)delete lex;
 	lex = new Lexer;
@@ -44,8 +50,11 @@ bool Parser::Parse(string code)
 	//cleanup from previous parse
 	Cleanup();
 		
-	if(!lex->Parse(code))
+	if(!lex->Parse(code,size))
+	{
+		error = lex->error;
 		return false;
+	}
 
 	tokens = lex->tokens;
 
@@ -60,7 +69,7 @@ bool Parser::Parse(string code)
 
 Program* Parser::ParseProgram(bool *ok)
 {
-	Program* program=AddNode(new Program());
+	Program* program=NewNode<Program>();
 
 	Statement* stmt=nullptr;
 	ClassDefinition* classDef=nullptr;
@@ -78,12 +87,12 @@ Program* Parser::ParseProgram(bool *ok)
 		case Token::Class:
 			classDef = ParseClassDefinition(CHECK_OK);
 			classDef->line = tok.line;
-			program->AddClass(classDef);
+			program->AddClass(&arena,classDef);
 			break;
 		case Token::Def:
 			func = ParseFunctionDefinition(CHECK_OK);
 			func->line = tok.line;
-			program->AddFunction(func);
+			program->AddFunction(&arena,func);
 			break;
 		case Token::SemiColon:
 			//empty statement
@@ -110,13 +119,13 @@ Program* Parser::ParseProgram(bool *ok)
 //	var iden (':' iden)? ';'
 ClassAttribDefinition* Parser::ParseClassAttribDefinition(bool* ok)
 {
-	ClassAttribDefinition* attrib = AddNode(new ClassAttribDefinition());
+	ClassAttribDefinition* attrib = NewNode<ClassAttribDefinition>();
 
 	Consume(Token::Var,CHECK_OK);
 
 	//name
 	Expect(Token::Iden,CHECK_OK);//iden
-	attrib->SetName(tokens->NextToken().token);
+	attrib->SetName(NextText());
 
 	//type is optional
 	if(tokens->PeekTokenType()== Token::Colon)
@@ -125,7 +134,7 @@ ClassAttribDefinition* Parser::ParseClassAttribDefinition(bool* ok)
 
 		//type
 		Expect(Token::Iden,CHECK_OK);//iden
-		attrib->SetType(tokens->NextToken().token);
+		attrib->SetType(NextText());
 			
 	}
 
@@ -133,10 +142,12 @@ ClassAttribDefinition* Parser::ParseClassAttribDefinition(bool* ok)
 	if(tokens->PeekTokenType()== Token::Assign)
 	{
 		Consume(Token::Assign,CHECK_OK);//'='
-		FunctionDefinition* func = AddNode(new FunctionDefinition());
+		FunctionDefinition* func = NewNode<FunctionDefinition>();
+		int line = tokens->PeekToken().line;
 		Expression* expr = ParseExpr(CHECK_OK);
-		ExpressionStatement* exprStmt = AddNode(new ExpressionStatement(expr));
-		func->AddStatement(exprStmt);
+		ExpressionStatement* exprStmt = NewNode<ExpressionStatement>(expr);
+		exprStmt->line = line;
+		func->AddStatement(&arena,exprStmt);
 
 		attrib->init = func;
 	}
@@ -152,11 +163,11 @@ ClassAttribDefinition* Parser::ParseClassAttribDefinition(bool* ok)
 //	'class' iden ('extends' iden)? '{' (ClassAttribDefinition|functiondefinition)* '}'
 ClassDefinition* Parser::ParseClassDefinition(bool* ok)
 {
-	ClassDefinition* classDef = AddNode(new ClassDefinition());
+	ClassDefinition* classDef = NewNode<ClassDefinition>();
 
 	Consume(Token::Class,CHECK_OK);// class
 	Expect(Token::Iden,CHECK_OK);// class name
-	classDef->SetName(tokens->NextToken().token);
+	classDef->SetName(NextText());
 
 	//(extends inden)?
 	if(tokens->PeekTokenType() == Token::Extends)
@@ -164,7 +175,7 @@ ClassDefinition* Parser::ParseClassDefinition(bool* ok)
 		Consume(Token::Extends,CHECK_OK);
 
 		Expect(Token::Iden,CHECK_OK);
-		classDef->SetSuperClass(tokens->NextToken().token);
+		classDef->SetSuperClass(NextText());
 	}
 
 	Consume(Token::OpenCurlyBrace,CHECK_OK);//{
@@ -187,18 +198,18 @@ ClassDefinition* Parser::ParseClassDefinition(bool* ok)
 		case Token::Iden://constructor
 			func = ParseFunctionDefinition(true,CHECK_OK);
 			//func->SetStatic(nextMemberIsStatic);
-			classDef->AddFunction(func);
+			classDef->AddFunction(&arena,func);
 			break;
 		case Token::Def:
 			func = ParseFunctionDefinition(CHECK_OK);
 			func->SetStatic(nextMemberIsStatic);
-			classDef->AddFunction(func);
+			classDef->AddFunction(&arena,func);
 			break;
 		case Token::Var:
 			{
 				ClassAttribDefinition* attrib=ParseClassAttribDefinition(CHECK_OK);
 				attrib->SetStatic(nextMemberIsStatic);
-				classDef->AddAttrib(attrib);
+				classDef->AddAttrib(&arena,attrib);
 			}
 			break;
 		default:
@@ -214,13 +225,16 @@ ClassDefinition* Parser::ParseClassDefinition(bool* ok)
 	return classDef;
 }
 
-bool Parser::ParseExpr(string code)
+bool Parser::ParseExpr(const string& code)
 {
 	if(lex)delete lex;
 	lex = new Lexer;
 		
 	if(!lex->Parse(code))
+	{
+		error = lex->error;
 		return false;
+	}
 
 	tokens = lex->tokens;
 
@@ -245,7 +259,7 @@ Expression* Parser::ParseAssignExpr(bool* ok)
 		Token::Type op = tokens->NextToken().type;
 
 		Expression *rhs = ParseBinaryExpr(4,CHECK_OK);
-		expr = new BinaryExpression(op,expr,rhs);
+		expr = NewNode<BinaryExpression>(op,expr,rhs);
 	}
 
 	//Consume(Token::SemiColon,CHECK_OK);
@@ -258,19 +272,19 @@ Expression* Parser::ParseVarExpr(bool* ok)
 	Consume(Token::Var,CHECK_OK);//var
 
 	Expect(Token::Iden,CHECK_OK);//iden
-	string name = tokens->NextToken().token;
+	StringRef name = NextText();
 
 	if(tokens->PeekTokenType()==Token::Colon)
 	{
 		Consume(Token::Colon,CHECK_OK);//':'
 
 		Expect(Token::Iden,CHECK_OK);//iden
-		string type = tokens->NextToken().token;
+		StringRef type = NextText();
 
-		return new VarExpr(name,type);
+		return NewNode<VarExpr>(name,type);
 	}
 
-	return new VarExpr(name,"any");//type doesnt matter at the moment
+	return NewNode<VarExpr>(name,"any");//type doesnt matter at the moment
 }
 
 bool Parser::IsAssignOp(Token::Type op)
@@ -317,7 +331,7 @@ Expression* Parser::ParseBinaryExpr(int min_prec,bool *ok)
 		Expression *rhs = ParseBinaryExpr(next_min_prec,CHECK_OK);
 
 		//create binary expression and add left and right hand side
-		BinaryExpression *bin = AddNode(new BinaryExpression(op.type,lhs,rhs));
+		BinaryExpression *bin = NewNode<BinaryExpression>(op.type,lhs,rhs);
 
 		//bin->left = lhs;
 		//bin->right = rhs;
@@ -331,8 +345,13 @@ Expression* Parser::ParseBinaryExpr(int min_prec,bool *ok)
 Op Parser::ParseOp(bool *ok)
 {
 	//assume next token is op, for now
+	return GetOp(tokens->PeekTokenType());
+}
+
+Op Parser::GetOp(Token::Type type)
+{
 	Op op;
-	op.type = tokens->PeekTokenType();
+	op.type = type;
 
 	switch(op.type)
 	{
@@ -390,28 +409,31 @@ Expression* Parser::ParsePrimary(bool *ok)
 	switch(token.type)
 	{
 	case Token::String:
-		atom = AddNode(new StringLiteral(token.token));
+		atom = NewNode<StringLiteral>(tokens->GetText(token));
 		tokens->Advance();
 		break;
 	case Token::Float:
 	case Token::Integer:
-		atom = AddNode(new NumberLiteral(token.token));
+		atom = NewNode<NumberLiteral>(tokens->GetText(token));
 		tokens->Advance();
 		break;
 	//negative
 	case Token::Sub:
 		atom = ParseNegExpr(CHECK_OK);
 		break;
+	case Token::Not:
+		atom = ParseNotExpr(CHECK_OK);
+		break;
 	case Token::Null:
-		atom = AddNode(new NullLiteral());
+		atom = NewNode<NullLiteral>();
 		tokens->Advance();
 		break;
 	case Token::True:
-		atom = AddNode(new BoolLiteral(true));
+		atom = NewNode<BoolLiteral>(true);
 		tokens->Advance();
 		break;
 	case Token::False:
-		atom = AddNode(new BoolLiteral(false));
+		atom = NewNode<BoolLiteral>(false);
 		tokens->Advance();
 		break;
 	case Token::Iden:
@@ -425,6 +447,9 @@ Expression* Parser::ParsePrimary(bool *ok)
 	case Token::New:
 		atom = ParseNewExpr(CHECK_OK);
 		break;
+	case Token::OpenCurlyBrace:
+		atom = ParseMapLiteral(CHECK_OK);
+		break;
 	case Token::OpenParen:
 		tokens->Advance();//consume (
 		atom = ParseExpr(CHECK_OK);
@@ -448,12 +473,12 @@ Expression* Parser::ParseLiteral(bool* ok)
 	switch(token.type)
 	{
 	case Token::String:
-		atom = AddNode(new StringLiteral(token.token));
+		atom = NewNode<StringLiteral>(tokens->GetText(token));
 		tokens->Advance();
 		break;
 	case Token::Float:
 	case Token::Integer:
-		atom = AddNode(new NumberLiteral(token.token));
+		atom = NewNode<NumberLiteral>(tokens->GetText(token));
 		tokens->Advance();
 		break;
 	//negative
@@ -461,15 +486,15 @@ Expression* Parser::ParseLiteral(bool* ok)
 		atom = ParseNegExpr(CHECK_OK);
 		break;
 	case Token::Null:
-		atom = AddNode(new NullLiteral());
+		atom = NewNode<NullLiteral>();
 		tokens->Advance();
 		break;
 	case Token::True:
-		atom = AddNode(new BoolLiteral(true));
+		atom = NewNode<BoolLiteral>(true);
 		tokens->Advance();
 		break;
 	case Token::False:
-		atom = AddNode(new BoolLiteral(false));
+		atom = NewNode<BoolLiteral>(false);
 		tokens->Advance();
 		break;
 	default:
@@ -486,7 +511,7 @@ Expression* Parser::ParseNegExpr(bool* ok)
 	Consume(Token::Sub,CHECK_OK);
 	Token token = tokens->PeekToken();
 
-	NegExpr *neg = AddNode(new NegExpr());
+	NegExpr *neg = NewNode<NegExpr>();
 
 	//parse expression instead, let the vm throw the error
 	neg->child = ParseExpr(CHECK_OK);
@@ -496,7 +521,7 @@ Expression* Parser::ParseNegExpr(bool* ok)
 	{
 	case Token::Float:
 	case Token::Integer:
-		neg->child = AddNode(new NumberLiteral(token.token));
+		neg->child = NewNode<NumberLiteral>(tokens->GetText(token));
 		tokens->Advance();
 		break;
 	case Token::Iden:
@@ -513,19 +538,31 @@ Expression* Parser::ParseNegExpr(bool* ok)
 	return neg;
 }
 
+//'!' primary
+//only binds to the primary so !a && b is (!a) && b
+Expression* Parser::ParseNotExpr(bool* ok)
+{
+	Consume(Token::Not,CHECK_OK);
+
+	NotExpr *notExpr = NewNode<NotExpr>();
+	notExpr->child = ParsePrimary(CHECK_OK);
+
+	return notExpr;
+}
+
 //'new' iden '(' args ')'
 Expression* Parser::ParseNewExpr(bool *ok)
 {
 	tokens->Advance();// 'new'
 
 	Expect(Token::Iden,CHECK_OK);
-	string name = tokens->NextToken().token;
+	StringRef name = NextText();
 
 	tokens->Advance();//' (
 
 	Arguments* args = ParseArgs(CHECK_OK);
 
-	Expression* expr = AddNode(new NewExpr(name,args));
+	Expression* expr = NewNode<NewExpr>(name,args);
 
 	Consume(Token::CloseParen,CHECK_OK);// ')'
 
@@ -533,13 +570,44 @@ Expression* Parser::ParseNewExpr(bool *ok)
 	return ParseMemberExprSuffix(expr,CHECK_OK);
 }
 
+//'{' (expr ':' expr (',' expr ':' expr)*)? '}'
+Expression* Parser::ParseMapLiteral(bool *ok)
+{
+	Consume(Token::OpenCurlyBrace,CHECK_OK);// {
+
+	MapLiteral* map = NewNode<MapLiteral>();
+
+	if(tokens->PeekTokenType()!=Token::CloseCurlyBrace)
+	{
+		while(true)
+		{
+			Expression* key = ParseExpr(CHECK_OK);
+			Consume(Token::Colon,CHECK_OK);// :
+			Expression* value = ParseExpr(CHECK_OK);
+			map->AddPair(&arena,key,value);
+
+			if(tokens->PeekTokenType()!=Token::Comma)
+				break;
+			Consume(Token::Comma,CHECK_OK);
+
+			//allow a trailing comma
+			if(tokens->PeekTokenType()==Token::CloseCurlyBrace)
+				break;
+		}
+	}
+
+	Consume(Token::CloseCurlyBrace,CHECK_OK);// }
+
+	return ParseMemberExprSuffix(map,CHECK_OK);
+}
+
 /*
 iden expr_suffix?
 */
 Expression* Parser::ParseMemberExpr(bool *ok)
 {
 	Expect(Token::Iden,CHECK_OK);
-	Expression* expr = AddNode(new Identifier(tokens->NextToken().token));
+	Expression* expr = NewNode<Identifier>(NextText());
 
 	return ParseMemberExprSuffix(expr,CHECK_OK);
 }
@@ -551,7 +619,7 @@ these follow identifiers,list_literals and expressions between parentheses
 */
 Expression* Parser::ParseMemberExprSuffix(Expression *expr,bool *ok)
 {
-	//Expression *e;
+	Expression *e;
 	Identifier* iden;
 	Arguments* args;
 
@@ -560,30 +628,27 @@ Expression* Parser::ParseMemberExprSuffix(Expression *expr,bool *ok)
 		switch(tokens->PeekTokenType())
 		{
 		case Token::OpenBracket:
-			//todo: chnage to indexaccess
-			/*
 			tokens->Advance();// [
 
 			e = ParseExpr(CHECK_OK);
-			expr = AddNode(new PropertyAccess(expr,e));
+			expr = NewNode<IndexAccess>(expr,e);
 
 			Consume(Token::CloseBracket,CHECK_OK);// ]
-			*/
 			break;
 		case Token::Dot:
 			tokens->Advance();// .
 			Expect(Token::Iden,CHECK_OK);//next item must be an identifier
 
 			//make into an identifier
-			iden = AddNode(new Identifier(tokens->NextToken().token));
-			expr = AddNode(new PropertyAccess(expr,iden->name));
+			iden = NewNode<Identifier>(NextText());
+			expr = NewNode<PropertyAccess>(expr,iden->name);
 			break;
 		case Token::OpenParen:
 			tokens->Advance();//' (
 
 			args = ParseArgs(CHECK_OK);
 
-			expr = AddNode(new CallExpr(expr,args));
+			expr = NewNode<CallExpr>(expr,args);
 
 			Consume(Token::CloseParen,CHECK_OK);// ')'
 			break;
@@ -595,12 +660,12 @@ Expression* Parser::ParseMemberExprSuffix(Expression *expr,bool *ok)
 
 Arguments* Parser::ParseArgs(bool *ok)
 {
-	Arguments* args = AddNode(new Arguments());
+	Arguments* args = NewNode<Arguments>();
 
 	if(tokens->PeekTokenType()!=Token::CloseParen)
 	{
 		Expression* expr = ParseExpr(CHECK_OK);
-		args->AddArg(expr);
+		args->AddArg(&arena,expr);
 
 		while(tokens->PeekTokenType()==Token::Comma)
 		{
@@ -609,7 +674,7 @@ Arguments* Parser::ParseArgs(bool *ok)
 			//tokens->Advance();//cheaper
 
 			expr = ParseExpr(CHECK_OK);
-			args->AddArg(expr);
+			args->AddArg(&arena,expr);
 		}
 	}
 
@@ -628,13 +693,13 @@ import module.Submodule.*;
 */
 ImportStatement* Parser::ParseImportStatement(bool *ok)
 {
-	ImportStatement *stmt = AddNode(new ImportStatement());
+	ImportStatement *stmt = NewNode<ImportStatement>();
 
 	Consume(Token::Import,CHECK_OK);
 
 	Expect(Token::Iden,CHECK_OK);
 	Token name = tokens->NextToken();
-	stmt->AddToPath(name.token);
+	stmt->AddToPath(&arena,tokens->GetText(name));
 
 	while(tokens->PeekTokenType()==Token::Dot)
 	{
@@ -644,14 +709,14 @@ ImportStatement* Parser::ParseImportStatement(bool *ok)
 		if(tokens->PeekTokenType()==Token::Mul)// import module.*;
 		{
 			tokens->Advance();
-			stmt->AddToPath("*");
+			stmt->AddToPath(&arena,"*");
 			break;
 		}
 		else
 		{
 			Expect(Token::Iden,CHECK_OK);
 			name = tokens->NextToken();
-			stmt->AddToPath(name.token);
+			stmt->AddToPath(&arena,tokens->GetText(name));
 		}
 			
 	}
@@ -665,11 +730,11 @@ ImportStatement* Parser::ParseImportStatement(bool *ok)
 //	iden (colon iden)?
 FunctionParameter* Parser::ParseParam(bool *ok)
 {
-	FunctionParameter* param = AddNode(new FunctionParameter());
+	FunctionParameter* param = NewNode<FunctionParameter>();
 
 	//iden
 	Expect(Token::Iden,CHECK_OK);
-	param->name = tokens->NextToken().token;
+	param->name = NextText();
 
 	//type is optional at the moment
 	if(tokens->PeekTokenType()==Token::Colon)
@@ -679,7 +744,7 @@ FunctionParameter* Parser::ParseParam(bool *ok)
 
 		//iden
 		Expect(Token::Iden,CHECK_OK);
-		param->type = tokens->NextToken().token;
+		param->type = NextText();
 	}
 	else
 	{
@@ -698,7 +763,7 @@ void* Parser::ParseParamList(FunctionDefinition* func,bool *ok)
 	if(tokens->PeekTokenType()==Token::Iden)
 	{
 		FunctionParameter* param = ParseParam(CHECK_OK);
-		func->AddParam(param);
+		func->AddParam(&arena,param);
 
 		while(tokens->PeekTokenType()==Token::Comma)
 		{
@@ -707,7 +772,7 @@ void* Parser::ParseParamList(FunctionDefinition* func,bool *ok)
 			//tokens->Advance();//cheaper
 				
 			FunctionParameter* param = ParseParam(CHECK_OK);
-			func->AddParam(param);
+			func->AddParam(&arena,param);
 		}
 	}
 
@@ -722,14 +787,14 @@ FunctionDefinition* Parser::ParseFunctionDefinition(bool *ok)
 //('def')? iden '(' (functionparam)* ')' (':' iden)? '{' block '}'
 FunctionDefinition* Parser::ParseFunctionDefinition(bool isConstructor,bool *ok)
 {
-	FunctionDefinition *func = AddNode(new FunctionDefinition());
+	FunctionDefinition *func = NewNode<FunctionDefinition>();
 
 	if(!isConstructor)//constructors have no 'def'
 		Consume(Token::Def,CHECK_OK); //def
 
 	//function name
 	Expect(Token::Iden,CHECK_OK);
-	func->SetName(tokens->NextToken().token);
+	func->SetName(NextText());
 
 	Consume(Token::OpenParen,CHECK_OK);// (
 
@@ -742,7 +807,7 @@ FunctionDefinition* Parser::ParseFunctionDefinition(bool isConstructor,bool *ok)
 	{
 		Consume(Token::Colon,CHECK_OK);//':'
 		Expect(Token::Iden,CHECK_OK);
-		func->SetReturnType(tokens->NextToken().token);
+		func->SetReturnType(NextText());
 	}
 	else
 	{
@@ -756,7 +821,7 @@ FunctionDefinition* Parser::ParseFunctionDefinition(bool isConstructor,bool *ok)
 	while(peek != Token::CloseCurlyBrace && peek != Token::EOS)
 	{
 		Statement *stmt = ParseStatement(CHECK_OK);
-		func->AddStatement(stmt);
+		func->AddStatement(&arena,stmt);
 
 		peek = tokens->PeekTokenType();
 	}
@@ -789,10 +854,18 @@ Statement* Parser::ParseStatement(bool *ok)
 		stmt = ParseWhileStatement(CHECK_OK);
 		stmt->line = tok.line;
 		break;
+	case Token::For:
+		stmt = ParseForStatement(CHECK_OK);
+		stmt->line = tok.line;
+		break;
 	case Token::Return:
 		stmt = ParseReturnStatement(CHECK_OK);
 		stmt->line = tok.line;
 		break;
+	case Token::Yield:
+		stmt = ParseYieldStatement(CHECK_OK);
+		stmt->line = tok.line;
+		break;
 	//case Token::Var:
 	//	stmt = ParseVarStatement(CHECK_OK);
 	//	break;
@@ -819,7 +892,7 @@ IfStatement* Parser::ParseIfStatement(bool *ok)
 
 	Block* block = ParseBlock(CHECK_OK);//{ }
 
-	IfStatement *stmt = AddNode(new IfStatement(expr,block));
+	IfStatement *stmt = NewNode<IfStatement>(expr,block);
 		
 	//check for an else
 	if(tokens->PeekTokenType()==Token::Else)
@@ -829,7 +902,7 @@ IfStatement* Parser::ParseIfStatement(bool *ok)
 	}
 		
 
-	//IfStatement* stmt = AddNode(new IfStatement());
+	//IfStatement* stmt = NewNode<IfStatement>();
 	return stmt;
 }
 
@@ -844,8 +917,39 @@ WhileStatement* Parser::ParseWhileStatement(bool *ok)
 
 	Block* block = ParseBlock(CHECK_OK);//{ }
 
-	//IfStatement* stmt = AddNode(new IfStatement());
-	return AddNode(new WhileStatement(expr,block));
+	//IfStatement* stmt = NewNode<IfStatement>();
+	return NewNode<WhileStatement>(expr,block);
+}
+
+//'for' '(' 'var'? iden 'in' expr ('..' expr)? ')' block
+ForStatement* Parser::ParseForStatement(bool *ok)
+{
+	Consume(Token::For,CHECK_OK);// for
+	Consume(Token::OpenParen,CHECK_OK);// (
+
+	//var is optional, the loop variable is a local either way
+	if(tokens->PeekTokenType()==Token::Var)
+		tokens->Advance();
+
+	Expect(Token::Iden,CHECK_OK);
+	StringRef name = NextText();
+
+	Consume(Token::In,CHECK_OK);// in
+
+	Expression* expr = ParseExpr(CHECK_OK);
+	Expression* end = nullptr;
+
+	if(tokens->PeekTokenType()==Token::Range)
+	{
+		tokens->Advance();// ..
+		end = ParseExpr(CHECK_OK);
+	}
+
+	Consume(Token::CloseParen,CHECK_OK);// )
+
+	Block* block = ParseBlock(CHECK_OK);//{ }
+
+	return NewNode<ForStatement>(name,expr,end,block);
 }
 /*
 'enum' EnumName '{' (EnumValue ('=' literal )? )*  '}'
@@ -856,9 +960,9 @@ EnumStatement* Parser::ParseEnumStatement(bool *ok)
 	Consume(Token::Enum,CHECK_OK);//enum
 
 	Expect(Token::Iden,CHECK_OK);// iden
-	string name = tokens->NextToken().token;
+	StringRef name = NextText();
 
-	EnumStatement* stmt = AddNode(new EnumStatement(name));
+	EnumStatement* stmt = NewNode<EnumStatement>(name);
 
 	Consume(Token::OpenCurlyBrace,CHECK_OK);//{
 
@@ -866,8 +970,8 @@ EnumStatement* Parser::ParseEnumStatement(bool *ok)
 	if(tokens->PeekTokenType()!=Token::CloseParen)
 	{
 		Expect(Token::Iden,CHECK_OK);// iden
-		name = tokens->NextToken().token;
-		stmt->AddValue(name);
+		name = NextText();
+		stmt->AddValue(&arena,name);
 
 		while(tokens->PeekTokenType()==Token::Comma)
 		{
@@ -876,8 +980,8 @@ EnumStatement* Parser::ParseEnumStatement(bool *ok)
 			tokens->Advance();//cheaper
 
 			Expect(Token::Iden,CHECK_OK);// iden
-			name = tokens->NextToken().token;
-			stmt->AddValue(name);
+			name = NextText();
+			stmt->AddValue(&arena,name);
 		}
 	}
 
@@ -892,15 +996,29 @@ ReturnStatement* Parser::ParseReturnStatement(bool* ok)
 	Expression* expr = ParseExpr(CHECK_OK);
 	Consume(Token::SemiColon,CHECK_OK);//y not use ParseExprStatement
 
-	ReturnStatement* retStmt = AddNode(new ReturnStatement());
+	ReturnStatement* retStmt = NewNode<ReturnStatement>();
 	retStmt->expr = expr;
 
 	return retStmt;
 }
 
+//yield expr; or yield;
+YieldStatement* Parser::ParseYieldStatement(bool* ok)
+{
+	Consume(Token::Yield,CHECK_OK);
+
+	YieldStatement* yieldStmt = NewNode<YieldStatement>();
+	if(tokens->PeekTokenType()!=Token::SemiColon)
+		yieldStmt->expr = ParseExpr(CHECK_OK);
+
+	Consume(Token::SemiColon,CHECK_OK);
+
+	return yieldStmt;
+}
+
 Block* Parser::ParseBlock(bool *ok)
 {
-	Block* block = AddNode(new Block());
+	Block* block = NewNode<Block>();
 
 	if(tokens->PeekTokenType()==Token::OpenCurlyBrace)
 	{
@@ -910,7 +1028,7 @@ Block* Parser::ParseBlock(bool *ok)
 		while(tokens->PeekTokenType()!=Token::CloseCurlyBrace)
 		{
 			Statement *stmt = ParseStatement(CHECK_OK);
-			block->AddStatement(stmt);
+			block->AddStatement(&arena,stmt);
 		}
 
 		Consume(Token::CloseCurlyBrace,CHECK_OK);
@@ -919,7 +1037,7 @@ Block* Parser::ParseBlock(bool *ok)
 	{
 		//parse single statement
 		Statement *stmt = ParseStatement(CHECK_OK);
-		block->AddStatement(stmt);
+		block->AddStatement(&arena,stmt);
 	}
 
 	return block;
@@ -930,7 +1048,7 @@ ExpressionStatement* Parser::ParseExprStatement(bool *ok)
 	Expression *expr = ParseExpr(CHECK_OK);
 	Consume(Token::SemiColon,CHECK_OK);
 
-	ExpressionStatement *stmt = AddNode(new ExpressionStatement(expr));
+	ExpressionStatement *stmt = NewNode<ExpressionStatement>(expr);
 
 	return stmt;
 }
@@ -999,22 +1117,24 @@ void Parser::Consume(Token::Type type,bool *ok)
 
 }
 
-template<class T>
-T* Parser::AddNode(T* node)
+StringRef Parser::NextText()
 {
-	nodes.push_back(static_cast<ASTNode*>(node));
-
-	return node;
+	return tokens->GetText(tokens->NextToken());
 }
 
 void Parser::Cleanup()
 {
-	//cleanup all nodes
-	for(auto i:nodes)
-	{
-		ASTNode* node = i;
-		delete node;
-	}
+	//every node lives in the arena
+	program = nullptr;
+	arena.Reset();
+}
 
-	nodes.clear();
-}
\ No newline at end of file
+void Parser::Release()
+{
+	program = nullptr;
+	arena.Release();
+
+	if(lex)delete lex;
+	lex = nullptr;
+	tokens = nullptr;
+}
@@ -0,0 +1,113 @@
+/*
+
+Copyright (C) 2014-2018 Nicolas Brown
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is furnished
+to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+*/
+
+#include "../include/loris/profiler.hpp"
+
+#include <sstream>
+
+using namespace loris;
+
+Profiler::Profiler(long long interval)
+{
+	this->interval = interval > 0 ? interval : 1;
+	assembly = nullptr;
+	numSamples = 0;
+}
+
+long long Profiler::GetInterval()
+{
+	return interval;
+}
+
+void Profiler::Sample(VirtualMachine* vm, const deque<StackFrame*>& frames)
+{
+	if (frames.empty())
+		return;
+
+	assembly = vm->GetAssembly();
+
+	//frames below the top saved their position when they made their call
+	scratch.clear();
+	for (auto frame : frames)
+	{
+		StackEntry entry;
+		entry.function = frame->function;
+		entry.pc = frame->cp;
+		scratch.push_back(entry);
+	}
+
+	stacks[scratch]++;
+	numSamples++;
+}
+
+size_t Profiler::GetNumSamples()
+{
+	return numSamples;
+}
+
+void Profiler::Clear()
+{
+	stacks.clear();
+	numSamples = 0;
+}
+
+string Profiler::DescribeFrame(const StackEntry& entry)
+{
+	Function* func = entry.function;
+
+	string file = "?";
+	if (assembly != nullptr && func->sourceIndex >= 0 && func->sourceIndex < (int)assembly->sourceNames.size())
+		file = assembly->sourceNames[func->sourceIndex];
+
+	string name = func->name.empty() ? "<anonymous>" : func->name;
+
+	return file + ":" + name + ":" + to_string(func->GetLine(entry.pc));
+}
+
+void Profiler::WriteFoldedStacks(ostream& out)
+{
+	//stacks that only differ by pc can end up on the same lines, merge them
+	std::map<string, size_t> folded;
+	for (auto& stack : stacks)
+	{
+		string key;
+		for (size_t i = 0; i < stack.first.size(); i++)
+		{
+			if (i > 0)
+				key += ";";
+			key += DescribeFrame(stack.first[i]);
+		}
+
+		folded[key] += stack.second;
+	}
+
+	for (auto& stack : folded)
+		out << stack.first << " " << stack.second << "\n";
+}
+
+string Profiler::GetFoldedStacks()
+{
+	stringstream stream;
+	WriteFoldedStacks(stream);
+	return stream.str();
+}
@@ -0,0 +1,446 @@
+/*
+
+Copyright (C) 2014-2018 Nicolas Brown
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is furnished
+to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+*/
+
+#include "../include/loris/runtime.hpp"
+
+#include <atomic>
+#include <algorithm>
+
+using namespace loris;
+
+//objects a participant takes at a time, small enough to balance uneven work
+//and large enough to keep the shared counters cool
+static const size_t BATCH_GRAIN = 16;
+
+//set on threads running a batch. the workers are all busy then, so a batch
+//started from inside one just runs on the current thread
+static thread_local bool inBatch = false;
+
+namespace loris
+{
+
+//share of the objects handed to one participant. others steal from it when theyre done
+struct WorkRange
+{
+	std::atomic<size_t> next;
+	size_t end;
+};
+
+struct ParallelBatch
+{
+	const vector<Object*>* objects;
+	string name;
+	const vector<Value>* args;
+
+	vector<WorkRange> ranges;
+
+	//the first error raised stops everyone
+	std::atomic<bool> failed;
+	std::mutex errorMutex;
+	Error error;
+
+	ParallelBatch(size_t participants) : ranges(participants)
+	{
+		failed = false;
+	}
+};
+
+}
+
+LorisRuntime::LorisRuntime()
+{
+	assembly = new Assembly();
+	compiled = false;
+
+	size_t cores = std::thread::hardware_concurrency();
+	workerCount = cores > 1 ? cores - 1 : 0;
+	batch = nullptr;
+	batchId = 0;
+	pendingWorkers = 0;
+	stopping = false;
+}
+
+void LorisRuntime::AddSource(string source)
+{
+	compiler.AddSource("<source>", source);
+}
+
+void LorisRuntime::AddSource(string filename, string source)
+{
+	compiler.AddSource(filename, source);
+}
+
+bool LorisRuntime::AddFileSource(const string& filename)
+{
+	if (!compiler.AddFileSource(filename))
+	{
+		error = compiler.GetError();
+		return false;
+	}
+
+	return true;
+}
+
+bool LorisRuntime::AddFileSources(const vector<string>& filenames)
+{
+	if (!compiler.AddFileSources(filenames))
+	{
+		error = compiler.GetError();
+		return false;
+	}
+
+	return true;
+}
+
+bool LorisRuntime::AddSourceDirectory(const string& dir, const string& pattern)
+{
+	if (!compiler.AddSourceDirectory(dir, pattern))
+	{
+		error = compiler.GetError();
+		return false;
+	}
+
+	return true;
+}
+
+void LorisRuntime::SetSinglePass(bool singlePass)
+{
+	compiler.SetSinglePass(singlePass);
+}
+
+void LorisRuntime::SetLazy(bool lazy)
+{
+	compiler.SetLazy(lazy);
+}
+
+void LorisRuntime::SetCacheDirectory(const string& dir)
+{
+	compiler.SetCacheDirectory(dir);
+}
+
+void LorisRuntime::AddFunction(const string& name, NativeFunction func)
+{
+	assembly->AddFunction(name, func);
+}
+
+void LorisRuntime::AddFunction(const string& name, std::function<Value(VirtualMachine*, Object*)> func)
+{
+	assembly->AddFunction(name, func);
+}
+
+void LorisRuntime::AddClass(Class* cls)
+{
+	assembly->AddClass(cls);
+}
+
+bool LorisRuntime::Compile()
+{
+	if (!compiler.Compile(assembly))
+	{
+		error = compiler.GetError();
+		return false;
+	}
+
+	compiled = true;
+
+	return true;
+}
+
+bool LorisRuntime::HasError()
+{
+	return error.code != Error::NONE;
+}
+
+Error LorisRuntime::GetError()
+{
+	return error;
+}
+
+Assembly* LorisRuntime::GetAssembly()
+{
+	return assembly;
+}
+
+void LorisRuntime::Reserve(size_t count)
+{
+	if (!compiled)
+		return;
+
+	std::lock_guard<std::mutex> lock(poolMutex);
+	while (contexts.size() < count)
+		idleContexts.push_back(CreateContext());
+}
+
+VirtualMachine* LorisRuntime::AcquireContext()
+{
+	if (!compiled)
+		return nullptr;
+
+	std::lock_guard<std::mutex> lock(poolMutex);
+	if (idleContexts.empty())
+		return CreateContext();
+
+	VirtualMachine* vm = idleContexts.back();
+	idleContexts.pop_back();
+	return vm;
+}
+
+void LorisRuntime::ReleaseContext(VirtualMachine* vm)
+{
+	//dont let one caller's error or budget leak into the next
+	vm->ClearError();
+	vm->ClearArgs();
+	vm->SetBudget(0);
+	vm->SetTimeBudget(0);
+
+	std::lock_guard<std::mutex> lock(poolMutex);
+	idleContexts.push_back(vm);
+}
+
+size_t LorisRuntime::NumContexts()
+{
+	std::lock_guard<std::mutex> lock(poolMutex);
+	return contexts.size();
+}
+
+void LorisRuntime::SetWorkerCount(size_t count)
+{
+	std::lock_guard<std::mutex> lock(batchMutex);
+	if (workers.empty())
+		workerCount = count;
+}
+
+size_t LorisRuntime::GetWorkerCount()
+{
+	return workerCount;
+}
+
+bool LorisRuntime::ForEachParallel(VirtualMachine* vm, const vector<Object*>& objects, const string& name, const vector<Value>& callArgs)
+{
+	if (inBatch || objects.size() <= 1)
+		return vm->ForEach(objects, name, callArgs);
+
+	std::lock_guard<std::mutex> batchLock(batchMutex);
+
+	StartWorkers();
+	if (workers.empty())
+		return vm->ForEach(objects, name, callArgs);
+
+	ParallelBatch work(workers.size() + 1);
+	work.objects = &objects;
+	work.name = name;
+	work.args = &callArgs;
+
+	//everyone starts on their own contiguous share
+	size_t participants = work.ranges.size();
+	size_t share = (objects.size() + participants - 1) / participants;
+	for (size_t i = 0; i < participants; i++)
+	{
+		work.ranges[i].next = std::min(i * share, objects.size());
+		work.ranges[i].end = std::min((i + 1) * share, objects.size());
+	}
+
+	//the heaps are touched from several threads, so nothing can be collected
+	//objects created from here on get handed to vm afterwards
+	bool gcWasEnabled = vm->IsGCEnabled();
+	vm->SetGCEnabled(false);
+	vector<size_t> heapStarts;
+	for (auto worker : workerContexts)
+		heapStarts.push_back(worker->GetHeapSize());
+
+	{
+		std::lock_guard<std::mutex> lock(workMutex);
+		batch = &work;
+		pendingWorkers = workers.size();
+		batchId++;
+	}
+	workReady.notify_all();
+
+	//the calling thread pitches in as participant 0
+	RunBatch(&work, vm, 0);
+
+	{
+		std::unique_lock<std::mutex> lock(workMutex);
+		workDone.wait(lock, [this] { return pendingWorkers == 0; });
+		batch = nullptr;
+	}
+
+	for (size_t i = 0; i < workerContexts.size(); i++)
+		vm->AdoptHeap(workerContexts[i], heapStarts[i]);
+	vm->SetGCEnabled(gcWasEnabled);
+
+	if (work.failed)
+	{
+		vm->SetError(work.error);
+		return false;
+	}
+
+	return true;
+}
+
+//batchMutex must be held
+void LorisRuntime::StartWorkers()
+{
+	if (!workers.empty() || workerCount == 0)
+		return;
+
+	{
+		std::lock_guard<std::mutex> lock(poolMutex);
+		for (size_t i = 0; i < workerCount; i++)
+		{
+			VirtualMachine* vm = CreateContext();
+			//workers never collect, whatever they create is adopted by the caller
+			vm->SetGCEnabled(false);
+			workerContexts.push_back(vm);
+		}
+	}
+
+	for (size_t i = 0; i < workerCount; i++)
+		workers.push_back(std::thread(&LorisRuntime::WorkerLoop, this, i));
+}
+
+void LorisRuntime::WorkerLoop(size_t index)
+{
+	VirtualMachine* vm = workerContexts[index];
+	size_t lastBatch = 0;
+
+	while (true)
+	{
+		ParallelBatch* work;
+		{
+			std::unique_lock<std::mutex> lock(workMutex);
+			workReady.wait(lock, [&] { return stopping || batchId != lastBatch; });
+			if (stopping)
+				return;
+
+			lastBatch = batchId;
+			work = batch;
+		}
+
+		RunBatch(work, vm, index + 1);
+
+		{
+			std::lock_guard<std::mutex> lock(workMutex);
+			pendingWorkers--;
+			if (pendingWorkers == 0)
+				workDone.notify_one();
+		}
+	}
+}
+
+void LorisRuntime::RunBatch(ParallelBatch* work, VirtualMachine* vm, size_t participant)
+{
+	inBatch = true;
+
+	const vector<Object*>& objects = *work->objects;
+	const vector<Value>& callArgs = *work->args;
+	size_t participants = work->ranges.size();
+
+	//drain our own share first, then steal from everyone else's
+	for (size_t i = 0; i < participants; i++)
+	{
+		WorkRange& range = work->ranges[(participant + i) % participants];
+
+		while (!work->failed)
+		{
+			size_t start = range.next.fetch_add(BATCH_GRAIN);
+			if (start >= range.end)
+				break;
+
+			size_t end = std::min(start + BATCH_GRAIN, range.end);
+			for (size_t j = start; j < end; j++)
+			{
+				//script functions take their args in reverse
+				for (size_t a = callArgs.size(); a > 0; a--)
+					vm->AddArg(callArgs[a - 1]);
+
+				vm->ExecuteMemberFunction(objects[j], work->name);
+
+				if (vm->HasError())
+				{
+					std::lock_guard<std::mutex> lock(work->errorMutex);
+					if (!work->failed)
+						work->error = vm->GetError();
+					work->failed = true;
+
+					vm->ClearError();
+					break;
+				}
+			}
+		}
+	}
+
+	inBatch = false;
+}
+
+//poolMutex must be held
+VirtualMachine* LorisRuntime::CreateContext()
+{
+	//SetAssembly only reads the assembly, the class objects and
+	//static attribs the context makes as they're used belong to it
+	VirtualMachine* vm = new VirtualMachine();
+	vm->SetAssembly(assembly);
+	vm->SetRuntime(this);
+	contexts.push_back(vm);
+
+	return vm;
+}
+
+LorisRuntime::~LorisRuntime()
+{
+	{
+		std::lock_guard<std::mutex> lock(workMutex);
+		stopping = true;
+	}
+	workReady.notify_all();
+
+	for (auto& worker : workers)
+		worker.join();
+
+	for (auto vm : contexts)
+		delete vm;
+
+	delete assembly;
+}
+
+RuntimeContext::RuntimeContext(LorisRuntime& runtime)
+{
+	this->runtime = &runtime;
+	vm = runtime.AcquireContext();
+}
+
+RuntimeContext::~RuntimeContext()
+{
+	if (vm != nullptr)
+		runtime->ReleaseContext(vm);
+}
+
+VirtualMachine* RuntimeContext::Get()
+{
+	return vm;
+}
+
+VirtualMachine* RuntimeContext::operator->()
+{
+	return vm;
+}
@@ -0,0 +1,1448 @@
+/*
+
+Copyright (C) 2014-2018 Nicolas Brown
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is furnished
+to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+*/
+
+#include "../include/loris/singlepass.hpp"
+
+#include <cstdlib>
+#include <mutex>
+
+using namespace loris;
+
+SinglePassCompiler::SinglePassCompiler()
+{
+	tokens = nullptr;
+	assembly = nullptr;
+	func = nullptr;
+	sourceIndex = 0;
+}
+
+bool SinglePassCompiler::Compile(const char* code,size_t size,int sourceIndex,Assembly* assembly)
+{
+	this->assembly = assembly;
+	this->sourceIndex = sourceIndex;
+	lazySource = nullptr;
+
+	return CompileSource(code,size);
+}
+
+bool SinglePassCompiler::CompileLazy(std::shared_ptr<const SourceBuffer> source,int sourceIndex,Assembly* assembly)
+{
+	this->assembly = assembly;
+	this->sourceIndex = sourceIndex;
+
+	//bodies are compiled long after this, by then a mapped file could have been edited or truncated
+	if(source->IsMapped())
+		source = std::make_shared<SourceBuffer>(std::string(source->Data(),source->Size()));
+	lazySource = source;
+
+	bool result = CompileSource(source->Data(),source->Size());
+	lazySource = nullptr;
+
+	return result;
+}
+
+bool SinglePassCompiler::CompileBody(Function* func,Error& error)
+{
+	//functions are shared by every vm running the assembly, the first to call one compiles it
+	static std::mutex mutex;
+	std::lock_guard<std::mutex> lock(mutex);
+
+	LazyBody* body = func->lazy.load(std::memory_order_relaxed);
+	if(body==nullptr)
+		return true;
+
+	SinglePassCompiler compiler;
+	compiler.sourceIndex = func->sourceIndex;
+	compiler.func = func;
+
+	bool result = compiler.lex.Parse(body->source->Data()+body->start,body->end-body->start,body->line);
+	if(result)
+	{
+		compiler.tokens = compiler.lex.tokens;
+		compiler.ParseFunctionBody(&result);
+	}
+	else
+	{
+		compiler.error = compiler.lex.error;
+	}
+
+	if(result && compiler.callError.code!=Error::NONE)
+	{
+		compiler.error = compiler.callError;
+		result = false;
+	}
+
+	if(!result)
+	{
+		//left as it was, so the next call fails the same way
+		func->instr.clear();
+		func->strings.clear();
+		func->constants.clear();
+		func->lines.Clear();
+		error = compiler.error;
+		return false;
+	}
+
+	//the code written above is visible to any thread that sees lazy cleared
+	func->lazy.store(nullptr,std::memory_order_release);
+	delete body;
+
+	return true;
+}
+
+bool SinglePassCompiler::CompileSource(const char* code,size_t size)
+{
+	error = Error();
+	callError = Error();
+
+	if(!lex.Parse(code,size))
+	{
+		error = lex.error;
+		return false;
+	}
+
+	tokens = lex.tokens;
+
+	bool result = true;
+	bool* ok = &result;
+	while(tokens->HasMore())
+	{
+		Token tok = tokens->PeekToken();
+		switch(tok.type)
+		{
+		case Token::Import:
+			ParseImportStatement(ok);
+			break;
+		case Token::Class:
+			ParseClassDefinition(ok);
+			break;
+		case Token::Def:
+			{
+				Function* def = ParseFunctionDefinition(false,ok);
+				if(def)
+					assembly->AddFunction(def);
+			}
+			break;
+		case Token::SemiColon:
+			//empty statement
+			tokens->Advance();
+			break;
+		default:
+			ReportUnexpectTokenError(tokens->NextToken());
+			result = false;
+			break;
+		}
+
+		if(!result)
+			return false;
+	}
+
+	if(callError.code!=Error::NONE)
+	{
+		error = callError;
+		return false;
+	}
+
+	return true;
+}
+
+Error SinglePassCompiler::GetError()
+{
+	return error;
+}
+
+/* DEFINITIONS */
+
+//'class' iden ('extends' iden)? '{' (attrib|function)* '}'
+void* SinglePassCompiler::ParseClassDefinition(bool *ok)
+{
+	Consume(Token::Class,CHECK_OK);
+	Expect(Token::Iden,CHECK_OK);
+
+	Class* cls = new Class;
+	cls->sourceIndex = sourceIndex;
+	cls->name = NextText();
+
+	//the class is only added to the assembly once all of it has compiled
+	auto fail = [&]()
+	{
+		for(auto& method:cls->methods)
+			delete method.second;
+		for(auto& attrib:cls->attribs)
+			delete attrib.init;
+		delete cls;
+		return nullptr;
+	};
+
+	if(tokens->PeekTokenType() == Token::Extends)
+	{
+		tokens->Advance();
+		Expect(Token::Iden,ok);
+		if(!*ok)return fail();
+		cls->parentName = NextText();
+	}
+
+	Consume(Token::OpenCurlyBrace,ok);
+	if(!*ok)return fail();
+
+	while(tokens->HasMore() && tokens->PeekTokenType() != Token::CloseCurlyBrace)
+	{
+		bool isStatic = false;
+		if(tokens->PeekTokenType()==Token::Static)
+		{
+			isStatic = true;
+			tokens->Advance();
+		}
+
+		Function* method = nullptr;
+		switch(tokens->PeekTokenType())
+		{
+		case Token::Iden://constructor
+			method = ParseFunctionDefinition(true,ok);
+			break;
+		case Token::Def:
+			method = ParseFunctionDefinition(false,ok);
+			if(method)
+				method->isStatic = isStatic;
+			break;
+		case Token::Var:
+			ParseClassAttrib(cls,isStatic,ok);
+			break;
+		default:
+			ReportUnexpectTokenError(tokens->NextToken());
+			*ok = false;
+			break;
+		}
+
+		if(!*ok)return fail();
+
+		if(method)
+			cls->methods[method->name] = method;
+	}
+
+	Consume(Token::CloseCurlyBrace,ok);
+	if(!*ok)return fail();
+
+	assembly->AddClass(cls);
+	return nullptr;
+}
+
+//'var' iden (':' iden)? ('=' expr)? ';'
+void* SinglePassCompiler::ParseClassAttrib(Class* cls,bool isStatic,bool *ok)
+{
+	Consume(Token::Var,CHECK_OK);
+	Expect(Token::Iden,CHECK_OK);
+
+	ClassAttrib attrib = {NextText(),isStatic,nullptr};
+
+	if(tokens->PeekTokenType()==Token::Colon)
+	{
+		Consume(Token::Colon,CHECK_OK);
+		Expect(Token::Iden,CHECK_OK);
+		tokens->Advance();
+	}
+
+	if(tokens->PeekTokenType()==Token::Assign)
+	{
+		Consume(Token::Assign,CHECK_OK);
+
+		if(isStatic)
+		{
+			//the expression becomes a function returning its value
+			Function* init = new Function;
+			init->sourceIndex = sourceIndex;
+			func = init;
+			AddLine(tokens->PeekToken().line);
+
+			ExprDesc expr;
+			ParseExpr(expr,ok);
+			if(*ok)
+				Emit(OpCode::Return);
+
+			func = nullptr;
+			if(!*ok)
+			{
+				delete init;
+				return nullptr;
+			}
+
+			attrib.init = init;
+		}
+		else
+		{
+			//only static attributes get initialized
+			SkipExpr(CHECK_OK);
+		}
+	}
+
+	cls->attribs.push_back(attrib);
+
+	Consume(Token::SemiColon,CHECK_OK);
+
+	return nullptr;
+}
+
+//('def')? iden '(' (param (',' param)*)? ')' (':' iden)? '{' statement* '}'
+Function* SinglePassCompiler::ParseFunctionDefinition(bool isConstructor,bool *ok)
+{
+	//constructors have no 'def', CHECK_OK is more than one statement so this needs braces
+	if(!isConstructor)
+	{
+		Consume(Token::Def,CHECK_OK);
+	}
+
+	Expect(Token::Iden,CHECK_OK);
+	StringRef name = NextText();
+
+	Consume(Token::OpenParen,CHECK_OK);
+
+	Function* def = new Function;
+	def->name = name;
+	def->sourceIndex = sourceIndex;
+	func = def;
+
+	//param: iden (':' iden)?
+	if(tokens->PeekTokenType()==Token::Iden)
+	{
+		while(true)
+		{
+			Expect(Token::Iden,ok);
+			if(!*ok)break;
+			def->args.push_back(NextText());
+
+			if(tokens->PeekTokenType()==Token::Colon)
+			{
+				Consume(Token::Colon,ok);
+				if(!*ok)break;
+				Expect(Token::Iden,ok);
+				if(!*ok)break;
+				tokens->Advance();
+			}
+
+			if(tokens->PeekTokenType()!=Token::Comma)
+				break;
+			Consume(Token::Comma,ok);
+			if(!*ok)break;
+		}
+	}
+
+	if(*ok)Consume(Token::CloseParen,ok);
+
+	//return type
+	if(*ok && tokens->PeekTokenType()==Token::Colon)
+	{
+		Consume(Token::Colon,ok);
+		if(*ok)Expect(Token::Iden,ok);
+		if(*ok)tokens->Advance();
+	}
+
+	if(*ok)
+	{
+		if(lazySource)
+			SkipFunctionBody(ok);
+		else
+			ParseFunctionBody(ok);
+	}
+
+	func = nullptr;
+	if(!*ok)
+	{
+		delete def;
+		return nullptr;
+	}
+
+	return def;
+}
+
+//'{' statement* '}'
+void* SinglePassCompiler::ParseFunctionBody(bool *ok)
+{
+	Consume(Token::OpenCurlyBrace,CHECK_OK);
+
+	Token::Type peek = tokens->PeekTokenType();
+	while(peek != Token::CloseCurlyBrace && peek != Token::EOS)
+	{
+		ParseStatement(true,CHECK_OK);
+		peek = tokens->PeekTokenType();
+	}
+
+	Consume(Token::CloseCurlyBrace,CHECK_OK);
+
+	return nullptr;
+}
+
+//finds the end of the body and leaves it for CompileBody
+void* SinglePassCompiler::SkipFunctionBody(bool *ok)
+{
+	Expect(Token::OpenCurlyBrace,CHECK_OK);
+	Token open = tokens->NextToken();
+
+	int depth = 1;
+	while(depth>0)
+	{
+		switch(tokens->PeekTokenType())
+		{
+		case Token::OpenCurlyBrace:
+			depth++;
+			break;
+		case Token::CloseCurlyBrace:
+			depth--;
+			break;
+		case Token::EOS:
+			Consume(Token::CloseCurlyBrace,CHECK_OK);
+			break;
+		default:
+			break;
+		}
+
+		tokens->Advance();
+	}
+
+	Token close = tokens->tokens[tokens->index-1];
+
+	LazyBody* body = new LazyBody;
+	body->source = lazySource;
+	body->start = open.offset;
+	body->end = close.offset+1;//symbols have no length
+	body->line = open.line;
+	func->lazy = body;
+
+	return nullptr;
+}
+
+//imports arent used yet, they're only checked
+//import iden ('.' iden)* ('.' '*')? ';'
+void* SinglePassCompiler::ParseImportStatement(bool *ok)
+{
+	Consume(Token::Import,CHECK_OK);
+	Expect(Token::Iden,CHECK_OK);
+	tokens->Advance();
+
+	while(tokens->PeekTokenType()==Token::Dot)
+	{
+		tokens->Advance();
+
+		if(tokens->PeekTokenType()==Token::Mul)
+		{
+			tokens->Advance();
+			break;
+		}
+
+		Expect(Token::Iden,CHECK_OK);
+		tokens->Advance();
+	}
+
+	Consume(Token::SemiColon,CHECK_OK);
+
+	return nullptr;
+}
+
+/* STATEMENTS */
+
+void* SinglePassCompiler::ParseStatement(bool topLevel,bool *ok)
+{
+	Token tok = tokens->PeekToken();
+
+	//nested blocks dont get a line of their own
+	if(topLevel || tok.type!=Token::OpenCurlyBrace)
+		AddLine(tok.line);
+
+	switch(tok.type)
+	{
+	case Token::OpenCurlyBrace:
+		//blocks at the top of a function arent compiled, see Compiler::CompileFunction
+		if(topLevel)
+		{
+			SkipBlock(CHECK_OK);
+		}
+		else
+		{
+			ParseBlock(CHECK_OK);
+		}
+		break;
+	case Token::If:
+		ParseIfStatement(CHECK_OK);
+		break;
+	case Token::While:
+		ParseWhileStatement(CHECK_OK);
+		break;
+	case Token::For:
+		ParseForStatement(CHECK_OK);
+		break;
+	case Token::Return:
+		ParseReturnStatement(CHECK_OK);
+		break;
+	case Token::Yield:
+		ParseYieldStatement(CHECK_OK);
+		break;
+	default:
+		{
+			ExprDesc expr;
+			ParseExpr(expr,CHECK_OK);
+			Consume(Token::SemiColon,CHECK_OK);
+
+			//values nobody assigns are popped so they dont sit on the stack,
+			//see Compiler::CompileExpressionStatement
+			if(!topLevel && expr.kind!=ExprDesc::Assign)
+				Emit(OpCode::Pop);
+		}
+		break;
+	}
+
+	return nullptr;
+}
+
+//'{' statement* '}' or a single statement
+void* SinglePassCompiler::ParseBlock(bool *ok)
+{
+	if(tokens->PeekTokenType()==Token::OpenCurlyBrace)
+	{
+		Consume(Token::OpenCurlyBrace,CHECK_OK);
+
+		while(tokens->PeekTokenType()!=Token::CloseCurlyBrace)
+		{
+			ParseStatement(false,CHECK_OK);
+		}
+
+		Consume(Token::CloseCurlyBrace,CHECK_OK);
+	}
+	else
+	{
+		ParseStatement(false,CHECK_OK);
+	}
+
+	return nullptr;
+}
+
+void* SinglePassCompiler::SkipBlock(bool *ok)
+{
+	Function* current = func;
+	func = &skipped;
+	ParseBlock(ok);
+	func = current;
+
+	ClearSkipped();
+	return nullptr;
+}
+
+void* SinglePassCompiler::SkipExpr(bool *ok)
+{
+	Function* current = func;
+	func = &skipped;
+	ExprDesc expr;
+	ParseExpr(expr,ok);
+	func = current;
+
+	ClearSkipped();
+	return nullptr;
+}
+
+//skips can be nested, only the outermost one is done with the code
+void SinglePassCompiler::ClearSkipped()
+{
+	if(func==&skipped)
+		return;
+
+	skipped.instr.clear();
+	skipped.strings.clear();
+	skipped.constants.clear();
+	skipped.lines.Clear();
+}
+
+//see Compiler::CompileIfStatement for the layout
+void* SinglePassCompiler::ParseIfStatement(bool *ok)
+{
+	Consume(Token::If,CHECK_OK);
+	Consume(Token::OpenParen,CHECK_OK);
+
+	vector<int> blockEndJumps;
+	ParseConditionalJump(false,blockEndJumps,CHECK_OK);
+
+	Consume(Token::CloseParen,CHECK_OK);
+
+	ParseBlock(CHECK_OK);
+
+	int endChainIndex = Emit(OpCode::Jump);
+
+	PatchJumps(blockEndJumps);
+	Emit(OpCode::Nop);
+
+	if(tokens->PeekTokenType()==Token::Else)
+	{
+		tokens->Advance();
+		ParseStatement(false,CHECK_OK);
+	}
+
+	func->instr[endChainIndex].val = Emit(OpCode::Nop);
+
+	return nullptr;
+}
+
+/*
+the condition goes after the block, see Compiler::CompileWhileStatement.
+it is only checked on the way in, then compiled once the block is done
+so its strings and constants come after the block's like they would with an ast
+*/
+void* SinglePassCompiler::ParseWhileStatement(bool *ok)
+{
+	int line = tokens->PeekToken().line;
+
+	Consume(Token::While,CHECK_OK);
+	Consume(Token::OpenParen,CHECK_OK);
+
+	unsigned int conditionStart = tokens->index;
+	SkipExpr(CHECK_OK);
+
+	Consume(Token::CloseParen,CHECK_OK);
+
+	int jumpOpIndex = Emit(OpCode::Jump);
+
+	int blockIndex = func->instr.size();
+	ParseBlock(CHECK_OK);
+	unsigned int blockEnd = tokens->index;
+
+	func->instr[jumpOpIndex].val = func->instr.size();
+	AddLine(line);
+
+	tokens->index = conditionStart;
+	vector<int> loopJumps;
+	ParseConditionalJump(true,loopJumps,CHECK_OK);
+	tokens->index = blockEnd;
+
+	for(size_t i=0;i<loopJumps.size();i++)
+		func->instr[loopJumps[i]].val = blockIndex;
+
+	Emit(OpCode::Nop);
+
+	return nullptr;
+}
+
+//'for' '(' 'var'? iden 'in' expr ('..' expr)? ')' block
+//see Compiler::CompileForStatement for the layout
+void* SinglePassCompiler::ParseForStatement(bool *ok)
+{
+	int line = tokens->PeekToken().line;
+
+	Consume(Token::For,CHECK_OK);
+	Consume(Token::OpenParen,CHECK_OK);
+
+	if(tokens->PeekTokenType()==Token::Var)
+		tokens->Advance();
+
+	Expect(Token::Iden,CHECK_OK);
+	StringRef name = NextText();
+
+	Consume(Token::In,CHECK_OK);
+
+	ExprDesc expr;
+	ParseExpr(expr,CHECK_OK);
+
+	OpCode prep = OpCode::ForIterPrep;
+	if(tokens->PeekTokenType()==Token::Range)
+	{
+		tokens->Advance();
+		ParseExpr(expr,CHECK_OK);
+		prep = OpCode::ForPrep;
+	}
+
+	Consume(Token::CloseParen,CHECK_OK);
+
+	Emit(prep,AddString(name));
+
+	int jumpOpIndex = Emit(OpCode::Jump);
+
+	int blockIndex = func->instr.size();
+	ParseBlock(CHECK_OK);
+
+	func->instr[jumpOpIndex].val = func->instr.size();
+	AddLine(line);
+	Emit(OpCode::ForLoop,blockIndex);
+
+	return nullptr;
+}
+
+//return f(x); and return obj.f(x); become tail calls
+void* SinglePassCompiler::ParseReturnStatement(bool *ok)
+{
+	Consume(Token::Return,CHECK_OK);
+
+	ExprDesc expr;
+	ParseExpr(expr,CHECK_OK);
+
+	Consume(Token::SemiColon,CHECK_OK);
+
+	if(expr.kind==ExprDesc::Call)
+	{
+		DSInstr& call = func->instr.back();
+		call.op = call.op==OpCode::CallFunction?OpCode::TailCall:OpCode::TailCallMethod;
+	}
+	else
+	{
+		Emit(OpCode::Return);
+	}
+
+	return nullptr;
+}
+
+//yield expr; or yield;
+void* SinglePassCompiler::ParseYieldStatement(bool *ok)
+{
+	Consume(Token::Yield,CHECK_OK);
+
+	if(tokens->PeekTokenType()!=Token::SemiColon)
+	{
+		ExprDesc expr;
+		ParseExpr(expr,CHECK_OK);
+	}
+	else
+	{
+		Emit(OpCode::LoadNull);
+	}
+
+	Consume(Token::SemiColon,CHECK_OK);
+
+	Emit(OpCode::Yield);
+
+	return nullptr;
+}
+
+/* EXPRESSIONS */
+
+/*
+the target of an assignment is compiled after the value, but it comes first in the source.
+it gets compiled as a value first to find out what it is, then that code is thrown away,
+the value is compiled and the target is compiled again with its last load turned into a store
+*/
+void* SinglePassCompiler::ParseExpr(ExprDesc& expr,bool *ok)
+{
+	Mark start = GetMark();
+
+	ParseBinaryExpr(4,expr,CHECK_OK);
+	if(tokens->PeekTokenType()!=Token::Assign)
+		return nullptr;
+
+	ExprDesc target = expr;
+	unsigned int assign = tokens->index;
+	Rewind(start);
+	tokens->index = assign+1;// =
+
+	ExprDesc value;
+	ParseBinaryExpr(4,value,CHECK_OK);
+	unsigned int end = tokens->index;
+
+	expr = ExprDesc();
+	expr.kind = ExprDesc::Assign;
+
+	switch(target.kind)
+	{
+	case ExprDesc::Iden:
+		//i = i + 1 and i = i - 1 update the local in place
+		if(value.kind==ExprDesc::LocalPlusConstant && value.name==target.name)
+			func->instr[func->instr.size()-2].op = OpCode::IncrementLocal;
+		else
+			Emit(OpCode::StoreLocal,AddString(target.name));
+		break;
+	case ExprDesc::Var:
+		Emit(OpCode::StoreLocal,AddString(target.name));
+		break;
+	case ExprDesc::PropAccess:
+	case ExprDesc::IndexAccess:
+		{
+			tokens->index = start.token;
+			ExprDesc again;
+			ParseBinaryExpr(4,again,CHECK_OK);
+			tokens->index = end;
+
+			DSInstr& load = func->instr.back();
+			load.op = load.op==OpCode::LoadProp?OpCode::StoreProp:OpCode::StoreIndex;
+		}
+		break;
+	default:
+		//assigning to a call or a literal does nothing, not even the value gets evaluated
+		Rewind(start);
+		tokens->index = end;
+		break;
+	}
+
+	return nullptr;
+}
+
+//http://eli.thegreenplace.net/2012/08/02/parsing-expressions-by-precedence-climbing/
+void* SinglePassCompiler::ParseBinaryExpr(int minPrec,ExprDesc& expr,bool *ok)
+{
+	ParsePrimary(expr,CHECK_OK);
+
+	while(true)
+	{
+		Op op = Parser::GetOp(tokens->PeekTokenType());
+		if(op.prec < minPrec)
+			break;
+
+		tokens->Advance();
+
+		int nextMinPrec = op.assoc==Op::LeftAssoc?op.prec+1:op.prec;
+
+		//the right side is only evaluated if the left doesnt decide the result
+		if(op.type==Token::And || op.type==Token::Or)
+		{
+			int jumpIndex = Emit(op.type==Token::And?OpCode::JumpIfFalseOrPop:OpCode::JumpIfTrueOrPop);
+
+			ExprDesc rhs;
+			ParseBinaryExpr(nextMinPrec,rhs,CHECK_OK);
+
+			func->instr[jumpIndex].val = func->instr.size();
+			expr = ExprDesc();
+			continue;
+		}
+
+		ExprDesc rhs;
+		ParseBinaryExpr(nextMinPrec,rhs,CHECK_OK);
+
+		OpCode code = OpCode::Nop;
+		switch(op.type)
+		{
+		case Token::Add:
+		case Token::Sub:
+			{
+				//local + number and number + local are done in one instruction,
+				//the loads that were just emitted get replaced
+				bool localFirst = expr.kind==ExprDesc::Iden && rhs.kind==ExprDesc::Number;
+				bool numberFirst = op.type==Token::Add && expr.kind==ExprDesc::Number && rhs.kind==ExprDesc::Iden;
+				if(localFirst || numberFirst)
+				{
+					StringRef local = localFirst?expr.name:rhs.name;
+					double amount = localFirst?rhs.number:expr.number;
+					if(op.type==Token::Sub)
+						amount = -amount;
+
+					func->instr.resize(func->instr.size()-2);
+					func->strings.pop_back();
+					func->constants.pop_back();
+					EmitLocalConstantOp(OpCode::LoadLocalAddConstant,local,amount);
+
+					expr = ExprDesc();
+					expr.kind = ExprDesc::LocalPlusConstant;
+					expr.name = local;
+					continue;
+				}
+			}
+			code = op.type==Token::Add?OpCode::Add:OpCode::Sub;
+			break;
+		case Token::Mul:
+			code = OpCode::Mul;
+			break;
+		case Token::Div:
+			code = OpCode::Div;
+			break;
+		case Token::GT:
+			code = OpCode::IsGreaterThan;
+			break;
+		case Token::LT:
+			code = OpCode::IsLessThan;
+			break;
+		case Token::GTE:
+			code = OpCode::IsGreaterThanOrEqual;
+			break;
+		case Token::LTE:
+			code = OpCode::IsLessThanOrEqual;
+			break;
+		case Token::EQ:
+			code = OpCode::IsEqual;
+			break;
+		case Token::NEQ:
+			code = OpCode::IsNotEqual;
+			break;
+		default:
+			break;
+		}
+
+		expr = ExprDesc();
+		if(code!=OpCode::Nop)
+		{
+			Emit(code);
+			if(code>=OpCode::IsEqual && code<=OpCode::IsNotEqual)
+				expr.kind = ExprDesc::Compare;
+		}
+	}
+
+	return nullptr;
+}
+
+void* SinglePassCompiler::ParsePrimary(ExprDesc& expr,bool *ok)
+{
+	Token token = tokens->PeekToken();
+
+	expr = ExprDesc();
+	switch(token.type)
+	{
+	case Token::String:
+		{
+			StringRef text = NextText();
+			Emit(OpCode::LoadConstant,AddConstant(Value::CreateString(text.Data(),text.size())));
+		}
+		break;
+	case Token::Float:
+	case Token::Integer:
+		expr.kind = ExprDesc::Number;
+		expr.number = Token::ToNumber(tokens->GetText(token));
+		Emit(OpCode::LoadConstant,AddConstant(Value::CreateNumber(expr.number)));
+		tokens->Advance();
+		break;
+	case Token::Sub:
+		{
+			//the whole expression after the - gets negated, not just the primary
+			tokens->Advance();
+			ExprDesc child;
+			ParseExpr(child,CHECK_OK);
+			Emit(OpCode::Neg);
+		}
+		break;
+	case Token::Not:
+		{
+			//binds to the primary so !a && b is (!a) && b
+			tokens->Advance();
+			ExprDesc child;
+			ParsePrimary(child,CHECK_OK);
+			Emit(OpCode::Not);
+		}
+		break;
+	case Token::Null:
+		Emit(OpCode::LoadNull);
+		tokens->Advance();
+		break;
+	case Token::True:
+		Emit(OpCode::LoadBool,1);
+		tokens->Advance();
+		break;
+	case Token::False:
+		Emit(OpCode::LoadBool,0);
+		tokens->Advance();
+		break;
+	case Token::Iden:
+		expr.kind = ExprDesc::Iden;
+		expr.name = NextText();
+		Emit(OpCode::LoadLocal,AddString(expr.name));
+		ParseMemberExprSuffix(expr,CHECK_OK);
+		break;
+	case Token::Var:
+		ParseVarExpr(expr,CHECK_OK);
+		break;
+	case Token::New:
+		ParseNewExpr(expr,CHECK_OK);
+		break;
+	case Token::OpenCurlyBrace:
+		ParseMapLiteral(expr,CHECK_OK);
+		break;
+	case Token::OpenParen:
+		tokens->Advance();
+		ParseExpr(expr,CHECK_OK);
+		Consume(Token::CloseParen,CHECK_OK);
+		break;
+	default:
+		*ok=false;
+		ReportUnexpectTokenError(token);
+		break;
+	}
+
+	return nullptr;
+}
+
+//'var' iden (':' iden)?, only emits anything when assigned to
+void* SinglePassCompiler::ParseVarExpr(ExprDesc& expr,bool *ok)
+{
+	Consume(Token::Var,CHECK_OK);
+	Expect(Token::Iden,CHECK_OK);
+
+	expr.kind = ExprDesc::Var;
+	expr.name = NextText();
+
+	if(tokens->PeekTokenType()==Token::Colon)
+	{
+		Consume(Token::Colon,CHECK_OK);
+		Expect(Token::Iden,CHECK_OK);
+		tokens->Advance();
+	}
+
+	return nullptr;
+}
+
+//'new' iden '(' args ')'
+void* SinglePassCompiler::ParseNewExpr(ExprDesc& expr,bool *ok)
+{
+	tokens->Advance();// new
+
+	Expect(Token::Iden,CHECK_OK);
+	StringRef name = NextText();
+
+	tokens->Advance();// (
+
+	int count;
+	ParseArgs(&count,CHECK_OK);
+
+	Consume(Token::CloseParen,CHECK_OK);
+
+	for(int i=0;i<count;i++)
+		Emit(OpCode::AddArg);
+	Emit(OpCode::CreateInstance,AddString(name));
+
+	return ParseMemberExprSuffix(expr,ok);
+}
+
+//'{' (expr ':' expr (',' expr ':' expr)*)? '}'
+void* SinglePassCompiler::ParseMapLiteral(ExprDesc& expr,bool *ok)
+{
+	Consume(Token::OpenCurlyBrace,CHECK_OK);
+
+	int count = 0;
+	if(tokens->PeekTokenType()!=Token::CloseCurlyBrace)
+	{
+		while(true)
+		{
+			ExprDesc item;
+			ParseExpr(item,CHECK_OK);
+			Consume(Token::Colon,CHECK_OK);
+			ParseExpr(item,CHECK_OK);
+			count++;
+
+			if(tokens->PeekTokenType()!=Token::Comma)
+				break;
+			Consume(Token::Comma,CHECK_OK);
+
+			//allow a trailing comma
+			if(tokens->PeekTokenType()==Token::CloseCurlyBrace)
+				break;
+		}
+	}
+
+	Consume(Token::CloseCurlyBrace,CHECK_OK);
+
+	Emit(OpCode::CreateMap,count);
+
+	return ParseMemberExprSuffix(expr,ok);
+}
+
+//( '.' iden | '[' expr ']' | '(' args ')' )*
+void* SinglePassCompiler::ParseMemberExprSuffix(ExprDesc& expr,bool *ok)
+{
+	while(true)
+	{
+		Token token = tokens->PeekToken();
+		switch(token.type)
+		{
+		case Token::OpenBracket:
+			{
+				tokens->Advance();
+
+				ExprDesc index;
+				ParseExpr(index,CHECK_OK);
+				Emit(OpCode::LoadIndex);
+
+				Consume(Token::CloseBracket,CHECK_OK);
+
+				expr = ExprDesc();
+				expr.kind = ExprDesc::IndexAccess;
+			}
+			break;
+		case Token::Dot:
+			tokens->Advance();
+			Expect(Token::Iden,CHECK_OK);
+
+			expr = ExprDesc();
+			expr.kind = ExprDesc::PropAccess;
+			expr.name = NextText();
+			Emit(OpCode::LoadProp,AddString(expr.name));
+			break;
+		case Token::OpenParen:
+			{
+				//functions arent values, so the load of the function or method gets taken back
+				//and the call is made by name
+				bool callable = expr.kind==ExprDesc::Iden || expr.kind==ExprDesc::PropAccess;
+				OpCode call = expr.kind==ExprDesc::Iden?OpCode::CallFunction:OpCode::CallMethod;
+				StringRef name = expr.name;
+				if(callable)
+				{
+					func->instr.pop_back();
+					func->strings.pop_back();
+				}
+
+				tokens->Advance();
+
+				//args are pushed after the object is evaluated in case of chaining,
+				//the args list is cleared by every call
+				int count;
+				ParseArgs(&count,CHECK_OK);
+
+				Consume(Token::CloseParen,CHECK_OK);
+
+				//kept until the whole source parses, syntax errors come first like they do with the parser
+				if(!callable)
+				{
+					if(callError.code==Error::NONE)
+					{
+						callError = Error::InvalidOperation("only functions and methods can be called");
+						callError.line = token.line;
+					}
+
+					expr = ExprDesc();
+					break;
+				}
+
+				for(int i=0;i<count;i++)
+					Emit(OpCode::AddArg);
+				Emit(call,AddString(name));
+
+				expr = ExprDesc();
+				expr.kind = ExprDesc::Call;
+			}
+			break;
+		default:
+			return nullptr;
+		}
+	}
+}
+
+//compiles every argument, AddArgs come after all of them are evaluated
+void* SinglePassCompiler::ParseArgs(int* count,bool *ok)
+{
+	*count = 0;
+
+	if(tokens->PeekTokenType()!=Token::CloseParen)
+	{
+		ExprDesc arg;
+		ParseExpr(arg,CHECK_OK);
+		(*count)++;
+
+		while(tokens->PeekTokenType()==Token::Comma)
+		{
+			Consume(Token::Comma,CHECK_OK);
+
+			ParseExpr(arg,CHECK_OK);
+			(*count)++;
+		}
+	}
+
+	return nullptr;
+}
+
+/* CONDITIONS */
+
+/*
+&&, || and ! are compiled into jumps the way Compiler::CompileConditionalJump does it.
+a part of the condition that turns out to be a value after all, like (a || b) + 1,
+is rewound and compiled again as a value
+*/
+void* SinglePassCompiler::ParseConditionalJump(bool jumpIfTrue,vector<int>& jumps,bool *ok)
+{
+	Mark start = GetMark();
+
+	CondDesc cond;
+	ParseOrCondition(cond,CHECK_OK);
+
+	//an assignment is just a value that gets tested
+	if(tokens->PeekTokenType()==Token::Assign)
+	{
+		Rewind(start);
+
+		ExprDesc expr;
+		ParseExpr(expr,CHECK_OK);
+
+		jumps.push_back(Emit(jumpIfTrue?OpCode::JumpIfTrue:OpCode::JumpIfFalse));
+		return nullptr;
+	}
+
+	EmitConditionJump(cond,jumpIfTrue);
+
+	vector<int>& taken = jumpIfTrue?cond.trueJumps:cond.falseJumps;
+	jumps.insert(jumps.end(),taken.begin(),taken.end());
+	PatchJumps(jumpIfTrue?cond.falseJumps:cond.trueJumps);
+
+	return nullptr;
+}
+
+//part ('||' part)*
+void* SinglePassCompiler::ParseOrCondition(CondDesc& cond,bool *ok)
+{
+	ParseAndCondition(cond,CHECK_OK);
+
+	while(tokens->PeekTokenType()==Token::Or)
+	{
+		tokens->Advance();
+
+		//the left side being true decides it, false moves on to the right side
+		EmitConditionJump(cond,true);
+		PatchJumps(cond.falseJumps);
+
+		CondDesc right;
+		ParseAndCondition(right,CHECK_OK);
+		right.trueJumps.insert(right.trueJumps.begin(),cond.trueJumps.begin(),cond.trueJumps.end());
+		cond = std::move(right);
+	}
+
+	return nullptr;
+}
+
+//part ('&&' part)*
+void* SinglePassCompiler::ParseAndCondition(CondDesc& cond,bool *ok)
+{
+	ParseConditionPart(cond,CHECK_OK);
+
+	while(tokens->PeekTokenType()==Token::And)
+	{
+		tokens->Advance();
+
+		EmitConditionJump(cond,false);
+		PatchJumps(cond.trueJumps);
+
+		CondDesc right;
+		ParseConditionPart(right,CHECK_OK);
+		right.falseJumps.insert(right.falseJumps.begin(),cond.falseJumps.begin(),cond.falseJumps.end());
+		cond = std::move(right);
+	}
+
+	return nullptr;
+}
+
+//anything that binds tighter than &&
+void* SinglePassCompiler::ParseConditionPart(CondDesc& cond,bool *ok)
+{
+	Token::Type type = tokens->PeekTokenType();
+	if(type==Token::Not || type==Token::OpenParen)
+	{
+		Mark start = GetMark();
+		ParseConditionPrimary(cond,CHECK_OK);
+
+		//!a < b and (a || b) == c compare the value instead
+		if(Parser::GetOp(tokens->PeekTokenType()).prec <= Parser::GetOp(Token::And).prec)
+			return nullptr;
+
+		Rewind(start);
+	}
+
+	ExprDesc expr;
+	ParseBinaryExpr(Parser::GetOp(Token::And).prec+1,expr,CHECK_OK);
+
+	cond = CondDesc();
+	cond.compare = expr.kind==ExprDesc::Compare;
+
+	return nullptr;
+}
+
+//'!' primary, '(' condition ')' or any other primary
+void* SinglePassCompiler::ParseConditionPrimary(CondDesc& cond,bool *ok)
+{
+	switch(tokens->PeekTokenType())
+	{
+	case Token::Not:
+		tokens->Advance();
+		ParseConditionPrimary(cond,CHECK_OK);
+
+		std::swap(cond.trueJumps,cond.falseJumps);
+		cond.negated = !cond.negated;
+		return nullptr;
+	case Token::OpenParen:
+		{
+			Mark start = GetMark();
+			tokens->Advance();
+			ParseOrCondition(cond,CHECK_OK);
+
+			if(tokens->PeekTokenType()!=Token::Assign)
+			{
+				Consume(Token::CloseParen,CHECK_OK);
+				return nullptr;
+			}
+
+			Rewind(start);
+		}
+		break;
+	default:
+		break;
+	}
+
+	ExprDesc expr;
+	ParsePrimary(expr,CHECK_OK);
+
+	cond = CondDesc();
+	cond.compare = expr.kind==ExprDesc::Compare;
+
+	return nullptr;
+}
+
+void SinglePassCompiler::EmitConditionJump(CondDesc& cond,bool whenTrue)
+{
+	bool jumpIfTrue = cond.negated?!whenTrue:whenTrue;
+	int index;
+
+	if(cond.compare)
+	{
+		//comparisons jump directly instead of pushing a bool
+		DSInstr& last = func->instr.back();
+		switch(last.op)
+		{
+		case OpCode::IsEqual:
+			last.op = jumpIfTrue?OpCode::JumpIfEqual:OpCode::JumpIfNotEqual;
+			break;
+		case OpCode::IsNotEqual:
+			last.op = jumpIfTrue?OpCode::JumpIfNotEqual:OpCode::JumpIfEqual;
+			break;
+		case OpCode::IsLessThan:
+			last.op = jumpIfTrue?OpCode::JumpIfLessThan:OpCode::JumpIfNotLessThan;
+			break;
+		case OpCode::IsLessThanOrEqual:
+			last.op = jumpIfTrue?OpCode::JumpIfLessThanOrEqual:OpCode::JumpIfNotLessThanOrEqual;
+			break;
+		case OpCode::IsGreaterThan:
+			last.op = jumpIfTrue?OpCode::JumpIfGreaterThan:OpCode::JumpIfNotGreaterThan;
+			break;
+		case OpCode::IsGreaterThanOrEqual:
+			last.op = jumpIfTrue?OpCode::JumpIfGreaterThanOrEqual:OpCode::JumpIfNotGreaterThanOrEqual;
+			break;
+		default:
+			break;
+		}
+		index = func->instr.size()-1;
+	}
+	else
+	{
+		index = Emit(jumpIfTrue?OpCode::JumpIfTrue:OpCode::JumpIfFalse);
+	}
+
+	(whenTrue?cond.trueJumps:cond.falseJumps).push_back(index);
+	cond.compare = false;
+}
+
+/* HELPERS */
+
+int SinglePassCompiler::Emit(OpCode op,int val)
+{
+	DSInstr instr;
+	instr.op = op;
+	instr.val = val;
+	func->instr.push_back(instr);
+
+	return func->instr.size()-1;
+}
+
+int SinglePassCompiler::AddString(StringRef str)
+{
+	func->strings.push_back(str);
+	return func->strings.size()-1;
+}
+
+int SinglePassCompiler::AddConstant(Value val)
+{
+	func->constants.push_back(std::move(val));
+	return func->constants.size()-1;
+}
+
+//op followed by an Operand holding the index of amount in the constants table
+void SinglePassCompiler::EmitLocalConstantOp(OpCode op,StringRef local,double amount)
+{
+	Emit(op,AddString(local));
+	Emit(OpCode::Operand,AddConstant(Value::CreateNumber(amount)));
+}
+
+//points all the jumps to the next instruction
+void SinglePassCompiler::PatchJumps(vector<int>& jumps)
+{
+	for(size_t i=0;i<jumps.size();i++)
+		func->instr[jumps[i]].val = func->instr.size();
+
+	jumps.clear();
+}
+
+void SinglePassCompiler::AddLine(int line)
+{
+	func->lines.Add(func->instr.size(),line);
+}
+
+SinglePassCompiler::Mark SinglePassCompiler::GetMark()
+{
+	Mark mark;
+	mark.token = tokens->index;
+	mark.instr = func->instr.size();
+	mark.strings = func->strings.size();
+	mark.constants = func->constants.size();
+
+	return mark;
+}
+
+//expressions never add lines, so only the code has to be taken back
+void SinglePassCompiler::Rewind(const Mark& mark)
+{
+	tokens->index = mark.token;
+	func->instr.resize(mark.instr);
+	func->strings.resize(mark.strings);
+	func->constants.resize(mark.constants);
+}
+
+//same errors as the Parser
+void SinglePassCompiler::Expect(Token::Type type,bool *ok)
+{
+	Token peek = tokens->PeekToken();
+	if(peek.type==type)
+	{
+		*ok=true;
+		return;
+	}
+
+	*ok=false;
+	error = Error();
+	error.line = peek.line;
+	error.message = "Unexpected token '";
+	error.message+=Token::GetTokenName(peek.type);
+	error.message+="'. Expected '";
+	error.message+=Token::GetTokenName(type);
+	error.message+="'";
+}
+
+void SinglePassCompiler::Consume(Token::Type type,bool *ok)
+{
+	Token tok = tokens->NextToken();
+	if(tok.type==type)
+	{
+		*ok=true;
+		return;
+	}
+
+	*ok=false;
+	error = Error();
+	error.line = tok.line;
+	error.message = "unexpected token ";
+	error.message+=Token::GetTokenName(tok.type);
+	error.message+=". expected ";
+	error.message+=Token::GetTokenName(type);
+}
+
+void SinglePassCompiler::ReportUnexpectTokenError(Token token)
+{
+	error = Error();
+	error.line = token.line;
+	error.message = "unexpected token '";
+	error.message+=Token::GetTokenName(token.type);
+	error.message+= "'";
+}
+
+StringRef SinglePassCompiler::NextText()
+{
+	return tokens->GetText(tokens->NextToken());
+}
@@ -0,0 +1,1145 @@
+/*
+
+Copyright (C) 2014-2018 Nicolas Brown
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is furnished
+to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+*/
+
+#include "../include/loris/snapshot.hpp"
+#include "../include/loris/singlepass.hpp"
+#include "../include/loris/sourcefile.hpp"
+
+#include <cstring>
+
+using namespace loris;
+
+static const char MAGIC[8] = {'L','O','R','I','S','S','N','P'};
+static const char SOURCE_MAGIC[8] = {'L','O','R','I','S','S','R','C'};
+
+//bump whenever the layout below changes, changes to what it saves are caught by GetFingerprint
+static const unsigned int VERSION = 1;
+
+//how a function is found again when the snapshot is read
+enum FunctionKind
+{
+	SCRIPT_FUNCTION,//saved in full
+	NATIVE_FUNCTION,//looked up in the assembly by name
+	NATIVE_METHOD,//looked up in a native class by name
+	NATIVE_DESTRUCTOR
+};
+
+enum ObjectKind
+{
+	PLAIN_OBJECT,
+	ARRAY_OBJECT,
+	MAP_OBJECT,
+	CLASS_OBJECT
+};
+
+//classes with native code are the host's, only their names are saved
+static bool IsNativeClass(Class* cls)
+{
+	if(cls->destructor!=nullptr && cls->destructor->isNative)
+		return true;
+
+	for(auto& method:cls->methods)
+		if(method.second->isNative)
+			return true;
+
+	return false;
+}
+
+Snapshot::Snapshot()
+{
+	in = nullptr;
+	size = 0;
+	pos = 0;
+	sourceIndex = -1;
+	host = nullptr;
+}
+
+bool Snapshot::Fail(const string& message)
+{
+	if(error.code==Error::NONE)
+		error = Error::InvalidOperation(message);
+
+	return false;
+}
+
+/* WRITING */
+
+bool Snapshot::Write(VirtualMachine* vm,const string& filename,Error& error)
+{
+	Snapshot snapshot;
+	Assembly* assembly = vm->GetAssembly();
+
+	if(assembly==nullptr)
+		snapshot.Fail("nothing to save, the scripts havent been compiled");
+	else if(!vm->frames.empty())
+		snapshot.Fail("cant save a snapshot while a script is running");
+
+	if(snapshot.error.code==Error::NONE)
+	{
+		snapshot.WriteHeader(MAGIC);
+
+		if(snapshot.WriteAssembly(assembly,-1) && snapshot.WriteHeap(vm))
+		{
+			if(!WriteFileAtomic(filename,snapshot.out))
+			{
+				snapshot.error.code = Error::FILE_ERROR;
+				snapshot.error.message = "cant write "+filename;
+				snapshot.error.filename = filename;
+			}
+		}
+	}
+
+	error = snapshot.error;
+	return error.code==Error::NONE;
+}
+
+bool Snapshot::WriteSource(Assembly* assembly,int sourceIndex,const string& filename)
+{
+	Snapshot snapshot;
+	snapshot.WriteHeader(SOURCE_MAGIC);
+
+	return snapshot.WriteAssembly(assembly,sourceIndex) && WriteFileAtomic(filename,snapshot.out);
+}
+
+unsigned long long Snapshot::GetFingerprint()
+{
+	static const unsigned long long fingerprint = []()
+	{
+		unsigned long long hash = 14695981039346656037ull;
+		Hash(hash,&VERSION,sizeof(VERSION));
+
+		//renumbering or adding an opcode changes the names in order
+		for(int i=0;i<NUM_OPCODES;i++)
+		{
+			const char* name = GetOpCodeName((OpCode)i);
+			Hash(hash,name,strlen(name)+1);
+		}
+
+		size_t sizes[] = {sizeof(void*),sizeof(DSInstr),sizeof(Value),sizeof(Function),sizeof(Object)};
+		Hash(hash,sizes,sizeof(sizes));
+		return hash;
+	}();
+
+	return fingerprint;
+}
+
+//fnv-1a
+void Snapshot::Hash(unsigned long long& hash,const void* data,size_t size)
+{
+	const unsigned char* bytes = (const unsigned char*)data;
+	for(size_t i=0;i<size;i++)
+	{
+		hash ^= bytes[i];
+		hash *= 1099511628211ull;
+	}
+}
+
+void Snapshot::WriteHeader(const char* magic)
+{
+	unsigned long long fingerprint = GetFingerprint();
+
+	out.append(magic,sizeof(MAGIC));
+	WriteInt(VERSION);
+	WriteInt((unsigned int)fingerprint);
+	WriteInt((unsigned int)(fingerprint>>32));
+}
+
+bool Snapshot::WriteAssembly(Assembly* assembly,int source)
+{
+	//natives have no source of their own
+	auto isSaved = [source](Function* func)
+	{
+		return source<0 || (!func->isNative && func->sourceIndex==source);
+	};
+	auto isClassSaved = [source](Class* cls)
+	{
+		return source<0 || (!IsNativeClass(cls) && cls->sourceIndex==source);
+	};
+
+	//every function gets an id first, objects and classes refer to them by it
+	for(auto& func:assembly->functions)
+		if(isSaved(func.second) && !AddFunction(func.second))
+			return false;
+
+	for(auto& cls:assembly->classes)
+	{
+		if(!isClassSaved(cls.second))
+			continue;
+
+		for(auto& method:cls.second->methods)
+			if(!AddFunction(method.second))
+				return false;
+
+		for(auto& attrib:cls.second->attribs)
+			if(attrib.init!=nullptr && !AddFunction(attrib.init))
+				return false;
+
+		if(cls.second->destructor!=nullptr && !AddFunction(cls.second->destructor))
+			return false;
+	}
+
+	//a single source's names come from the compiler
+	if(source<0)
+	{
+		WriteInt(assembly->sourceNames.size());
+		for(auto& name:assembly->sourceNames)
+			WriteString(name);
+	}
+	else
+	{
+		WriteInt(0);
+	}
+
+	//natives are written as where to find them, so that has to be worked out
+	//from the assembly rather than the function
+	unordered_map<Function*,std::pair<FunctionKind,string>> natives;
+	for(auto& func:assembly->functions)
+		if(func.second->isNative)
+			natives[func.second] = {NATIVE_FUNCTION,func.first};
+
+	for(auto& cls:assembly->classes)
+	{
+		for(auto& method:cls.second->methods)
+			if(method.second->isNative)
+				natives[method.second] = {NATIVE_METHOD,cls.first+"."+method.first};
+
+		Function* destructor = cls.second->destructor;
+		if(destructor!=nullptr && destructor->isNative)
+			natives[destructor] = {NATIVE_DESTRUCTOR,cls.first};
+	}
+
+	WriteInt(functions.size());
+	for(auto func:functions)
+	{
+		if(func->isNative)
+		{
+			auto native = natives[func];
+			WriteInt(native.first);
+			WriteString(native.second);
+		}
+		else
+		{
+			WriteInt(SCRIPT_FUNCTION);
+			WriteFunction(func);
+		}
+	}
+
+	vector<std::pair<string,Function*>> savedFunctions;
+	for(auto& func:assembly->functions)
+		if(isSaved(func.second))
+			savedFunctions.push_back(func);
+
+	WriteInt(savedFunctions.size());
+	for(auto& func:savedFunctions)
+	{
+		WriteString(func.first);
+		WriteFunctionRef(func.second);
+	}
+
+	vector<Class*> savedClasses;
+	for(auto& cls:assembly->classes)
+		if(isClassSaved(cls.second))
+			savedClasses.push_back(cls.second);
+
+	WriteInt(savedClasses.size());
+	for(auto cls:savedClasses)
+		WriteClass(cls);
+
+	return true;
+}
+
+bool Snapshot::AddFunction(Function* func)
+{
+	if(functionIds.find(func)!=functionIds.end())
+		return true;
+
+	if(!func->isNative)
+	{
+		Error compileError;
+		if(!SinglePassCompiler::CompileBody(func,compileError))
+			return Fail("function "+func->name+" doesnt compile: "+compileError.message);
+	}
+
+	functionIds[func] = functions.size();
+	functions.push_back(func);
+	return true;
+}
+
+//-1 for none
+void Snapshot::WriteFunctionRef(Function* func)
+{
+	WriteInt(func==nullptr?~0u:functionIds[func]);
+}
+
+void Snapshot::WriteFunction(Function* func)
+{
+	WriteString(func->name);
+	WriteInt(func->isStatic);
+	WriteInt(func->sourceIndex);
+
+	WriteInt(func->args.size());
+	for(auto& arg:func->args)
+		WriteString(arg);
+
+	WriteInt(func->strings.size());
+	for(auto& str:func->strings)
+		WriteString(str);
+
+	WriteInt(func->constants.size());
+	for(auto& constant:func->constants)
+		WriteValue(constant);
+
+	WriteInt(func->instr.size());
+	out.append((const char*)func->instr.data(),func->instr.size()*sizeof(DSInstr));
+
+	//the line table is saved as it is
+	LineTable& lines = func->lines;
+	WriteInt(lines.data.size());
+	out.append((const char*)lines.data.data(),lines.data.size());
+	WriteInt(lines.lastOffset);
+	WriteInt(lines.lastPc);
+	WriteInt(lines.lastLine);
+	WriteInt(lines.prevPc);
+	WriteInt(lines.prevLine);
+}
+
+void Snapshot::WriteClass(Class* cls)
+{
+	bool native = IsNativeClass(cls);
+	WriteInt(native);
+	WriteString(cls->name);
+	if(native)
+		return;
+
+	WriteString(cls->parentName);
+	WriteInt(cls->sourceIndex);
+
+	WriteInt(cls->attribs.size());
+	for(auto& attrib:cls->attribs)
+	{
+		WriteString(attrib.name);
+		WriteInt(attrib.isStatic);
+		WriteFunctionRef(attrib.init);
+	}
+
+	WriteInt(cls->methods.size());
+	for(auto& method:cls->methods)
+	{
+		WriteString(method.first);
+		WriteFunctionRef(method.second);
+	}
+
+	WriteFunctionRef(cls->destructor);
+}
+
+bool Snapshot::WriteHeap(VirtualMachine* vm)
+{
+	//finds everything reachable from the class objects, objects[i] gets id i
+	for(auto& global:vm->globals)
+		if(!AddValue(global.second))
+			return false;
+
+	for(size_t i=0;i<objects.size();i++)
+	{
+		Object* obj = objects[i];
+		for(auto& var:obj->vars)
+			if(!AddValue(var.second))
+				return false;
+
+		if(obj->isArray)
+		{
+			for(auto& element:((ArrayObject*)obj)->elements)
+				if(!AddValue(element))
+					return false;
+		}
+		else if(obj->isMap)
+		{
+			for(auto& entry:((MapObject*)obj)->entries)
+				if(entry.state==MapEntry::Used && (!AddValue(entry.key) || !AddValue(entry.value)))
+					return false;
+		}
+	}
+
+	//all the objects are made before any of them are filled in, so the kinds go first
+	WriteInt(objects.size());
+	for(auto obj:objects)
+	{
+		if(obj->isClass)
+		{
+			WriteInt(CLASS_OBJECT);
+			WriteString(((ClassObject*)obj)->cls->name);
+		}
+		else
+		{
+			WriteInt(obj->isArray?ARRAY_OBJECT:obj->isMap?MAP_OBJECT:PLAIN_OBJECT);
+		}
+	}
+
+	for(auto obj:objects)
+		WriteObject(obj);
+
+	WriteInt(vm->globals.size());
+	for(auto& global:vm->globals)
+	{
+		WriteString(global.first);
+		WriteValue(global.second);
+	}
+
+	return true;
+}
+
+bool Snapshot::AddObject(Object* obj)
+{
+	if(objectIds.find(obj)!=objectIds.end())
+		return true;
+
+	if(obj->isCoroutine)
+		return Fail("coroutines cant be saved in a snapshot");
+	if(obj->data!=nullptr)
+		return Fail("objects with native data cant be saved in a snapshot ("+obj->typeName+")");
+	if(!obj->managed && !obj->isClass)
+		return Fail("objects owned by the host cant be saved in a snapshot ("+obj->typeName+")");
+
+	//arrays and maps get their methods back from their constructors
+	if(!obj->isArray && !obj->isMap)
+	{
+		for(auto& method:obj->methods)
+			if(functionIds.find(method.second)==functionIds.end())
+				return Fail("method "+method.first+" of "+obj->typeName+" isnt in the assembly");
+	}
+
+	if(obj->destructor!=nullptr && functionIds.find(obj->destructor)==functionIds.end())
+		return Fail("the destructor of "+obj->typeName+" isnt in the assembly");
+
+	objectIds[obj] = objects.size();
+	objects.push_back(obj);
+	return true;
+}
+
+bool Snapshot::AddValue(const Value& val)
+{
+	switch(val.type)
+	{
+	case ValueType::Object:
+	case ValueType::Array:
+	case ValueType::Map:
+		return val.val.obj==nullptr || AddObject(val.val.obj);
+	default:
+		return true;
+	}
+}
+
+void Snapshot::WriteValue(const Value& val)
+{
+	WriteInt(val.type);
+	switch(val.type)
+	{
+	case ValueType::Number:
+		WriteNumber(val.val.num);
+		break;
+	case ValueType::Bool:
+		WriteInt(val.val.b);
+		break;
+	case ValueType::String:
+		WriteString(val.val.str);
+		break;
+	case ValueType::Object:
+	case ValueType::Array:
+	case ValueType::Map:
+		WriteInt(val.val.obj==nullptr?~0u:objectIds[val.val.obj]);
+		break;
+	default:
+		break;
+	}
+}
+
+void Snapshot::WriteObject(Object* obj)
+{
+	WriteString(obj->typeName);
+	WriteFunctionRef(obj->destructor);
+
+	WriteInt(obj->vars.size());
+	for(auto& var:obj->vars)
+	{
+		WriteString(var.first);
+		WriteValue(var.second);
+	}
+
+	if(obj->isArray)
+	{
+		ArrayObject* arr = (ArrayObject*)obj;
+		WriteInt(arr->elements.size());
+		for(auto& element:arr->elements)
+			WriteValue(element);
+	}
+	else if(obj->isMap)
+	{
+		MapObject* map = (MapObject*)obj;
+		WriteInt(map->count);
+		for(auto& entry:map->entries)
+		{
+			if(entry.state!=MapEntry::Used)
+				continue;
+
+			WriteValue(entry.key);
+			WriteValue(entry.value);
+		}
+	}
+	else
+	{
+		WriteInt(obj->methods.size());
+		for(auto& method:obj->methods)
+		{
+			WriteString(method.first);
+			WriteFunctionRef(method.second);
+		}
+	}
+
+	if(obj->isClass)
+	{
+		ClassObject* cls = (ClassObject*)obj;
+		WriteInt(cls->pendingInits.size());
+		for(auto& init:cls->pendingInits)
+			WriteString(init.first);
+	}
+}
+
+void Snapshot::WriteInt(unsigned int val)
+{
+	out.append((const char*)&val,sizeof(val));
+}
+
+void Snapshot::WriteNumber(double val)
+{
+	out.append((const char*)&val,sizeof(val));
+}
+
+void Snapshot::WriteString(const string& str)
+{
+	WriteInt(str.size());
+	out.append(str);
+}
+
+/* READING */
+
+bool Snapshot::Read(const string& filename,Assembly* assembly,VirtualMachine* vm,Error& error)
+{
+	//big snapshots are mapped rather than read
+	SourceBuffer buffer;
+	if(!buffer.Load(filename))
+	{
+		error = Error();
+		error.code = Error::FILE_ERROR;
+		error.message = "cant read "+filename;
+		error.filename = filename;
+		return false;
+	}
+
+	Snapshot snapshot;
+	snapshot.in = buffer.Data();
+	snapshot.size = buffer.Size();
+	snapshot.host = assembly;
+
+	//everything is read on the side and only handed over once the whole file checks out
+	Assembly scratch;
+	unordered_map<string,Value> globals;
+	if(snapshot.ReadHeader(MAGIC,filename) && snapshot.ReadAssembly(&scratch) && snapshot.ResolveParents(&scratch) && snapshot.ReadHeap(&scratch,globals))
+	{
+		//the snapshot's sources go after the ones already in the assembly
+		int offset = assembly->sourceNames.size();
+		for(auto func:snapshot.readFunctions)
+			if(!func->isNative && func->sourceIndex>=0)
+				func->sourceIndex += offset;
+		for(auto& cls:scratch.classes)
+			if(cls.second->sourceIndex>=0)
+				cls.second->sourceIndex += offset;
+
+		snapshot.Merge(&scratch,assembly);
+
+		vm->SetAssembly(assembly);
+		vm->globals = std::move(globals);
+		for(auto obj:snapshot.readObjects)
+			if(!obj->isClass)
+				GC::AddObject(vm,obj,false);
+	}
+	else
+	{
+		for(auto obj:snapshot.readObjects)
+			delete obj;
+		snapshot.Discard(&scratch);
+
+		snapshot.error.filename = filename;
+	}
+
+	error = snapshot.error;
+	return error.code==Error::NONE;
+}
+
+bool Snapshot::ReadSource(const string& filename,Assembly* assembly,int sourceIndex)
+{
+	SourceBuffer buffer;
+	if(!buffer.Load(filename))
+		return false;
+
+	Snapshot snapshot;
+	snapshot.in = buffer.Data();
+	snapshot.size = buffer.Size();
+	snapshot.sourceIndex = sourceIndex;
+
+	snapshot.host = assembly;
+
+	//read into an assembly of its own so nothing is half added if the file is bad
+	Assembly scratch;
+	if(snapshot.ReadHeader(SOURCE_MAGIC,filename) && snapshot.ReadAssembly(&scratch) && snapshot.pos==snapshot.size)
+	{
+		snapshot.Merge(&scratch,assembly);
+		return true;
+	}
+
+	snapshot.Discard(&scratch);
+	return false;
+}
+
+void Snapshot::Merge(Assembly* scratch,Assembly* assembly)
+{
+	for(auto& name:scratch->sourceNames)
+		assembly->sourceNames.push_back(name);
+	for(auto& func:scratch->functions)
+		assembly->functions[func.first] = func.second;
+	for(auto& cls:scratch->classes)
+		assembly->AddClass(cls.second);
+}
+
+void Snapshot::Discard(Assembly* scratch)
+{
+	//natives belong to the host, everything else was made by this read
+	for(auto func:readFunctions)
+		if(func!=nullptr && !func->isNative)
+			delete func;
+	for(auto& cls:scratch->classes)
+		delete cls.second;
+}
+
+Class* Snapshot::FindClass(Assembly* scratch,const string& name)
+{
+	Class* cls = scratch->GetClass(name);
+	return cls!=nullptr?cls:host->GetClass(name);
+}
+
+bool Snapshot::ReadHeader(const char* magic,const string& filename)
+{
+	unsigned int version,low,high;
+	if(size<sizeof(MAGIC) || memcmp(in,magic,sizeof(MAGIC))!=0)
+		return Fail(filename+" isnt a snapshot");
+
+	pos = sizeof(MAGIC);
+	if(!ReadInt(version) || !ReadInt(low) || !ReadInt(high))
+		return Fail(filename+" isnt a snapshot");
+	if(version!=VERSION || (low|((unsigned long long)high<<32))!=GetFingerprint())
+		return Fail(filename+" was saved by a different build of loris");
+
+	return true;
+}
+
+bool Snapshot::ReadAssembly(Assembly* assembly)
+{
+	unsigned int count;
+	if(!ReadCount(count))
+		return false;
+
+	for(unsigned int i=0;i<count;i++)
+	{
+		string name;
+		if(!ReadString(name))
+			return false;
+		assembly->sourceNames.push_back(name);
+	}
+
+	if(!ReadCount(count))
+		return false;
+
+	readFunctions.resize(count,nullptr);
+	for(unsigned int i=0;i<count;i++)
+		if(!ReadFunction(readFunctions[i]))
+			return false;
+
+	//script functions
+	if(!ReadCount(count))
+		return false;
+
+	for(unsigned int i=0;i<count;i++)
+	{
+		string name;
+		Function* func;
+		if(!ReadString(name) || !ReadFunctionRef(func))
+			return false;
+
+		if(func!=nullptr && !func->isNative)
+			assembly->functions[name] = func;
+	}
+
+	if(!ReadCount(count))
+		return false;
+
+	for(unsigned int i=0;i<count;i++)
+		if(!ReadClass(assembly))
+			return false;
+
+	return true;
+}
+
+bool Snapshot::ResolveParents(Assembly* assembly)
+{
+	for(auto& cls:assembly->classes)
+	{
+		if(cls.second->parentName.empty())
+			continue;
+
+		cls.second->parent = FindClass(assembly,cls.second->parentName);
+		if(cls.second->parent==nullptr)
+			return Fail("unable to find class "+cls.second->parentName);
+	}
+
+	return true;
+}
+
+bool Snapshot::ReadFunction(Function*& func)
+{
+	unsigned int kind;
+	if(!ReadInt(kind))
+		return false;
+
+	if(kind!=SCRIPT_FUNCTION)
+	{
+		string name;
+		if(!ReadString(name))
+			return false;
+
+		if(kind==NATIVE_FUNCTION)
+		{
+			func = host->GetFunction(name);
+			if(func==nullptr || !func->isNative)
+				return Fail("native function "+name+" has to be added before the snapshot is read");
+		}
+		else if(kind==NATIVE_METHOD)
+		{
+			size_t dot = name.find('.');
+			Class* cls = host->GetClass(name.substr(0,dot));
+			func = cls==nullptr?nullptr:cls->GetMethod(name.substr(dot+1));
+			if(func==nullptr || !func->isNative)
+				return Fail("native class "+name.substr(0,dot)+" has to be added before the snapshot is read");
+		}
+		else
+		{
+			Class* cls = host->GetClass(name);
+			func = cls==nullptr?nullptr:cls->destructor;
+			if(func==nullptr || !func->isNative)
+				return Fail("native class "+name+" has to be added before the snapshot is read");
+		}
+
+		return true;
+	}
+
+	func = new Function;
+
+	unsigned int val,count,instrCount,lineBytes;
+	if(!ReadString(func->name) || !ReadInt(val))
+		return false;
+	func->isStatic = val!=0;
+
+	if(!ReadInt(val))
+		return false;
+	func->sourceIndex = sourceIndex<0?(int)val:sourceIndex;
+
+	if(!ReadCount(count))
+		return false;
+	func->args.resize(count);
+	for(auto& arg:func->args)
+		if(!ReadString(arg))
+			return false;
+
+	if(!ReadCount(count))
+		return false;
+	func->strings.resize(count);
+	for(auto& str:func->strings)
+		if(!ReadString(str))
+			return false;
+
+	if(!ReadCount(count))
+		return false;
+	func->constants.resize(count);
+	for(auto& constant:func->constants)
+		if(!ReadValue(constant))
+			return false;
+
+	if(!ReadInt(instrCount))
+		return false;
+	if(instrCount>(size-pos)/sizeof(DSInstr))
+		return Fail("snapshot is truncated");
+	//the file isnt aligned, so the instructions are copied rather than assigned
+	func->instr.resize(instrCount);
+	if(instrCount>0)
+		memcpy(func->instr.data(),in+pos,instrCount*sizeof(DSInstr));
+	pos += instrCount*sizeof(DSInstr);
+
+	LineTable& lines = func->lines;
+	if(!ReadInt(lineBytes))
+		return false;
+	if(lineBytes>size-pos)
+		return Fail("snapshot is truncated");
+	lines.data.assign(in+pos,in+pos+lineBytes);
+	pos += lineBytes;
+
+	unsigned int lastOffset,lastPc,lastLine,prevPc,prevLine;
+	if(!ReadInt(lastOffset) || !ReadInt(lastPc) || !ReadInt(lastLine) || !ReadInt(prevPc) || !ReadInt(prevLine))
+		return false;
+	lines.lastOffset = lastOffset;
+	lines.lastPc = (int)lastPc;
+	lines.lastLine = (int)lastLine;
+	lines.prevPc = (int)prevPc;
+	lines.prevLine = (int)prevLine;
+
+	return true;
+}
+
+bool Snapshot::ReadFunctionRef(Function*& func)
+{
+	unsigned int id;
+	if(!ReadInt(id))
+		return false;
+
+	if(id==~0u)
+	{
+		func = nullptr;
+		return true;
+	}
+
+	if(id>=readFunctions.size())
+		return Fail("snapshot is corrupt");
+
+	func = readFunctions[id];
+	return true;
+}
+
+bool Snapshot::ReadClass(Assembly* assembly)
+{
+	unsigned int native;
+	string name;
+	if(!ReadInt(native) || !ReadString(name))
+		return false;
+
+	//native classes were already checked for when their functions were read,
+	//but one without any functions only shows up here
+	if(native)
+	{
+		if(host->GetClass(name)==nullptr)
+			return Fail("native class "+name+" has to be added before the snapshot is read");
+		return true;
+	}
+
+	Class* cls = new Class;
+	cls->name = name;
+	assembly->AddClass(cls);
+
+	unsigned int val,count;
+	if(!ReadString(cls->parentName) || !ReadInt(val))
+		return false;
+	cls->sourceIndex = sourceIndex<0?(int)val:sourceIndex;
+
+	if(!ReadCount(count))
+		return false;
+	for(unsigned int i=0;i<count;i++)
+	{
+		ClassAttrib attrib;
+		if(!ReadString(attrib.name) || !ReadInt(val) || !ReadFunctionRef(attrib.init))
+			return false;
+		attrib.isStatic = val!=0;
+		cls->attribs.push_back(attrib);
+	}
+
+	if(!ReadCount(count))
+		return false;
+	for(unsigned int i=0;i<count;i++)
+	{
+		string method;
+		Function* func;
+		if(!ReadString(method) || !ReadFunctionRef(func))
+			return false;
+		cls->methods[method] = func;
+	}
+
+	return ReadFunctionRef(cls->destructor);
+}
+
+bool Snapshot::ReadHeap(Assembly* assembly,unordered_map<string,Value>& globals)
+{
+	unsigned int count;
+	if(!ReadCount(count))
+		return false;
+
+	//made empty first, values can point at any of them
+	for(unsigned int i=0;i<count;i++)
+	{
+		unsigned int kind;
+		if(!ReadInt(kind))
+			return false;
+
+		Object* obj;
+		if(kind==CLASS_OBJECT)
+		{
+			string name;
+			if(!ReadString(name))
+				return false;
+
+			Class* cls = FindClass(assembly,name);
+			if(cls==nullptr)
+				return Fail("unable to find class "+name);
+			if(globals.find(name)!=globals.end())
+				return Fail("snapshot is corrupt");
+
+			//class objects arent added to the gc, the vm deletes them through globals
+			obj = new ClassObject(cls);
+			globals[name] = Value::CreateObject(obj);
+		}
+		else if(kind==ARRAY_OBJECT)
+		{
+			obj = new ArrayObject;
+		}
+		else if(kind==MAP_OBJECT)
+		{
+			obj = new MapObject;
+		}
+		else
+		{
+			obj = new Object;
+		}
+
+		readObjects.push_back(obj);
+	}
+
+	for(auto obj:readObjects)
+		if(!ReadObject(obj))
+			return false;
+
+	if(!ReadCount(count))
+		return false;
+
+	for(unsigned int i=0;i<count;i++)
+	{
+		string name;
+		Value val;
+		if(!ReadString(name) || !ReadValue(val))
+			return false;
+
+		//the vm deletes what globals hold, so they cant be anything but their own class objects
+		if(val.type!=ValueType::Object || val.val.obj==nullptr || !val.val.obj->isClass || ((ClassObject*)val.val.obj)->cls->name!=name)
+			return Fail("snapshot is corrupt");
+
+		globals[name] = val;
+	}
+
+	return true;
+}
+
+bool Snapshot::ReadValue(Value& val)
+{
+	unsigned int type;
+	if(!ReadInt(type))
+		return false;
+
+	switch(type)
+	{
+	case ValueType::Number:
+		{
+			double num;
+			if(!ReadNumber(num))
+				return false;
+			val = Value::CreateNumber(num);
+		}
+		return true;
+	case ValueType::Bool:
+		{
+			unsigned int b;
+			if(!ReadInt(b))
+				return false;
+			val = Value::CreateBool(b!=0);
+		}
+		return true;
+	case ValueType::String:
+		{
+			string str;
+			if(!ReadString(str))
+				return false;
+			val = Value::CreateString(str.c_str());
+		}
+		return true;
+	case ValueType::Object:
+	case ValueType::Array:
+	case ValueType::Map:
+		{
+			unsigned int id;
+			if(!ReadInt(id))
+				return false;
+
+			//constants are read before any objects exist, but never hold one
+			Object* obj = nullptr;
+			if(id!=~0u)
+			{
+				if(id>=readObjects.size())
+					return Fail("snapshot is corrupt");
+				obj = readObjects[id];
+			}
+
+			val = Value::CreateObject(obj);
+			val.type = (ValueType::Enum)type;
+		}
+		return true;
+	case ValueType::Null:
+		val = Value::CreateNull();
+		return true;
+	default:
+		return Fail("snapshot is corrupt");
+	}
+}
+
+bool Snapshot::ReadObject(Object* obj)
+{
+	Function* destructor;
+	if(!ReadString(obj->typeName) || !ReadFunctionRef(destructor))
+		return false;
+	obj->destructor = destructor;
+
+	unsigned int count;
+	if(!ReadCount(count))
+		return false;
+
+	for(unsigned int i=0;i<count;i++)
+	{
+		string name;
+		Value val;
+		if(!ReadString(name) || !ReadValue(val))
+			return false;
+		obj->vars[name] = val;
+	}
+
+	if(!ReadCount(count))
+		return false;
+
+	if(obj->isArray)
+	{
+		ArrayObject* arr = (ArrayObject*)obj;
+		arr->elements.resize(count);
+		for(auto& element:arr->elements)
+			if(!ReadValue(element))
+				return false;
+	}
+	else if(obj->isMap)
+	{
+		MapObject* map = (MapObject*)obj;
+		for(unsigned int i=0;i<count;i++)
+		{
+			Value key,val;
+			if(!ReadValue(key) || !ReadValue(val))
+				return false;
+			map->Set(key,val);
+		}
+	}
+	else
+	{
+		for(unsigned int i=0;i<count;i++)
+		{
+			string name;
+			Function* func;
+			if(!ReadString(name) || !ReadFunctionRef(func))
+				return false;
+			obj->methods[name] = func;
+		}
+	}
+
+	if(obj->isClass)
+	{
+		ClassObject* classObj = (ClassObject*)obj;
+		if(!ReadCount(count))
+			return false;
+
+		for(unsigned int i=0;i<count;i++)
+		{
+			string name;
+			if(!ReadString(name))
+				return false;
+
+			for(auto& attrib:classObj->cls->attribs)
+				if(attrib.name==name && attrib.init!=nullptr)
+					classObj->pendingInits[name] = attrib.init;
+		}
+	}
+
+	return true;
+}
+
+bool Snapshot::ReadInt(unsigned int& val)
+{
+	if(size-pos<sizeof(val))
+		return Fail("snapshot is truncated");
+
+	memcpy(&val,in+pos,sizeof(val));
+	pos += sizeof(val);
+	return true;
+}
+
+//a count of things that take at least an int each, so a corrupt one cant ask for
+//more memory than the file could fill
+bool Snapshot::ReadCount(unsigned int& count)
+{
+	if(!ReadInt(count))
+		return false;
+
+	if(count>(size-pos)/sizeof(unsigned int))
+		return Fail("snapshot is corrupt");
+
+	return true;
+}
+
+bool Snapshot::ReadNumber(double& val)
+{
+	if(size-pos<sizeof(val))
+		return Fail("snapshot is truncated");
+
+	memcpy(&val,in+pos,sizeof(val));
+	pos += sizeof(val);
+	return true;
+}
+
+bool Snapshot::ReadString(string& str)
+{
+	unsigned int length;
+	if(!ReadInt(length))
+		return false;
+
+	if(length>size-pos)
+		return Fail("snapshot is truncated");
+
+	str.assign(in+pos,length);
+	pos += length;
+	return true;
+}
@@ -0,0 +1,347 @@
+/*
+
+Copyright (C) 2014-2018 Nicolas Brown
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is furnished
+to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+*/
+
+#include "../include/loris/sourcefile.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <thread>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+using namespace loris;
+
+//files smaller than this are read instead of mapped
+static const size_t MAP_THRESHOLD = 64 * 1024;
+
+SourceBuffer::SourceBuffer()
+{
+	data = "";
+	size = 0;
+	mapping = nullptr;
+	mappingSize = 0;
+}
+
+SourceBuffer::SourceBuffer(std::string text) : text(std::move(text))
+{
+	data = this->text.data();
+	size = this->text.size();
+	mapping = nullptr;
+	mappingSize = 0;
+}
+
+SourceBuffer::~SourceBuffer()
+{
+	Unmap();
+}
+
+SourceBuffer::SourceBuffer(SourceBuffer&& other)
+{
+	mapping = nullptr;
+	mappingSize = 0;
+	*this = std::move(other);
+}
+
+SourceBuffer& SourceBuffer::operator=(SourceBuffer&& other)
+{
+	if (this == &other)
+		return *this;
+
+	Unmap();
+
+	text = std::move(other.text);
+	mapping = other.mapping;
+	mappingSize = other.mappingSize;
+	size = other.size;
+
+	//a moved short string gets a new buffer, a mapping stays where it is
+	data = mapping ? other.data : text.data();
+
+	other.text.clear();
+	other.data = "";
+	other.size = 0;
+	other.mapping = nullptr;
+	other.mappingSize = 0;
+
+	return *this;
+}
+
+void SourceBuffer::Unmap()
+{
+	if (mapping == nullptr)
+		return;
+
+#ifndef _WIN32
+	munmap(mapping, mappingSize);
+#endif
+	mapping = nullptr;
+	mappingSize = 0;
+}
+
+#ifdef _WIN32
+
+bool SourceBuffer::Load(const std::string& filename)
+{
+	FILE* file = fopen(filename.c_str(), "rb");
+	if (file == nullptr)
+		return false;
+
+	std::string contents;
+	fseek(file, 0, SEEK_END);
+	long length = ftell(file);
+	fseek(file, 0, SEEK_SET);
+
+	bool ok = length >= 0;
+	if (ok && length > 0)
+	{
+		contents.resize((size_t)length);
+		ok = fread(&contents[0], 1, contents.size(), file) == contents.size();
+	}
+	fclose(file);
+
+	if (!ok)
+		return false;
+
+	*this = SourceBuffer(std::move(contents));
+	return true;
+}
+
+#else
+
+bool SourceBuffer::Load(const std::string& filename)
+{
+	int fd = open(filename.c_str(), O_RDONLY);
+	if (fd < 0)
+		return false;
+
+	struct stat info;
+	if (fstat(fd, &info) != 0 || !S_ISREG(info.st_mode))
+	{
+		close(fd);
+		return false;
+	}
+
+	size_t length = (size_t)info.st_size;
+
+	if (length >= MAP_THRESHOLD)
+	{
+		int flags = MAP_PRIVATE;
+#ifdef MAP_POPULATE
+		//read the pages in now, so the io happens on the loading thread and not in the lexer
+		flags |= MAP_POPULATE;
+#endif
+		void* map = mmap(nullptr, length, PROT_READ, flags, fd, 0);
+		close(fd);
+
+		if (map == MAP_FAILED)
+			return false;
+
+		*this = SourceBuffer();
+		mapping = map;
+		mappingSize = length;
+		data = (const char*)map;
+		size = length;
+		return true;
+	}
+
+	std::string contents(length, '\0');
+	size_t done = 0;
+	while (done < length)
+	{
+		ssize_t count = read(fd, &contents[done], length - done);
+		if (count < 0)
+		{
+			close(fd);
+			return false;
+		}
+		//the file shrank since fstat
+		if (count == 0)
+			break;
+
+		done += (size_t)count;
+	}
+	close(fd);
+
+	contents.resize(done);
+	*this = SourceBuffer(std::move(contents));
+	return true;
+}
+
+#endif
+
+bool loris::MatchGlob(const char* pattern, const char* name)
+{
+	//where to retry from when the last * has to swallow one more char
+	const char* star = nullptr;
+	const char* retry = nullptr;
+
+	while (*name)
+	{
+		if (*pattern == '*')
+		{
+			star = pattern++;
+			retry = name;
+		}
+		else if (*pattern == '?' || *pattern == *name)
+		{
+			pattern++;
+			name++;
+		}
+		else if (star)
+		{
+			pattern = star + 1;
+			name = ++retry;
+		}
+		else
+		{
+			return false;
+		}
+	}
+
+	while (*pattern == '*')
+		pattern++;
+
+	return *pattern == '\0';
+}
+
+bool loris::ListFiles(const std::string& dir, const std::string& pattern, std::vector<std::string>& files)
+{
+	std::vector<std::string> found;
+
+#ifdef _WIN32
+	WIN32_FIND_DATAA entry;
+	HANDLE handle = FindFirstFileA((dir + "\\*").c_str(), &entry);
+	if (handle == INVALID_HANDLE_VALUE)
+		return false;
+
+	do
+	{
+		if (!(entry.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) && MatchGlob(pattern.c_str(), entry.cFileName))
+			found.push_back(entry.cFileName);
+	} while (FindNextFileA(handle, &entry));
+	FindClose(handle);
+#else
+	DIR* handle = opendir(dir.c_str());
+	if (handle == nullptr)
+		return false;
+
+	while (dirent* entry = readdir(handle))
+	{
+		if (entry->d_name[0] == '.' && (entry->d_name[1] == '\0' || strcmp(entry->d_name, "..") == 0))
+			continue;
+#ifdef _DIRENT_HAVE_D_TYPE
+		if (entry->d_type == DT_DIR)
+			continue;
+#endif
+
+		if (MatchGlob(pattern.c_str(), entry->d_name))
+			found.push_back(entry->d_name);
+	}
+	closedir(handle);
+#endif
+
+	//directory order depends on the file system, sorting keeps compiles repeatable
+	std::sort(found.begin(), found.end());
+	for (auto& name : found)
+		files.push_back(dir + "/" + name);
+
+	return true;
+}
+
+size_t loris::LoadFiles(const std::vector<std::string>& filenames, std::vector<SourceBuffer>& buffers, size_t threads)
+{
+	size_t count = filenames.size();
+	buffers.clear();
+	buffers.resize(count);
+
+	std::atomic<size_t> next(0);
+	std::atomic<size_t> failed(count);
+
+	auto work = [&]()
+	{
+		for (size_t i = next++; i < count; i = next++)
+		{
+			if (!buffers[i].Load(filenames[i]))
+			{
+				//keep the lowest index so the error is the same on every run
+				size_t current = failed.load();
+				while (i < current && !failed.compare_exchange_weak(current, i))
+				{
+				}
+			}
+		}
+	};
+
+	threads = std::max<size_t>(1, std::min(threads, count));
+
+	std::vector<std::thread> workers;
+	for (size_t t = 1; t < threads; t++)
+		workers.emplace_back(work);
+
+	work();
+	for (auto& worker : workers)
+		worker.join();
+
+	return failed;
+}
+
+bool loris::WriteFileAtomic(const std::string& filename, const std::string& data)
+{
+	//the temp file sits next to the target so the rename never crosses filesystems,
+	//the pid and counter keep writers in other processes and threads apart
+	static std::atomic<unsigned int> counter(0);
+#ifdef _WIN32
+	unsigned long pid = GetCurrentProcessId();
+#else
+	unsigned long pid = (unsigned long)getpid();
+#endif
+	std::string temp = filename + "." + std::to_string(pid) + "." + std::to_string(counter++) + ".tmp";
+
+	FILE* file = fopen(temp.c_str(), "wb");
+	if (file == nullptr)
+		return false;
+
+	bool ok = fwrite(data.data(), 1, data.size(), file) == data.size();
+	ok = fclose(file) == 0 && ok;
+
+#ifdef _WIN32
+	ok = ok && MoveFileExA(temp.c_str(), filename.c_str(), MOVEFILE_REPLACE_EXISTING);
+#else
+	ok = ok && rename(temp.c_str(), filename.c_str()) == 0;
+#endif
+
+	if (!ok)
+		remove(temp.c_str());
+
+	return ok;
+}
@@ -22,7 +22,12 @@ WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 */
 
 #include <algorithm>
+#include <climits>
+#include <sstream>
 #include "../include/loris/virtualmachine.hpp"
+#include "../include/loris/runtime.hpp"
+#include "../include/loris/profiler.hpp"
+#include "../include/loris/singlepass.hpp"
 
 using namespace loris;
 
@@ -52,6 +57,13 @@ Value::Value(const Value& other)
 
 Value& Value::operator=(const Value& other)
 {
+	if(this == &other)
+		return *this;
+
+	//free up the old string, map entries get overwritten a lot
+	if(type == ValueType::String)
+		delete[] val.str;
+
 	type = other.type;
 
 	//if its a string, copy over the value
@@ -71,6 +83,30 @@ Value& Value::operator=(const Value& other)
 	return *this;
 }
 
+Value::Value(Value&& other) noexcept
+{
+	type = other.type;
+	val = other.val;
+
+	//the string belongs to this value now
+	other.type = ValueType::Null;
+}
+
+Value& Value::operator=(Value&& other) noexcept
+{
+	if(this == &other)
+		return *this;
+
+	if(type == ValueType::String)
+		delete[] val.str;
+
+	type = other.type;
+	val = other.val;
+	other.type = ValueType::Null;
+
+	return *this;
+}
+
 double Value::AsNumber()
 {
 	return val.num;
@@ -98,6 +134,11 @@ ArrayObject* Value::AsArray()
 	return val.arr;
 }
 
+MapObject* Value::AsMap()
+{
+	return val.map;
+}
+
 //display
 void Value::Print(bool newLine)
 {
@@ -120,6 +161,9 @@ void Value::Print(bool newLine)
 	case ValueType::Object:
 		cout<<"<Object>"<<lineEnd;
 		break;
+	case ValueType::Map:
+		cout<<"<Map>"<<lineEnd;
+		break;
 	case ValueType::Null:
 		cout<<"null"<<lineEnd;
 		break;
@@ -169,10 +213,14 @@ Value Value::CreateObject(Object* obj)
 
 Value Value::CreateString(const char* val)
 {
-	int len = strlen(val);
-	char* str = new char[len+1];
-	strcpy(str,val);
-	str[len]='\0';
+	return CreateString(val,strlen(val));
+}
+
+Value Value::CreateString(const char* val,size_t length)
+{
+	char* str = new char[length+1];
+	memcpy(str,val,length);
+	str[length]='\0';
 
 	Value v;
 	v.type = ValueType::String;
@@ -187,6 +235,9 @@ Object::Object()
 {
 	marked = false;
 	isArray = false;
+	isMap = false;
+	isCoroutine = false;
+	isClass = false;
 
 	//custom data
 	manageData = false;
@@ -232,13 +283,111 @@ bool Object::HasMethod(string name)
 	return iter!=methods.end();
 }
 
+/* LINE TABLE */
+
+void LineTable::Clear()
+{
+	data.clear();
+	lastOffset = 0;
+	lastPc = lastLine = 0;
+	prevPc = prevLine = 0;
+}
+
+static void WriteVarInt(vector<unsigned char>& data,unsigned int val)
+{
+	while(val>=0x80)
+	{
+		data.push_back((unsigned char)(val|0x80));
+		val >>= 7;
+	}
+	data.push_back((unsigned char)val);
+}
+
+static unsigned int ReadVarInt(const vector<unsigned char>& data,size_t& offset)
+{
+	unsigned int val = 0;
+	int shift = 0;
+	while(true)
+	{
+		unsigned char byte = data[offset++];
+		val |= (unsigned int)(byte&0x7f)<<shift;
+		if(byte<0x80)
+			return val;
+		shift += 7;
+	}
+}
+
+void LineTable::WriteRun(int pc,int line)
+{
+	lastOffset = data.size();
+	lastPc = pc;
+	lastLine = line;
+
+	//lines can go backwards (loop conditions are compiled after the body), so the
+	//line change is zigzag encoded to keep small negative changes small
+	int lineDelta = line-prevLine;
+	WriteVarInt(data,pc-prevPc);
+	WriteVarInt(data,((unsigned int)lineDelta<<1)^(unsigned int)(lineDelta>>31));
+}
+
+void LineTable::Add(int pc,int line)
+{
+	if(!data.empty())
+	{
+		if(lastLine==line)
+			return;
+
+		//nothing was emitted for the last line, replace it
+		if(lastPc==pc)
+		{
+			data.resize(lastOffset);
+			WriteRun(pc,line);
+			return;
+		}
+	}
+
+	prevPc = lastPc;
+	prevLine = lastLine;
+	WriteRun(pc,line);
+}
+
+int LineTable::GetLine(int pc) const
+{
+	//runs are in pc order, the answer is the last one starting at or before pc
+	int line = -1;
+	int runPc = 0,runLine = 0;
+	size_t offset = 0;
+	while(offset<data.size())
+	{
+		runPc += ReadVarInt(data,offset);
+		unsigned int zigzag = ReadVarInt(data,offset);
+		if(runPc>pc)
+			break;
+
+		runLine += (int)(zigzag>>1)^-(int)(zigzag&1);
+		line = runLine;
+	}
+
+	return line;
+}
+
 /* VIRTUAL MACHINE */
 
 VirtualMachine::VirtualMachine()
 {
-	lineNo = 0;
+	errorTracePending = false;
+	maxCallDepth = 10000;
 	nullVal = Value::CreateNull();
 	selfVal = Value::CreateObject(nullptr);
+	runningCoroutine = nullptr;
+	gcEnabled = true;
+	gcThreshold = 1000;
+	runtime = nullptr;
+
+	profiler = nullptr;
+	profileTicks = 0;
+	hasDeadline = false;
+	SetBudget(0);
 
 	//allocate 10 frames
 	for(auto i=0;i<20;i++)
@@ -247,6 +396,32 @@ VirtualMachine::VirtualMachine()
 	}
 }
 
+VirtualMachine::~VirtualMachine()
+{
+	for(auto frame:frames)
+		delete frame;
+	for(auto frame:allocatedFrames)
+		delete frame;
+
+	for(auto co:hostCoroutines)
+		delete co;
+
+	//script destructors arent run, the vm is going away
+	//unmanaged objects belong to whoever created them
+	for(auto obj:gcObjects)
+	{
+		if(obj->managed)
+			delete obj;
+	}
+
+	//class objects arent added to the gc
+	for(auto& global:globals)
+	{
+		if(global.second.type==ValueType::Object)
+			delete global.second.val.obj;
+	}
+}
+
 StackFrame* VirtualMachine::GetStackFrame()
 {
 	if(allocatedFrames.size()==0)
@@ -269,6 +444,8 @@ void VirtualMachine::ReturnStackFrame(StackFrame* frame)
 	frame->function = nullptr;
 	frame->locals.clear();
 	frame->stack.clear();
+	frame->loops.clear();
+	frame->constructed = nullptr;
 
 	allocatedFrames.push_back(frame);
 }
@@ -297,18 +474,220 @@ void VirtualMachine::SetAssembly(Assembly* assem)
 {
 	assembly = assem;
 
-	//load all the classes as objects
-	for(auto iter = assem->classes.begin();iter!=assem->classes.end();iter++)
+	//class objects are made as they're used, see LoadLocal
+	//the ones made for the old assembly go to the gc rather than being deleted, scripts may still hold them
+	for(auto& global:globals)
+	{
+		if(global.second.type==ValueType::Object)
+			GC::AddObject(this,global.second.val.obj,false);
+	}
+	globals.clear();
+}
+
+Assembly* VirtualMachine::GetAssembly()
+{
+	return assembly;
+}
+
+void VirtualMachine::SetMaxCallDepth(int depth)
+{
+	maxCallDepth = depth;
+}
+
+int VirtualMachine::GetMaxCallDepth()
+{
+	return maxCallDepth;
+}
+
+//with a deadline the countdown is only given this many ticks at a time,
+//so the clock gets read every so often instead of on every tick
+static const long long DEADLINE_CHECK_TICKS = 1024;
+
+//the tick limit when there isnt one, far enough from overflowing
+static const long long UNLIMITED_TICKS = LLONG_MAX/2;
+
+void VirtualMachine::SetBudget(long long ticks)
+{
+	budgetLimited = ticks>0;
+	budgetTicks = budgetLimited?ticks:UNLIMITED_TICKS;
+	budgetCountdown = 0;
+	RefillBudget();
+}
+
+void VirtualMachine::SetTimeBudget(double milliseconds)
+{
+	hasDeadline = milliseconds>0;
+	if(hasDeadline)
+		deadline = chrono::steady_clock::now()+chrono::microseconds((long long)(milliseconds*1000));
+
+	//hand the countdown a smaller share now that the clock has to be checked
+	if(budgetCountdown>0)
+		budgetTicks += budgetCountdown;
+	budgetCountdown = 0;
+	RefillBudget();
+}
+
+void VirtualMachine::SetProfiler(Profiler* prof)
+{
+	profiler = prof;
+	profileTicks = 0;
+
+	//the countdown has to run out once per sample
+	if(budgetCountdown>0)
+		budgetTicks += budgetCountdown;
+	budgetCountdown = 0;
+	RefillBudget();
+}
+
+Profiler* VirtualMachine::GetProfiler()
+{
+	return profiler;
+}
+
+VMStats& VirtualMachine::GetStats()
+{
+	return stats;
+}
+
+void VirtualMachine::ResetStats()
+{
+	stats.Reset();
+}
+
+void VirtualMachine::StartCall(StackFrame* frame)
+{
+	stats.functions[frame->function].calls++;
+	frame->callStart = chrono::steady_clock::now();
+}
+
+void VirtualMachine::EndCall(StackFrame* frame)
+{
+	chrono::duration<double> time = chrono::steady_clock::now()-frame->callStart;
+	stats.functions[frame->function].time += time.count();
+}
+
+long long VirtualMachine::GetBudgetLeft()
+{
+	if(!budgetLimited)
+		return -1;
+
+	return budgetTicks+std::max(budgetCountdown,0LL);
+}
+
+bool VirtualMachine::IsBudgetExhausted()
+{
+	if(hasDeadline && chrono::steady_clock::now()>=deadline)
+		return true;
+
+	return budgetLimited && GetBudgetLeft()==0;
+}
+
+void VirtualMachine::RefillBudget()
+{
+	long long amount = budgetTicks;
+	if(hasDeadline && amount>DEADLINE_CHECK_TICKS)
+		amount = DEADLINE_CHECK_TICKS;
+	if(profiler!=nullptr && amount>profiler->GetInterval()-profileTicks)
+		amount = std::max(profiler->GetInterval()-profileTicks,1LL);
+
+	budgetCountdown = amount;
+	budgetRefill = amount;
+	budgetTicks -= amount;
+}
+
+bool VirtualMachine::CheckBudget()
+{
+	if(profiler!=nullptr)
+	{
+		profileTicks += budgetRefill;
+		if(profileTicks>=profiler->GetInterval())
+		{
+			profileTicks = 0;
+			profiler->Sample(this,frames);
+		}
+	}
+
+	if(!budgetLimited)
+		budgetTicks = UNLIMITED_TICKS;
+
+	if(budgetTicks<=0 || (hasDeadline && chrono::steady_clock::now()>=deadline))
+	{
+		//stays at 0 so every tick after this one ends up here too
+		budgetCountdown = 0;
+		return false;
+	}
+
+	RefillBudget();
+
+	//the tick that ran the countdown out
+	budgetCountdown--;
+
+	return true;
+}
+
+bool VirtualMachine::StopForBudget(StackFrame* frame,int resumeCp,size_t baseDepth)
+{
+	if(runningCoroutine!=nullptr && runningCoroutine->baseDepth==baseDepth)
 	{
-		//todo: how are these being cleaned up?
-		//nd: not added to gc so cleanup must be manual
-		Value classObj = Value::CreateClass(this,iter->second);
-		globals[iter->first] = classObj;
+		frame->cp = resumeCp;
+		SuspendCoroutine(baseDepth);
+		return true;
 	}
+
+	this->RaiseError(frame,"execution budget exceeded");
+	error.code = Error::BUDGET_EXCEEDED;
+
+	return false;
+}
+
+void VirtualMachine::SuspendCoroutine(size_t baseDepth)
+{
+	runningCoroutine->frames.assign(frames.begin()+baseDepth,frames.end());
+	frames.erase(frames.begin()+baseDepth,frames.end());
+
+	//a call stopped by the budget runs again on resume and needs its args,
+	//they shouldnt go to whatever the host calls next either
+	runningCoroutine->args.swap(args);
+	runningCoroutine->status = CoroutineObject::Suspended;
+}
+
+void VirtualMachine::SetGCEnabled(bool enabled)
+{
+	gcEnabled = enabled;
+}
+
+bool VirtualMachine::IsGCEnabled()
+{
+	return gcEnabled;
+}
+
+void VirtualMachine::AdoptHeap(VirtualMachine* other,size_t start)
+{
+	if(start>=other->gcObjects.size())
+		return;
+
+	gcObjects.insert(gcObjects.end(),other->gcObjects.begin()+start,other->gcObjects.end());
+	other->gcObjects.erase(other->gcObjects.begin()+start,other->gcObjects.end());
+}
+
+size_t VirtualMachine::GetHeapSize()
+{
+	return gcObjects.size();
+}
+
+void VirtualMachine::SetRuntime(LorisRuntime* rt)
+{
+	runtime = rt;
+}
+
+LorisRuntime* VirtualMachine::GetRuntime()
+{
+	return runtime;
 }
 
 Object* VirtualMachine::CreateNativeObject(Class* cls,bool addToGC)
 {
+	LORIS_STATS(stats.allocations[cls->name]++);
 	return CreateObject(cls,addToGC,false);
 }
 
@@ -395,7 +774,11 @@ Value VirtualMachine::ExecuteMemberFunction(Object* obj,string name)
 {
 	Function* func = obj->GetMethod(name);
 	if(func==NULL)
+	{
+		//dont leave the args around for the next call
+		args.clear();
 		return Value::CreateNull();
+	}
 
 	if(func->isNative)
 		return ExecuteNativeFunction(obj,func);
@@ -403,6 +786,30 @@ Value VirtualMachine::ExecuteMemberFunction(Object* obj,string name)
 	return ExecuteScriptFunction(obj,func);
 }
 
+bool VirtualMachine::ForEach(const vector<Object*>& objects,const string& name,const vector<Value>& callArgs)
+{
+	for(auto obj:objects)
+	{
+		//script functions take their args in reverse
+		for(size_t i=callArgs.size();i>0;i--)
+			AddArg(callArgs[i-1]);
+
+		ExecuteMemberFunction(obj,name);
+		if(HasError())
+			return false;
+	}
+
+	return true;
+}
+
+bool VirtualMachine::ForEachParallel(const vector<Object*>& objects,const string& name,const vector<Value>& callArgs)
+{
+	if(runtime!=nullptr)
+		return runtime->ForEachParallel(this,objects,name,callArgs);
+
+	return ForEach(objects,name,callArgs);
+}
+
 Value VirtualMachine::ExecuteFunction(Function* func)
 {
 	if(func->isNative)
@@ -420,22 +827,23 @@ Value VirtualMachine::ExecuteNativeFunction(Object* self,Function* func)
 	//reverse args
 	std::reverse(args.begin(),args.end());
 
+	LORIS_STATS(stats.nativeCalls++);
+	LORIS_STATS(FunctionStats& funcStats = stats.functions[func]);
+	LORIS_STATS(funcStats.calls++);
+	LORIS_STATS(auto start = chrono::steady_clock::now());
+
 	Value val =  func->nativeFunction(this,self);
 	args.clear();
-		
+
+	LORIS_STATS(chrono::duration<double> time = chrono::steady_clock::now()-start);
+	LORIS_STATS(funcStats.time += time.count());
 
 	return val;
 }
 
 
-Value VirtualMachine::ExecuteScriptFunction(Object* self,Function* func)
+void VirtualMachine::BindArgs(StackFrame* frame,Object* self,Function* func)
 {
-	Value ret = Value::CreateNull();//value returned from called function
-	//Value retured;//value returned from this function
-
-	//init stackframe before execution
-	//StackFrame* frame = new StackFrame;
-	StackFrame* frame = GetStackFrame();
 	frame->function = func;
 
 	if(self!=nullptr)
@@ -458,91 +866,548 @@ Value VirtualMachine::ExecuteScriptFunction(Object* self,Function* func)
 	}
 
 	args.clear();
+}
 
-	//no need for this, language is dynamically typed
-	//for(int i=0;i<func->numLocals;i++)
-	//	frame->locals.push_back(Value());
-	frames.push_back(frame);
+bool VirtualMachine::EnsureCompiled(Function* func)
+{
+	if(func->IsCompiled())
+		return true;
 
-	//switch vars
-	Value val;
+	Error compileError;
+	if(SinglePassCompiler::CompileBody(func,compileError))
+		return true;
 
-	//start execution
-	int cpSize = func->instr.size();
-	int cp = 0; //code/instruction pointer
-	while(cp<cpSize && error.code==Error::NONE)
+	string where = " on line "+to_string(compileError.line);
+	if(func->sourceIndex>=0 && func->sourceIndex<(int)assembly->sourceNames.size())
+		where = " in "+assembly->sourceNames[func->sourceIndex]+where;
+
+	args.clear();
+	RaiseError("function "+func->name+" doesnt compile: "+compileError.message+where);
+	return false;
+}
+
+void VirtualMachine::InitStatic(ClassObject* cls,const string& name)
+{
+	auto iter = cls->pendingInits.find(name);
+	if(iter==cls->pendingInits.end() || cls->runningInits.count(name)>0)
+		return;
+
+	Function* init = iter->second;
+	cls->runningInits.insert(name);
+
+	//the init can run in the middle of building a call's args, keep them aside
+	vector<Value> pending;
+	pending.swap(args);
+	Value val = ExecuteFunction(init);
+	args.swap(pending);
+
+	cls->runningInits.erase(name);
+
+	//an init stopped by an error or the budget stays pending and runs again on the next read
+	if(error.code!=Error::NONE)
+		return;
+
+	cls->pendingInits.erase(name);
+	cls->SetAttrib(name,val);
+}
+
+Value VirtualMachine::ExecuteScriptFunction(Object* self,Function* func)
+{
+	if(!PushFrame(self,func))
+		return nullVal;
+
+	return Execute(frames.size()-1);
+}
+
+CoroutineObject* VirtualMachine::CreateCoroutine(Function* func,Object* self,bool addToGC)
+{
+	if(!EnsureCompiled(func))
+		return nullptr;
+
+	CoroutineObject* co = new CoroutineObject;
+
+	//the first resume starts from the top of the function like a regular call
+	StackFrame* frame = GetStackFrame();
+	BindArgs(frame,self,func);
+	frame->cp = -1;
+	co->frames.push_back(frame);
+	LORIS_STATS(StartCall(frame));
+	LORIS_STATS(stats.allocations[co->typeName]++);
+
+	if(addToGC)
 	{
-		DSInstr instr = func->instr[cp];
-		switch(instr.op)
-		{
-		case OpCode::Pop:
-			frame->stack.pop_back();
-			break;
-		case OpCode::Line:
-			lineNo = instr.val;
-			break;
-			/* COMPARISONS */
-		case OpCode::IsGreaterThan:
-		case OpCode::IsLessThan:
-		case OpCode::IsGreaterThanOrEqual:
-		case OpCode::IsLessThanOrEqual:
-		case OpCode::IsEqual:
-		case OpCode::IsNotEqual:
-			Comparison(frame,instr.op);
-			break;
-		/* ARITHMETIC */
-		case OpCode::Add:
-		case OpCode::Sub:
-		case OpCode::Mul:
-		case OpCode::Div:
-			OpArithmetic(frame,instr.op);
-			break;
-		case OpCode::Neg:
-			Negate(frame);
-			break;
-		/* JUMPS */
-		case OpCode::Jump:
-			cp = instr.val-1;//cp gets incremented at the end of the loop
-			break;
-		case OpCode::JumpIfTrue:
-			val = frame->stack.back();
-			frame->stack.pop_back();
-			if(val.type == ValueType::Bool && val.val.b)
-				cp = instr.val-1;//cp gets incremented at the end of the loop
-			break;
-		case OpCode::JumpIfFalse:
-			val = frame->stack.back();
-			frame->stack.pop_back();
-			if(val.type == ValueType::Bool && !val.val.b)
-				cp = instr.val-1;//cp gets incremented at the end of the loop
-			break;
-		/* LOADING AND STORING VALUES */
-		case OpCode::LoadConstant:
-			frame->stack.push_back(frame->function->constants[instr.val]);
+		//dont collect here, nothing references the coroutine yet
+		GC::AddObject(this,co,false);
+	}
+	else
+	{
+		co->managed = false;
+		hostCoroutines.push_back(co);
+	}
+
+	return co;
+}
+
+Value VirtualMachine::Resume(CoroutineObject* co)
+{
+	if(co->status==CoroutineObject::Done)
+		return nullVal;
+
+	if(co->status==CoroutineObject::Running)
+	{
+		RaiseError("cannot resume a coroutine that is already running");
+		return nullVal;
+	}
+
+	if((int)(frames.size()+co->frames.size())>maxCallDepth)
+	{
+		RaiseError("call depth exceeded "+to_string(maxCallDepth));
+		return nullVal;
+	}
+
+	//put the coroutine's frames back on the frame stack and carry on where it left off
+	co->baseDepth = frames.size();
+	for(auto frame:co->frames)
+		frames.push_back(frame);
+	co->frames.clear();
+
+	co->status = CoroutineObject::Running;
+	co->resumer = runningCoroutine;
+	runningCoroutine = co;
+
+	//whatever args the caller has in flight wait until the coroutine stops
+	vector<Value> pending;
+	pending.swap(args);
+	args.swap(co->args);
+
+	Value result = Execute(co->baseDepth);
+
+	args.swap(pending);
+	runningCoroutine = co->resumer;
+	co->resumer = nullptr;
+
+	//yield sets the status back to suspended, anything else means it returned or failed
+	if(co->status==CoroutineObject::Running)
+		co->status = CoroutineObject::Done;
+
+	return result;
+}
+
+void VirtualMachine::DestroyCoroutine(CoroutineObject* co)
+{
+	if(co->status==CoroutineObject::Running)
+	{
+		RaiseError("cannot destroy a coroutine that is running");
+		return;
+	}
+
+	auto iter = std::find(hostCoroutines.begin(),hostCoroutines.end(),co);
+	if(iter!=hostCoroutines.end())
+		hostCoroutines.erase(iter);
+
+	for(auto frame:co->frames)
+		ReturnStackFrame(frame);
+	co->frames.clear();
+
+	delete co;
+}
+
+CallSite VirtualMachine::Prepare(const string& name,int arity)
+{
+	CallSite site;
+	site.function = assembly->GetFunction(name);
+	site.arity = arity;
+
+	return site;
+}
+
+Value VirtualMachine::Invoke(const CallSite& site,const Value* callArgs,Object* self)
+{
+	Value result;
+	InvokeBatch(site,callArgs,1,&result,self);
+
+	return result;
+}
+
+bool VirtualMachine::InvokeBatch(const CallSite& site,const Value* callArgs,size_t count,Value* results,Object* self)
+{
+	Function* func = site.function;
+	if(func==nullptr)
+		return false;
+
+	//the results handed out so far are only held by the host, a later call could collect them
+	size_t slot = batchResults.size();
+	batchResults.push_back({results,0});
+
+	bool ok;
+	if(func->isNative)
+		ok = InvokeNativeBatch(func,site.arity,callArgs,count,slot,self);
+	else
+		ok = InvokeScriptBatch(func,site.arity,callArgs,count,slot,self);
+
+	batchResults.pop_back();
+	return ok;
+}
+
+bool VirtualMachine::InvokeNativeBatch(Function* func,size_t arity,const Value* callArgs,size_t count,size_t slot,Object* self)
+{
+	Value* results = batchResults[slot].first;
+	for(size_t i=0;i<count;i++)
+	{
+		//native functions get their args reversed before being called
+		args.clear();
+		for(size_t a=arity;a>0;a--)
+			args.push_back(callArgs[i*arity+a-1]);
+
+		Value ret = ExecuteNativeFunction(self,func);
+		if(HasError())
+			return false;
+		if(results!=nullptr)
+		{
+			results[i] = ret;
+			batchResults[slot].second = i+1;
+		}
+	}
+
+	return true;
+}
+
+bool VirtualMachine::InvokeScriptBatch(Function* func,size_t arity,const Value* callArgs,size_t count,size_t slot,Object* self)
+{
+	if(!EnsureCompiled(func))
+		return false;
+
+	if((int)frames.size()>=maxCallDepth)
+	{
+		RaiseError("call depth exceeded "+to_string(maxCallDepth));
+		return false;
+	}
+
+	Value* results = batchResults[slot].first;
+	StackFrame* frame = GetStackFrame();
+	frame->pinned = true;
+
+	bool ok = true;
+	for(size_t i=0;i<count;i++)
+	{
+		//locals are nulled rather than cleared, so the map keeps its nodes and
+		//binding the params doesnt allocate after the first call
+		frame->function = func;
+		frame->stack.clear();
+		frame->loops.clear();
+		frame->constructed = nullptr;
+		frame->cp = -1;
+		for(auto& local:frame->locals)
+			local.second = nullVal;
+
+		if(self!=nullptr)
+			frame->locals["self"] = Value::CreateObject(self);
+
+		const Value* callArg = callArgs+i*arity;
+		size_t paramSize = func->args.size();
+		for(size_t p=0;p<paramSize;p++)
+			frame->locals[func->args[p]] = p<arity?callArg[p]:nullVal;
+
+		frames.push_back(frame);
+		LORIS_STATS(StartCall(frame));
+		Value ret = Execute(frames.size()-1);
+
+		if(HasError())
+		{
+			ok = false;
 			break;
-		case OpCode::LoadLocal:
-			if(frame->locals.find(func->strings[instr.val])!=frame->locals.end())//if it's a local, add it to stack
-				frame->stack.push_back(frame->locals[func->strings[instr.val]]);
-			else
+		}
+
+		if(results!=nullptr)
+		{
+			results[i] = ret;
+			batchResults[slot].second = i+1;
+		}
+	}
+
+	frame->pinned = false;
+	ReturnStackFrame(frame);
+
+	return ok;
+}
+
+bool VirtualMachine::PushFrame(Object* self,Function* func)
+{
+	if((int)frames.size()>=maxCallDepth)
+	{
+		args.clear();
+		RaiseError("call depth exceeded "+to_string(maxCallDepth));
+		return false;
+	}
+
+	if(!EnsureCompiled(func))
+		return false;
+
+	//init stackframe before execution
+	//StackFrame* frame = new StackFrame;
+	StackFrame* frame = GetStackFrame();
+	BindArgs(frame,self,func);
+
+	//cp gets incremented before the first instruction
+	frame->cp = -1;
+	LORIS_STATS(StartCall(frame));
+
+	//no need for this, language is dynamically typed
+	//for(int i=0;i<func->numLocals;i++)
+	//	frame->locals.push_back(Value());
+	frames.push_back(frame);
+
+	return true;
+}
+
+bool VirtualMachine::PopFrame(size_t baseDepth,Value& ret)
+{
+	StackFrame* frame = frames.back();
+	Object* constructed = frame->constructed;
+
+	frames.pop_back();
+	LORIS_STATS(EndCall(frame));
+	//delete frame;
+	if(!frame->pinned)
+		ReturnStackFrame(frame);
+
+	if(frames.size()<=baseDepth)
+		return false;
+
+	//hand the result to the caller
+	//constructors give back the object that was created instead
+	if(constructed)
+	{
+		frames.back()->stack.push_back(Value::CreateObject(constructed));
+		GC::AddObject(this,constructed);
+	}
+	else
+	{
+		frames.back()->stack.push_back(ret);
+	}
+
+	return true;
+}
+
+//switches the dispatch loop over to the frame at the top of the frame stack
+#define LOAD_TOP_FRAME() frame = frames.back();\
+	func = frame->function;\
+	cpSize = func->instr.size();\
+	cp = frame->cp;
+
+//spends a tick of the budget at a loop's back edge or a call
+//running out suspends the coroutine, which carries on from resumeCp+1, or raises an error
+#define SPEND_TICK(resumeCp) if(--budgetCountdown<0)\
+	{\
+		frame->cp = cp;\
+		if(!CheckBudget())\
+		{\
+			if(StopForBudget(frame,(resumeCp),baseDepth))\
+				return nullVal;\
+			break;\
+		}\
+	}
+
+/*
+runs the frame at the top of the frame stack until it returns
+script functions called along the way get their own frame and run in this
+same loop, only native functions leave it
+*/
+Value VirtualMachine::Execute(size_t baseDepth)
+{
+	StackFrame* frame;
+	Function* func;
+	int cpSize;
+	int cp; //code/instruction pointer
+	LOAD_TOP_FRAME();
+	cp++;
+
+	//switch vars
+	Value val;
+	Value ret;
+	Function* callee;
+	Object* callSelf;
+	DSInstr instr;
+
+	//start execution
+	while(true)
+	{
+		if(error.code!=Error::NONE)
+		{
+			//the error came from the instruction before cp
+			if(errorTracePending)
+			{
+				frame->cp = cp-1;
+				SetErrorTrace(frame);
+			}
+
+			//and the args of a call that never happened
+			args.clear();
+
+			//drop every frame this call pushed
+			while(frames.size()>baseDepth)
+			{
+				frame = frames.back();
+				frames.pop_back();
+				LORIS_STATS(EndCall(frame));
+				if(!frame->pinned)
+					ReturnStackFrame(frame);
+			}
+
+			return nullVal;
+		}
+
+		if(cp<cpSize)
+		{
+			instr = func->instr[cp];
+		}
+		else
+		{
+			//running off the end of a function returns null
+			frame->stack.push_back(nullVal);
+			instr.op = OpCode::Return;
+		}
+
+		LORIS_STATS(stats.opCounts[(int)instr.op]++);
+
+		switch(instr.op)
+		{
+		case OpCode::Pop:
+			frame->stack.pop_back();
+			break;
+			/* COMPARISONS */
+		case OpCode::IsGreaterThan:
+		case OpCode::IsLessThan:
+		case OpCode::IsGreaterThanOrEqual:
+		case OpCode::IsLessThanOrEqual:
+		case OpCode::IsEqual:
+		case OpCode::IsNotEqual:
+			Comparison(frame,instr.op);
+			break;
+		case OpCode::Not:
+			Not(frame);
+			break;
+		/* ARITHMETIC */
+		case OpCode::Add:
+		case OpCode::Sub:
+		case OpCode::Mul:
+		case OpCode::Div:
+			OpArithmetic(frame,instr.op);
+			break;
+		case OpCode::Neg:
+			Negate(frame);
+			break;
+		/* JUMPS */
+		case OpCode::Jump:
+			if(instr.val<=cp)
 			{
-				//check if it's a class being referred
-					
-				if(globals.find(func->strings[instr.val])!=globals.end())
+				SPEND_TICK(instr.val-1);
+			}
+			cp = instr.val-1;//cp gets incremented at the end of the loop
+			break;
+		case OpCode::JumpIfTrue:
+			val = frame->stack.back();
+			frame->stack.pop_back();
+			//conditions and the operands of && || ! in them
+			if(val.type != ValueType::Bool)
+				this->RaiseError(frame,"conditions can only be bools");
+			else if(val.val.b)
+			{
+				if(instr.val<=cp)
 				{
-					//add global if available
-					frame->stack.push_back(globals[func->strings[instr.val]]);
+					SPEND_TICK(instr.val-1);
 				}
-				else
+				cp = instr.val-1;//cp gets incremented at the end of the loop
+			}
+			break;
+		case OpCode::JumpIfFalse:
+			val = frame->stack.back();
+			frame->stack.pop_back();
+			//conditions and the operands of && || ! in them
+			if(val.type != ValueType::Bool)
+				this->RaiseError(frame,"conditions can only be bools");
+			else if(!val.val.b)
+			{
+				if(instr.val<=cp)
 				{
-					//push null if it doesnt exist
-					frame->stack.push_back(Value::CreateNull());
+					SPEND_TICK(instr.val-1);
 				}
+				cp = instr.val-1;//cp gets incremented at the end of the loop
 			}
 			break;
+		case OpCode::JumpIfTrueOrPop:
+			if(frame->stack.back().type != ValueType::Bool)
+				this->RaiseError(frame,"&& and || can only be applied to bools");
+			else if(frame->stack.back().val.b)
+				cp = instr.val-1;
+			else
+				frame->stack.pop_back();
+			break;
+		case OpCode::JumpIfFalseOrPop:
+			if(frame->stack.back().type != ValueType::Bool)
+				this->RaiseError(frame,"&& and || can only be applied to bools");
+			else if(!frame->stack.back().val.b)
+				cp = instr.val-1;
+			else
+				frame->stack.pop_back();
+			break;
+		case OpCode::JumpIfEqual:
+		case OpCode::JumpIfNotEqual:
+		case OpCode::JumpIfLessThan:
+		case OpCode::JumpIfLessThanOrEqual:
+		case OpCode::JumpIfGreaterThan:
+		case OpCode::JumpIfGreaterThanOrEqual:
+		case OpCode::JumpIfNotLessThan:
+		case OpCode::JumpIfNotLessThanOrEqual:
+		case OpCode::JumpIfNotGreaterThan:
+		case OpCode::JumpIfNotGreaterThanOrEqual:
+			if(CompareAndJump(frame,instr.op))
+			{
+				//while loops test at the bottom, so their back edge is one of these
+				if(instr.val<=cp)
+				{
+					SPEND_TICK(instr.val-1);
+				}
+				cp = instr.val-1;
+			}
+			break;
+		/* LOOPS */
+		case OpCode::ForPrep:
+			ForPrep(frame,func->strings[instr.val]);
+			break;
+		case OpCode::ForIterPrep:
+			ForIterPrep(frame,func->strings[instr.val]);
+			break;
+		case OpCode::ForLoop:
+			if(ForLoop(frame))
+			{
+				SPEND_TICK(instr.val-1);
+				cp = instr.val-1;//cp gets incremented at the end of the loop
+			}
+			break;
+		/* LOADING AND STORING VALUES */
+		case OpCode::LoadConstant:
+			frame->stack.push_back(frame->function->constants[instr.val]);
+			break;
+		case OpCode::LoadLocal:
+			LoadLocal(frame,func->strings[instr.val]);
+			break;
 		case OpCode::StoreLocal:
-			val = frame->stack.back();
+			frame->locals[func->strings[instr.val]] = frame->stack.back();
 			frame->stack.pop_back();
-			frame->locals[func->strings[instr.val]] = val;
+			break;
+		case OpCode::IncrementLocal:
+			//operand is the index of the amount in the constants table
+			cp++;
+			IncrementLocal(frame,func->strings[instr.val],func->constants[func->instr[cp].val]);
+			break;
+		case OpCode::LoadLocalAddConstant:
+			cp++;
+			LoadLocal(frame,func->strings[instr.val]);
+			if(frame->stack.back().type == ValueType::Number)
+				frame->stack.back().val.num += func->constants[func->instr[cp].val].val.num;
+			else
+				this->RaiseError(frame,"invalid math operation");
 			break;
 		case OpCode::LoadBool:
 			frame->stack.push_back(Value::CreateBool(instr.val==1));
@@ -570,6 +1435,12 @@ Value VirtualMachine::ExecuteScriptFunction(Object* self,Function* func)
 			}
 			else
 			{
+				if(val.val.obj->isClass)
+				{
+					frame->cp = cp;
+					InitStatic((ClassObject*)val.val.obj,func->strings[instr.val]);
+				}
+
 				frame->stack.push_back(val.val.obj->GetAttrib(func->strings[instr.val]));
 			}
 			break;
@@ -578,22 +1449,98 @@ Value VirtualMachine::ExecuteScriptFunction(Object* self,Function* func)
 			val = frame->stack.back();
 			frame->stack.pop_back();
 
+			//a static attrib that's written first doesnt need its init
+			if(val.val.obj->isClass)
+				((ClassObject*)val.val.obj)->pendingInits.erase(func->strings[instr.val]);
+
 			//followed by the value to be stored
 			val.val.obj->SetAttrib(func->strings[instr.val],frame->stack.back());
 			frame->stack.pop_back();//pop top value
 
 			break;
+		case OpCode::LoadIndex:
+			LoadIndex(frame);
+			break;
+		case OpCode::StoreIndex:
+			StoreIndex(frame);
+			break;
 
 		case OpCode::CreateInstance:
-			CreateInstance(frame,func->strings[instr.val]);
+			//resuming after running out of budget runs this instruction again
+			SPEND_TICK(cp-1);
+
+			//script constructors run in this loop, the object is pushed when they return
+			frame->cp = cp;
+			callee = CreateInstance(frame,func->strings[instr.val],callSelf);
+			if(callee==nullptr)
+				break;
+
+			if(!PushFrame(callSelf,callee))
+				break;
+			frames.back()->constructed = callSelf;
+
+			LOAD_TOP_FRAME();
 			break;
-				
-		case OpCode::CallMethod:
-			CallMethod(frame,func->strings[instr.val]);
+
+		case OpCode::CreateMap:
+			CreateMap(frame,instr.val);
 			break;
 				
+		case OpCode::CallMethod:
 		case OpCode::CallFunction:
-			CallFunction(frame,func->strings[instr.val]);
+			SPEND_TICK(cp-1);
+			callee = GetCallee(frame,instr.op==OpCode::CallMethod,func->strings[instr.val],callSelf);
+			if(callee==nullptr)
+				break;
+
+			//remember where the caller left off, native functions can call back into scripts
+			frame->cp = cp;
+
+			if(callee->isNative)
+			{
+				frame->stack.push_back(ExecuteNativeFunction(callSelf,callee));
+				break;
+			}
+
+			//switch to the callee
+			if(!PushFrame(callSelf,callee))
+				break;
+
+			LOAD_TOP_FRAME();
+			break;
+
+		case OpCode::TailCall:
+		case OpCode::TailCallMethod:
+			SPEND_TICK(cp-1);
+			callee = GetCallee(frame,instr.op==OpCode::TailCallMethod,func->strings[instr.val],callSelf);
+			if(callee==nullptr)
+				break;
+
+			if(callee->isNative)
+			{
+				//no frame to reuse, return whatever the native function returns
+				frame->cp = cp;
+				ret = ExecuteNativeFunction(callSelf,callee);
+				if(!PopFrame(baseDepth,ret))
+					return ret;
+
+				LOAD_TOP_FRAME();
+				break;
+			}
+
+			if(!EnsureCompiled(callee))
+				break;
+
+			//the callee takes over this frame
+			LORIS_STATS(EndCall(frame));
+			frame->locals.clear();
+			frame->stack.clear();
+			frame->loops.clear();
+			BindArgs(frame,callSelf,callee);
+			LORIS_STATS(StartCall(frame));
+
+			frame->cp = -1;
+			LOAD_TOP_FRAME();
 			break;
 
 		case OpCode::AddArg:
@@ -606,11 +1553,29 @@ Value VirtualMachine::ExecuteScriptFunction(Object* self,Function* func)
 				
 		case OpCode::Return:
 			ret = frame->stack.back();
-			frame->stack.pop_back();//why bother?
+			if(!PopFrame(baseDepth,ret))
+				return ret;
+
+			//carry on from the caller's call instruction
+			LOAD_TOP_FRAME();
+			break;
+
+		case OpCode::Yield:
+			//only the loop started by Resume can suspend the coroutine, a native
+			//function further down would have nothing to return to
+			if(runningCoroutine==nullptr || runningCoroutine->baseDepth!=baseDepth)
+			{
+				this->RaiseError(frame,runningCoroutine==nullptr?"yield used outside of a coroutine":"cannot yield across a native call");
+				break;
+			}
+
+			ret = frame->stack.back();
+			frame->stack.pop_back();
 
-			frames.pop_back();
-			//delete frame;
-			ReturnStackFrame(frame);
+			//move the coroutine's frames off the frame stack, the resume after this one
+			//picks up at the next instruction
+			frame->cp = cp;
+			SuspendCoroutine(baseDepth);
 
 			return ret;
 		default:
@@ -621,13 +1586,53 @@ Value VirtualMachine::ExecuteScriptFunction(Object* self,Function* func)
 		//increase counter
 		cp++;
 	}
+}
 
-	frames.pop_back();
-	//delete frame;
-	ReturnStackFrame(frame);
+#undef LOAD_TOP_FRAME
+#undef SPEND_TICK
+
+
+void VirtualMachine::LoadLocal(StackFrame* frame,const string& name)
+{
+	//if it's a local, add it to stack
+	auto iter = frame->locals.find(name);
+	if(iter!=frame->locals.end())
+	{
+		frame->stack.push_back(iter->second);
+		return;
+	}
 
-	//return Value::CreateNull();
-	return nullVal;
+	//check if it's a class being referred
+	iter = globals.find(name);
+	if(iter!=globals.end())
+	{
+		//add global if available
+		frame->stack.push_back(iter->second);
+		return;
+	}
+
+	//first use of the class, make its object
+	Class* cls = assembly->GetClass(name);
+	if(cls!=nullptr)
+	{
+		//not added to gc, deleted with the vm
+		Value classObj = Value::CreateClass(this,cls);
+		globals[name] = classObj;
+		frame->stack.push_back(classObj);
+	}
+	else
+	{
+		//push null if it doesnt exist
+		frame->stack.push_back(nullVal);
+	}
+}
+
+void VirtualMachine::IncrementLocal(StackFrame* frame,const string& name,const Value& amount)
+{
+	auto iter = frame->locals.find(name);
+	VM_ASSERT(iter!=frame->locals.end() && iter->second.type == ValueType::Number,"invalid math operation");
+
+	iter->second.val.num += amount.val.num;
 }
 
 void VirtualMachine::Negate(StackFrame* frame)
@@ -648,27 +1653,25 @@ void VirtualMachine::Negate(StackFrame* frame)
 
 void VirtualMachine::OpArithmetic(StackFrame* frame,OpCode opcode)
 {
-	Value b = Value(frame->stack.back());
-	frame->stack.pop_back();
-	Value a = Value(frame->stack.back());
-	frame->stack.pop_back();
-
-	Value res;
+	//the result is written over the left operand, so neither gets copied
+	Value& a = frame->stack[frame->stack.size()-2];
+	const Value& b = frame->stack.back();
 
 	//arithmetic can only be done on number vars
 	if(b.type == ValueType::Number && a.type == ValueType::Number)
 	{
-		res.type = ValueType::Number;
 		switch(opcode)
 		{
 		case OpCode::Add:
-			res.val.num = a.val.num + b.val.num;break;
+			a.val.num = a.val.num + b.val.num;break;
 		case OpCode::Sub:
-			res.val.num = a.val.num - b.val.num;break;
+			a.val.num = a.val.num - b.val.num;break;
 		case OpCode::Mul:
-			res.val.num = a.val.num * b.val.num;break;
+			a.val.num = a.val.num * b.val.num;break;
 		case OpCode::Div:
-			res.val.num = a.val.num / b.val.num;break;
+			a.val.num = a.val.num / b.val.num;break;
+		default:
+			break;
 		}
 	}
 	else if(b.type == ValueType::String && a.type == ValueType::String)
@@ -679,8 +1682,8 @@ void VirtualMachine::OpArithmetic(StackFrame* frame,OpCode opcode)
 			strcpy(str,a.val.str);
 			strcat(str,b.val.str);
 
-			res.type = ValueType::String;
-			res.val.str = str;
+			delete[] a.val.str;
+			a.val.str = str;
 		}
 		else
 		{
@@ -692,36 +1695,36 @@ void VirtualMachine::OpArithmetic(StackFrame* frame,OpCode opcode)
 		VM_ERROR("invalid math operation");
 	}
 
-	frame->stack.push_back(res);
+	frame->stack.pop_back();
 }
 
-void VirtualMachine::Comparison(StackFrame* frame,OpCode opcode)
+bool VirtualMachine::CompareTop(StackFrame* frame,OpCode opcode,bool& result)
 {
-	Value b = Value(frame->stack.back());
-	frame->stack.pop_back();
-	Value a = Value(frame->stack.back());
-	frame->stack.pop_back();
+	//compare in place, no need to copy the operands off the stack
+	const Value& a = frame->stack[frame->stack.size()-2];
+	const Value& b = frame->stack.back();
 
-	Value res;
-	res.type = ValueType::Bool;
+	const char* errorMsg = nullptr;
+	result = false;
 
-	//only number comparisons for now
 	if(b.type == ValueType::Number && a.type == ValueType::Number)
 	{
 		switch(opcode)
 		{
 			case OpCode::IsGreaterThan:
-				res.val.b = a.val.num > b.val.num;break;
+				result = a.val.num > b.val.num;break;
 			case OpCode::IsLessThan:
-				res.val.b = a.val.num < b.val.num;break;
+				result = a.val.num < b.val.num;break;
 			case OpCode::IsGreaterThanOrEqual:
-				res.val.b = a.val.num >= b.val.num;break;
+				result = a.val.num >= b.val.num;break;
 			case OpCode::IsLessThanOrEqual:
-				res.val.b = a.val.num <= b.val.num;break;
+				result = a.val.num <= b.val.num;break;
 			case OpCode::IsEqual:
-				res.val.b = a.val.num == b.val.num;break;
+				result = a.val.num == b.val.num;break;
 			case OpCode::IsNotEqual:
-				res.val.b = a.val.num != b.val.num;break;
+				result = a.val.num != b.val.num;break;
+			default:
+				break;
 		}
 	}
 	else if(b.type == ValueType::Bool && a.type == ValueType::Bool)
@@ -729,16 +1732,34 @@ void VirtualMachine::Comparison(StackFrame* frame,OpCode opcode)
 		switch(opcode)
 		{
 			case OpCode::IsEqual:
-				res.val.b = a.val.b == b.val.b;break;
+				result = a.val.b == b.val.b;break;
 			case OpCode::IsNotEqual:
-				res.val.b = a.val.b != b.val.b;break;
+				result = a.val.b != b.val.b;break;
 			default:
-				VM_ERROR("invalid operation between bools");
+				errorMsg = "invalid operation between bools";
 				break;
 		}
-	}else if(b.type == ValueType::String && a.type == ValueType::String)
+	}
+	else if(b.type == ValueType::String && a.type == ValueType::String)
 	{
-		res.val.b = strcmp(b.val.str,a.val.str)==0;
+		int cmp = strcmp(a.val.str,b.val.str);
+		switch(opcode)
+		{
+			case OpCode::IsGreaterThan:
+				result = cmp > 0;break;
+			case OpCode::IsLessThan:
+				result = cmp < 0;break;
+			case OpCode::IsGreaterThanOrEqual:
+				result = cmp >= 0;break;
+			case OpCode::IsLessThanOrEqual:
+				result = cmp <= 0;break;
+			case OpCode::IsEqual:
+				result = cmp == 0;break;
+			case OpCode::IsNotEqual:
+				result = cmp != 0;break;
+			default:
+				break;
+		}
 	}
 	//this is a quick hack: should do object-object comparison instead
 	else if(b.type == ValueType::Null || a.type == ValueType::Null)
@@ -746,110 +1767,408 @@ void VirtualMachine::Comparison(StackFrame* frame,OpCode opcode)
 		switch(opcode)
 		{
 			case OpCode::IsEqual:
-				res.val.b = b.type==a.type;break;
+				result = b.type==a.type;break;
 			case OpCode::IsNotEqual:
-				res.val.b = b.type!=a.type;break;
+				result = b.type!=a.type;break;
 			default:
-				VM_ERROR("invalid comparison between null and other type");
+				errorMsg = "invalid comparison between null and other type";
 				break;
 		}
 	}
 	else
 	{
-		VM_ERROR("invalid comparison");
+		errorMsg = "invalid comparison";
 	}
 
-	frame->stack.push_back(res);
+	frame->stack.pop_back();
+	frame->stack.pop_back();
+
+	if(errorMsg)
+	{
+		RaiseError(frame,errorMsg);
+		return false;
+	}
+
+	return true;
+}
+
+void VirtualMachine::Comparison(StackFrame* frame,OpCode opcode)
+{
+	bool result;
+	if(!CompareTop(frame,opcode,result))
+		return;
+
+	frame->stack.push_back(Value::CreateBool(result));
+}
+
+bool VirtualMachine::CompareAndJump(StackFrame* frame,OpCode opcode)
+{
+	//the negated versions arent just the opposite comparison
+	//since NaN fails every ordered comparison
+	OpCode cmp;
+	bool negate = false;
+	switch(opcode)
+	{
+		case OpCode::JumpIfEqual:
+			cmp = OpCode::IsEqual;break;
+		case OpCode::JumpIfNotEqual:
+			cmp = OpCode::IsNotEqual;break;
+		case OpCode::JumpIfLessThan:
+			cmp = OpCode::IsLessThan;break;
+		case OpCode::JumpIfLessThanOrEqual:
+			cmp = OpCode::IsLessThanOrEqual;break;
+		case OpCode::JumpIfGreaterThan:
+			cmp = OpCode::IsGreaterThan;break;
+		case OpCode::JumpIfGreaterThanOrEqual:
+			cmp = OpCode::IsGreaterThanOrEqual;break;
+		case OpCode::JumpIfNotLessThan:
+			cmp = OpCode::IsLessThan;negate = true;break;
+		case OpCode::JumpIfNotLessThanOrEqual:
+			cmp = OpCode::IsLessThanOrEqual;negate = true;break;
+		case OpCode::JumpIfNotGreaterThan:
+			cmp = OpCode::IsGreaterThan;negate = true;break;
+		default:
+			cmp = OpCode::IsGreaterThanOrEqual;negate = true;break;
+	}
+
+	bool result;
+	if(!CompareTop(frame,cmp,result))
+		return false;
+
+	return result != negate;
 }
 
-void VirtualMachine::CreateInstance(StackFrame* frame,string className)
+void VirtualMachine::Not(StackFrame* frame)
+{
+	Value& top = frame->stack.back();
+	VM_ASSERT(top.type == ValueType::Bool,"! can only be applied to bools");
+
+	top.val.b = !top.val.b;
+}
+
+Function* VirtualMachine::CreateInstance(StackFrame* frame,const string& className,Object*& obj)
 {
 	assert(assembly!=NULL);
 
+	obj = nullptr;
+
 	Class* cls = this->assembly->GetClass(className);
 	//assert(cls!=NULL);
-	VM_ASSERT(cls!=NULL,"class "+className+" not found");
+	if(cls==NULL)
+	{
+		this->RaiseError(frame,"class "+className+" not found");
+		return nullptr;
+	}
 
-	Object* obj = CreateObject(cls,false);
-	//assert(obj!=NULL);
-	VM_ASSERT(obj!=NULL,"error creating instance of "+className+". report this immediately!");
+	//kept out of the gc until the constructor is done
+	obj = CreateObject(cls,false);
+	LORIS_STATS(stats.allocations[className]++);
 
+	//script constructors are left for the caller to run
+	Function* constructor = obj->GetMethod(className);
+	if(constructor!=nullptr && !constructor->isNative)
+		return constructor;
 
-	//call constructor if available
-	if(obj->HasMethod(className))
-	{
-		this->ExecuteMemberFunction(obj,className);
-	}
+	if(constructor!=nullptr)
+		ExecuteNativeFunction(obj,constructor);
+	else
+		args.clear();
 
-		
 	frame->stack.push_back(Value::CreateObject(obj));
 	GC::AddObject(this,obj);
+
+	return nullptr;
 }
 
-//this calls function of an attibribute
-void VirtualMachine::CallMethod(StackFrame* frame,string methodName)
+void VirtualMachine::CreateMap(StackFrame* frame,int numPairs)
 {
-	//get self
-	Value var = Value(frame->stack.back());
+	Value mapVal = Value::CreateMap();
+	MapObject* map = mapVal.AsMap();
+
+	//pairs are on the stack in the order they were written
+	size_t first = frame->stack.size()-numPairs*2;
+	for(size_t i=first;i<frame->stack.size();i+=2)
+	{
+		if(!MapObject::IsValidKey(frame->stack[i]))
+		{
+			delete map;
+			VM_ERROR("invalid map key");
+		}
+		map->Set(frame->stack[i],frame->stack[i+1]);
+	}
+	frame->stack.erase(frame->stack.begin()+first,frame->stack.end());
+
+	//on the stack before being added to the gc so it cant be swept right away
+	frame->stack.push_back(mapVal);
+	GC::AddObject(this,map);
+	LORIS_STATS(stats.allocations[map->typeName]++);
+}
+
+void VirtualMachine::ForPrep(StackFrame* frame,const string& varName)
+{
+	Value end = frame->stack.back();
+	frame->stack.pop_back();
+	Value start = frame->stack.back();
 	frame->stack.pop_back();
 
-	//must be a object
-	//assert(var.type == ValueType::Object);
-	VM_ASSERT(var.type == ValueType::Object || var.type == ValueType::Array ,"attemped to call a method '"+methodName+"' from a non-Object type");
+	VM_ASSERT(start.type == ValueType::Number && end.type == ValueType::Number,"range bounds must be numbers");
+
+	//ForLoop steps before checking, so start one step back
+	LoopState loop;
+	loop.counter = start.val.num-1;
+	loop.limit = end.val.num;
+	loop.var = &frame->locals[varName];
+
+	frame->loops.push_back(loop);
+}
+
+void VirtualMachine::ForIterPrep(StackFrame* frame,const string& varName)
+{
+	Value iterable = frame->stack.back();
+	frame->stack.pop_back();
+
+	VM_ASSERT(iterable.type == ValueType::Array || iterable.type == ValueType::Map,"only arrays and maps can be iterated");
+
+	LoopState loop;
+	loop.counter = -1;
+	loop.limit = 0;
+	loop.iterable = iterable;
+	loop.var = &frame->locals[varName];
+
+	frame->loops.push_back(loop);
+}
+
+bool VirtualMachine::ForLoop(StackFrame* frame)
+{
+	LoopState& loop = frame->loops.back();
+	loop.counter += 1;
+
+	switch(loop.iterable.type)
+	{
+	case ValueType::Array:
+		{
+			//size is checked every step since the body can add or remove elements
+			vector<Value>& elements = loop.iterable.AsArray()->elements;
+			if(loop.counter < elements.size())
+			{
+				*loop.var = elements[(size_t)loop.counter];
+				return true;
+			}
+		}
+		break;
+	case ValueType::Map:
+		{
+			//walk the table to the next used slot
+			vector<MapEntry>& entries = loop.iterable.AsMap()->entries;
+			size_t index = (size_t)loop.counter;
+			while(index < entries.size() && entries[index].state != MapEntry::Used)
+				index++;
 
-	//must contain method
-	//assert(var.val.obj->HasMethod(methodName));
-	VM_ASSERT(var.val.obj->HasMethod(methodName),"object doesnt have method "+methodName);
+			if(index < entries.size())
+			{
+				loop.counter = index;
+				*loop.var = entries[index].key;
+				return true;
+			}
+		}
+		break;
+	default:
+		if(loop.counter < loop.limit)
+		{
+			//write straight into the local, no new value needs to be made
+			if(loop.var->type == ValueType::Number)
+				loop.var->val.num = loop.counter;
+			else
+				*loop.var = Value::CreateNumber(loop.counter);
+			return true;
+		}
+		break;
+	}
 
-	Value ret = this->ExecuteMemberFunction(var.val.obj,methodName);
-	frame->stack.push_back(ret);
+	frame->loops.pop_back();
+	return false;
 }
 
-void VirtualMachine::CallFunction(StackFrame* frame,string funcName)
+void VirtualMachine::LoadIndex(StackFrame* frame)
 {
-	//VM_ASSERT(assembly!=NULL,"assembly not set");
+	Value index = frame->stack.back();
+	frame->stack.pop_back();
+	Value container = frame->stack.back();
+	frame->stack.pop_back();
+
+	if(container.type == ValueType::Map)
+	{
+		Value* found = nullptr;
+		if(MapObject::IsValidKey(index))
+			found = container.AsMap()->Find(index);
+
+		frame->stack.push_back(found?*found:nullVal);
+	}
+	else if(container.type == ValueType::Array)
+	{
+		//a value is expected to be pushed to the top of the stack regardless
+		frame->stack.push_back(nullVal);
 
-	Function* func = assembly->GetFunction(funcName);
-	//assert(func!=NULL);
-	VM_ASSERT(func!=NULL,"function "+funcName+" not found");
+		VM_ASSERT(index.type == ValueType::Number,"index should only be an integer");
 
-	Value ret = this->ExecuteFunction(func);
-	frame->stack.push_back(ret);
+		int ind = (int)index.val.num;
+		ArrayObject* arr = container.AsArray();
+		VM_ASSERT(ind>=0 && ind<(int)arr->elements.size(),"index out of bounds");
+
+		frame->stack.back() = arr->elements[ind];
+	}
+	else
+	{
+		frame->stack.push_back(nullVal);
+		VM_ERROR("only arrays and maps can be indexed");
+	}
+}
+
+void VirtualMachine::StoreIndex(StackFrame* frame)
+{
+	Value index = frame->stack.back();
+	frame->stack.pop_back();
+	Value container = frame->stack.back();
+	frame->stack.pop_back();
+
+	//followed by the value to be stored
+	Value value = frame->stack.back();
+	frame->stack.pop_back();
+
+	if(container.type == ValueType::Map)
+	{
+		VM_ASSERT(MapObject::IsValidKey(index),"invalid map key");
+		container.AsMap()->Set(index,value);
+	}
+	else if(container.type == ValueType::Array)
+	{
+		VM_ASSERT(index.type == ValueType::Number,"index should only be an integer");
+
+		int ind = (int)index.val.num;
+		ArrayObject* arr = container.AsArray();
+		VM_ASSERT(ind>=0 && ind<(int)arr->elements.size(),"index out of bounds");
+
+		arr->elements[ind] = value;
+	}
+	else
+	{
+		VM_ERROR("only arrays and maps can be indexed");
+	}
+}
+
+Function* VirtualMachine::GetCallee(StackFrame* frame,bool isMethod,const string& name,Object*& self)
+{
+	self = nullptr;
+
+	if(!isMethod)
+	{
+		Function* func = assembly->GetFunction(name);
+		if(func==NULL)
+			this->RaiseError(frame,"function "+name+" not found");
+		return func;
+	}
+
+	//get self
+	Value var = frame->stack.back();
+	frame->stack.pop_back();
+
+	if(var.type != ValueType::Object && var.type != ValueType::Array && var.type != ValueType::Map)
+	{
+		this->RaiseError(frame,"attemped to call a method '"+name+"' from a non-Object type");
+		return nullptr;
+	}
+
+	Function* func = var.val.obj->GetMethod(name);
+	if(func==NULL)
+	{
+		this->RaiseError(frame,"object doesnt have method "+name);
+		return nullptr;
+	}
+
+	self = var.val.obj;
+	return func;
 }
 
 void VirtualMachine::RaiseError(string msg)
 {
-	RaiseError(frames.back(),msg);
+	RaiseError(frames.empty()?nullptr:frames.back(),msg);
 }
 
 void VirtualMachine::RaiseError(StackFrame* frame,string msg)
 {
 	error = Error();
 	error.message = msg;
-	error.line = lineNo;
 	error.code = Error::INVALID_OPERATION;
 
-	if(frame->function->sourceIndex>=0)
-		error.filename = assembly->sourceNames[frame->function->sourceIndex];
-		
+	if(frame!=nullptr)
+	{
+		if(frame->function->sourceIndex>=0)
+			error.filename = assembly->sourceNames[frame->function->sourceIndex];
+
+		//the running loop only keeps cp in the frame at calls, Execute sets the
+		//real line before unwinding
+		error.line = frame->function->GetLine(frame->cp);
+		errorTracePending = true;
+	}
+}
+
+string VirtualMachine::DescribeFrame(StackFrame* frame)
+{
+	Function* func = frame->function;
+
+	string file = "?";
+	if(assembly!=nullptr && func->sourceIndex>=0 && func->sourceIndex<(int)assembly->sourceNames.size())
+		file = assembly->sourceNames[func->sourceIndex];
+
+	string name = func->name.empty()?"<anonymous>":func->name;
+
+	return file+":"+name+":"+to_string(func->GetLine(frame->cp));
+}
+
+string VirtualMachine::GetStackTrace()
+{
+	//runaway recursion can leave thousands of frames, the innermost ones are enough
+	const int maxFrames = 64;
+
+	string trace;
+	int numFrames = (int)frames.size();
+	for(int i=numFrames-1;i>=0 && i>=numFrames-maxFrames;i--)
+		trace += DescribeFrame(frames[i])+"\n";
+
+	if(numFrames>maxFrames)
+		trace += "... "+to_string(numFrames-maxFrames)+" more frames\n";
+
+	return trace;
+}
+
+void VirtualMachine::SetErrorTrace(StackFrame* frame)
+{
+	errorTracePending = false;
+	error.line = frame->function->GetLine(frame->cp);
+	error.stackTrace = GetStackTrace();
+}
+
+void VirtualMachine::SetError(const Error& err)
+{
+	error = err;
 }
 
 void VirtualMachine::ClearError()
 {
 	error.code = Error::NONE;
+	errorTracePending = false;
 }
 
 /* Garbage Collector */
-vector<Object*> GC::objects;
 
 void GC::AddObject(VirtualMachine* vm,Object* obj,bool doGC)
 {
-	objects.push_back(obj);
-	//cout<<"Created Object: "<<objects.size()<<endl;
+	vm->gcObjects.push_back(obj);
+	//cout<<"Created Object: "<<vm->gcObjects.size()<<endl;
 
-	if(doGC)
+	if(doGC && vm->gcEnabled)
 	{
-		if(objects.size()>1000)//fix this
+		if(vm->gcObjects.size()>vm->gcThreshold)
 		{
 			Collect(vm);
 		}
@@ -859,89 +2178,161 @@ void GC::AddObject(VirtualMachine* vm,Object* obj,bool doGC)
 
 void GC::Collect(VirtualMachine* vm)
 {
-	cout<<"Garbage Collecting"<<endl;
+	LORIS_STATS(auto start = chrono::steady_clock::now());
 
 	//search through stack and mark objects
 	for(size_t s = 0;s<vm->frames.size();s++)
-	{
-		StackFrame* frame = vm->frames[s];
+		MarkFrame(vm,vm->frames[s]);
 
-		for(size_t f = 0;f<frame->stack.size();f++)
-		{
-			if(frame->stack[f].type == ValueType::Object)
-				MarkObject(frame->stack[f].AsObject());
-			if(frame->stack[f].type == ValueType::Array)
-				MarkArray(frame->stack[f].AsArray());
-		}
+	//suspended coroutines the host is holding onto
+	for(auto co:vm->hostCoroutines)
+		MarkObject(vm,co);
 
-		//almost forgot about locals
-		//self get cleaned up when an object's method is called from c++
-		//this fixes that
-		for(auto i = frame->locals.begin();i!=frame->locals.end();i++)
-		{
-			if(i->second.type == ValueType::Object)
-				MarkObject(i->second.AsObject());
-			if(i->second.type == ValueType::Array)
-				MarkArray(i->second.AsArray());
-		}
+	//class objects hold the static attribs
+	for(auto& global:vm->globals)
+		MarkValue(vm,global.second);
+
+	//what running InvokeBatch calls have returned so far
+	for(auto& batch:vm->batchResults)
+		for(size_t i=0;i<batch.second;i++)
+			MarkValue(vm,batch.first[i]);
+
+	//unmanaged objects are held by the host, what they reference has to stay alive
+	for(auto obj:vm->gcObjects)
+	{
+		if(obj->managed)
+			continue;
+
+		if(obj->isArray)
+			MarkArray(vm,(ArrayObject*)obj);
+		else if(obj->isMap)
+			MarkMap(vm,(MapObject*)obj);
+		else
+			MarkObject(vm,obj);
 	}
 
+	//running coroutines can be temporaries nothing else points to
+	for(auto co = vm->runningCoroutine;co!=nullptr;co = co->resumer)
+		MarkObject(vm,co);
+
 	//sweep
 	Sweep(vm);
+
+	//objects outside the gc list (class objects, unmanaged objects) dont get
+	//unmarked by the sweep
+	for(auto obj:vm->gcVisited)
+		obj->marked = false;
+	vm->gcVisited.clear();
+
+	//let the heap double before collecting again, otherwise a large live heap
+	//would be walked on every allocation
+	vm->gcThreshold = std::max((size_t)1000,vm->gcObjects.size()*2);
+
+	LORIS_STATS(chrono::duration<double> pause = chrono::steady_clock::now()-start);
+	LORIS_STATS(vm->stats.gcCollections++);
+	LORIS_STATS(vm->stats.gcPauseTime += pause.count());
+	LORIS_STATS(vm->stats.gcMaxPause = std::max(vm->stats.gcMaxPause,pause.count()));
 }
 
-void GC::MarkObject(Object* obj)
+void GC::MarkValue(VirtualMachine* vm,const Value& val)
 {
-	obj->marked = true;
-
-	for(auto var:obj->vars)
+	switch(val.type)
 	{
-		if(var.second.type == ValueType::Object)
-		{
-			MarkObject(var.second.AsObject());
-		}
-		else if(var.second.type == ValueType::Array)
-		{
-			MarkArray(var.second.AsArray());
-		}
+	case ValueType::Object:
+		MarkObject(vm,val.val.obj);
+		break;
+	case ValueType::Array:
+		MarkArray(vm,val.val.arr);
+		break;
+	case ValueType::Map:
+		MarkMap(vm,val.val.map);
+		break;
+	default:
+		break;
 	}
 }
 
-void GC::MarkArray(ArrayObject* arr)
+void GC::MarkObject(VirtualMachine* vm,Object* obj)
+{
+	//already visited, maps make cycles easy to build
+	if(obj->marked)
+		return;
+	obj->marked = true;
+	vm->gcVisited.push_back(obj);
+
+	for(auto& var:obj->vars)
+		MarkValue(vm,var.second);
+
+	if(obj->isCoroutine)
+		MarkCoroutine(vm,(CoroutineObject*)obj);
+}
+
+void GC::MarkCoroutine(VirtualMachine* vm,CoroutineObject* co)
+{
+	//frames of a running coroutine are on the vm's frame stack
+	for(auto frame:co->frames)
+		MarkFrame(vm,frame);
+
+	for(auto& arg:co->args)
+		MarkValue(vm,arg);
+}
+
+void GC::MarkFrame(VirtualMachine* vm,StackFrame* frame)
+{
+	for(size_t f = 0;f<frame->stack.size();f++)
+		MarkValue(vm,frame->stack[f]);
+
+	//almost forgot about locals
+	//self get cleaned up when an object's method is called from c++
+	//this fixes that
+	for(auto i = frame->locals.begin();i!=frame->locals.end();i++)
+		MarkValue(vm,i->second);
+
+	//arrays and maps being iterated might not be referenced anywhere else
+	for(auto& loop:frame->loops)
+		MarkValue(vm,loop.iterable);
+}
+
+void GC::MarkArray(VirtualMachine* vm,ArrayObject* arr)
 {
+	if(arr->marked)
+		return;
 	arr->marked = true;
+	vm->gcVisited.push_back(arr);
 
 	//vars could be added to the array
-	for(auto var:arr->vars)
-	{
-		if(var.second.type == ValueType::Object)
-		{
-			MarkObject(var.second.AsObject());
-		}
-		else if(var.second.type == ValueType::Array)
-		{
-			MarkArray(var.second.AsArray());
-		}
-	}
+	for(auto& var:arr->vars)
+		MarkValue(vm,var.second);
 
 	//elements in the array
-	for(auto var:arr->elements)
+	for(auto& var:arr->elements)
+		MarkValue(vm,var);
+}
+
+void GC::MarkMap(VirtualMachine* vm,MapObject* map)
+{
+	if(map->marked)
+		return;
+	map->marked = true;
+	vm->gcVisited.push_back(map);
+
+	for(auto& var:map->vars)
+		MarkValue(vm,var.second);
+
+	for(auto& entry:map->entries)
 	{
-		if(var.type == ValueType::Object)
-		{
-			MarkObject(var.AsObject());
-		}
-		else if(var.type == ValueType::Array)
-		{
-			MarkArray(var.AsArray());
-		}
-	}
+		if(entry.state != MapEntry::Used)
+			continue;
 
+		MarkValue(vm,entry.key);
+		MarkValue(vm,entry.value);
+	}
 }
 
 void GC::Sweep(VirtualMachine* vm)
 {
 	//remove all unmarked objects
+	auto& objects = vm->gcObjects;
 	for(auto iter = objects.begin();iter!=objects.end();)
 	{
 		//unmanaged objects shouldnt be GC'd
@@ -968,21 +2359,16 @@ Value Value::CreateClass(VirtualMachine* vm,Class* cls)
 {
 	Value v;
 	v.type = ValueType::Object;
-	Object* obj = new Object;
+	ClassObject* obj = new ClassObject(cls);
 	
-	//add each static attrib as a var
+	//add each static attrib as a var, the inits are left for the first read
 	for(auto i = cls->attribs.begin();i!=cls->attribs.end();i++)
 	{
 		if(i->isStatic)
 		{
+			obj->SetAttrib(i->name,Value::CreateNull());
 			if(i->init)
-			{
-				obj->SetAttrib(i->name,vm->ExecuteFunction(i->init));
-			}
-			else
-			{
-				obj->SetAttrib(i->name,Value::CreateNull());
-			}
+				obj->pendingInits[i->name] = i->init;
 		}
 	}
 
@@ -1109,4 +2495,500 @@ Value ArrayObject::RemoveAt(VirtualMachine* vm, Object* self)
 	arr->elements.erase(arr->elements.begin() + ind);
 
 	return Value::CreateNull();
-}
\ No newline at end of file
+}
+Value Value::CreateMap()
+{
+	Value v;
+	v.type = ValueType::Map;
+	v.val.map = new MapObject;
+
+	return v;
+}
+
+//native methods of maps and coroutines are shared by every instance instead of being allocated per object
+static Function* CreateNativeMethod(string name,NativeFunction native)
+{
+	Function* func = new Function;
+	func->isNative = true;
+	func->nativeFunction = native;
+	func->name = name;
+	return func;
+}
+
+MapObject::MapObject()
+{
+	isMap = true;
+	typeName = "Map";
+	count = 0;
+	used = 0;
+
+	static Function* funcs[] = {
+		CreateNativeMethod("size",GetSize),
+		CreateNativeMethod("get",GetEl),
+		CreateNativeMethod("set",SetEl),
+		CreateNativeMethod("has",HasEl),
+		CreateNativeMethod("remove",RemoveEl),
+		CreateNativeMethod("keys",GetKeys),
+		CreateNativeMethod("values",GetValues),
+		CreateNativeMethod("clear",ClearEls)
+	};
+
+	for(auto func:funcs)
+		SetMethod(func->name,func);
+}
+
+bool MapObject::IsValidKey(const Value& key)
+{
+	switch(key.type)
+	{
+	case ValueType::Number:
+	case ValueType::Bool:
+	case ValueType::String:
+	case ValueType::Object:
+	case ValueType::Array:
+	case ValueType::Map:
+		return true;
+	default:
+		return false;
+	}
+}
+
+//finalizer from murmurhash3, spreads the bits of pointers and doubles
+static unsigned int MixHash(unsigned long long h)
+{
+	h ^= h >> 33;
+	h *= 0xff51afd7ed558ccdULL;
+	h ^= h >> 33;
+	h *= 0xc4ceb9fe1a85ec53ULL;
+	h ^= h >> 33;
+	return (unsigned int)h;
+}
+
+unsigned int MapObject::Hash(const Value& key)
+{
+	unsigned long long bits = 0;
+	unsigned int h;
+
+	switch(key.type)
+	{
+	case ValueType::Number:
+		{
+			//0 and -0 are equal so they need the same hash
+			double num = key.val.num==0?0:key.val.num;
+			memcpy(&bits,&num,sizeof(double));
+			return MixHash(bits);
+		}
+	case ValueType::Bool:
+		return key.val.b?1:2;
+	case ValueType::String:
+		//fnv-1a
+		h = 2166136261u;
+		for(const char* c = key.val.str;*c;c++)
+		{
+			h ^= (unsigned char)*c;
+			h *= 16777619u;
+		}
+		return h;
+	default:
+		//objects are keyed by identity
+		return MixHash((unsigned long long)(size_t)key.val.data);
+	}
+}
+
+bool MapObject::KeysEqual(const Value& a,const Value& b)
+{
+	if(a.type != b.type)
+		return false;
+
+	switch(a.type)
+	{
+	case ValueType::Number:
+		return a.val.num == b.val.num;
+	case ValueType::Bool:
+		return a.val.b == b.val.b;
+	case ValueType::String:
+		return strcmp(a.val.str,b.val.str)==0;
+	default:
+		return a.val.data == b.val.data;
+	}
+}
+
+//returns the slot holding key, or the slot it should be inserted into
+size_t MapObject::FindSlot(const Value& key,unsigned int hash)
+{
+	size_t mask = entries.size()-1;
+	size_t index = hash & mask;
+	size_t tombstone = entries.size();
+
+	while(true)
+	{
+		MapEntry& entry = entries[index];
+		if(entry.state == MapEntry::Empty)
+		{
+			//reuse the first tombstone on the probe chain
+			return tombstone!=entries.size()?tombstone:index;
+		}
+
+		if(entry.state == MapEntry::Deleted)
+		{
+			if(tombstone == entries.size())
+				tombstone = index;
+		}
+		else if(entry.hash == hash && KeysEqual(entry.key,key))
+		{
+			return index;
+		}
+
+		index = (index+1) & mask;
+	}
+}
+
+void MapObject::Grow()
+{
+	vector<MapEntry> old;
+	old.swap(entries);
+
+	//only grow if the table is actually full of live entries,
+	//otherwise rehashing just clears out the tombstones
+	size_t capacity = old.size()==0?8:old.size();
+	while((count+1)*4 > capacity*3)
+		capacity *= 2;
+
+	entries.resize(capacity);
+	used = count;
+
+	for(auto& entry:old)
+	{
+		if(entry.state != MapEntry::Used)
+			continue;
+
+		size_t index = FindSlot(entry.key,entry.hash);
+		entries[index] = entry;
+	}
+}
+
+Value* MapObject::Find(const Value& key)
+{
+	if(count==0)
+		return nullptr;
+
+	unsigned int hash = Hash(key);
+	MapEntry& entry = entries[FindSlot(key,hash)];
+	if(entry.state != MapEntry::Used)
+		return nullptr;
+
+	return &entry.value;
+}
+
+void MapObject::Set(const Value& key,const Value& value)
+{
+	//keep the load factor (tombstones included) under 3/4
+	if((used+1)*4 > entries.size()*3)
+		Grow();
+
+	unsigned int hash = Hash(key);
+	MapEntry& entry = entries[FindSlot(key,hash)];
+
+	if(entry.state == MapEntry::Used)
+	{
+		entry.value = value;
+		return;
+	}
+
+	if(entry.state == MapEntry::Empty)
+		used++;
+	count++;
+
+	entry.key = key;
+	entry.value = value;
+	entry.hash = hash;
+	entry.state = MapEntry::Used;
+}
+
+bool MapObject::Remove(const Value& key)
+{
+	if(count==0)
+		return false;
+
+	MapEntry& entry = entries[FindSlot(key,Hash(key))];
+	if(entry.state != MapEntry::Used)
+		return false;
+
+	entry.key = Value();
+	entry.value = Value();
+	entry.state = MapEntry::Deleted;
+	count--;
+
+	return true;
+}
+
+void MapObject::Clear()
+{
+	entries.clear();
+	count = 0;
+	used = 0;
+}
+
+//def size()
+Value MapObject::GetSize(VirtualMachine* vm,Object* self)
+{
+	MapObject* map = (MapObject*)self;
+	return Value::CreateNumber(map->count);
+}
+
+//def get(key)
+Value MapObject::GetEl(VirtualMachine* vm,Object* self)
+{
+	Value key = vm->GetArg(0);
+	if(!IsValidKey(key))
+		return Value::CreateNull();
+
+	Value* val = ((MapObject*)self)->Find(key);
+	if(val==nullptr)
+		return Value::CreateNull();
+
+	return *val;
+}
+
+//def set(key,val)
+Value MapObject::SetEl(VirtualMachine* vm,Object* self)
+{
+	Value key = vm->GetArg(0);
+	if(!IsValidKey(key))
+	{
+		vm->RaiseError("invalid map key");
+		return Value::CreateNull();
+	}
+
+	Value value = vm->GetArg(1);
+	((MapObject*)self)->Set(key,value);
+
+	return value;
+}
+
+//def has(key)
+Value MapObject::HasEl(VirtualMachine* vm,Object* self)
+{
+	Value key = vm->GetArg(0);
+	if(!IsValidKey(key))
+		return Value::CreateBool(false);
+
+	return Value::CreateBool(((MapObject*)self)->Find(key)!=nullptr);
+}
+
+//def remove(key)
+Value MapObject::RemoveEl(VirtualMachine* vm,Object* self)
+{
+	Value key = vm->GetArg(0);
+	if(!IsValidKey(key))
+		return Value::CreateBool(false);
+
+	return Value::CreateBool(((MapObject*)self)->Remove(key));
+}
+
+//def keys()
+Value MapObject::GetKeys(VirtualMachine* vm,Object* self)
+{
+	MapObject* map = (MapObject*)self;
+
+	Value arrayVal = Value::CreateArray();
+	ArrayObject* arr = arrayVal.AsArray();
+	arr->elements.reserve(map->count);
+	for(auto& entry:map->entries)
+	{
+		if(entry.state == MapEntry::Used)
+			arr->elements.push_back(entry.key);
+	}
+
+	//returned straight to the stack, so a collection here would sweep it
+	GC::AddObject(vm,arr,false);
+	LORIS_STATS(vm->GetStats().allocations[arr->typeName]++);
+	return arrayVal;
+}
+
+//def values()
+Value MapObject::GetValues(VirtualMachine* vm,Object* self)
+{
+	MapObject* map = (MapObject*)self;
+
+	Value arrayVal = Value::CreateArray();
+	ArrayObject* arr = arrayVal.AsArray();
+	arr->elements.reserve(map->count);
+	for(auto& entry:map->entries)
+	{
+		if(entry.state == MapEntry::Used)
+			arr->elements.push_back(entry.value);
+	}
+
+	GC::AddObject(vm,arr,false);
+	LORIS_STATS(vm->GetStats().allocations[arr->typeName]++);
+	return arrayVal;
+}
+
+//def clear()
+Value MapObject::ClearEls(VirtualMachine* vm,Object* self)
+{
+	((MapObject*)self)->Clear();
+	return Value::CreateNull();
+}
+
+/* CLASS */
+
+ClassObject::ClassObject(Class* cls)
+{
+	isClass = true;
+	this->cls = cls;
+}
+
+/* COROUTINE */
+
+CoroutineObject::CoroutineObject()
+{
+	isCoroutine = true;
+	typeName = "Coroutine";
+	status = Suspended;
+	baseDepth = 0;
+	resumer = nullptr;
+
+	static Function* funcs[] = {
+		CreateNativeMethod("resume",Resume),
+		CreateNativeMethod("done",GetDone)
+	};
+
+	for(auto func:funcs)
+		SetMethod(func->name,func);
+}
+
+CoroutineObject::~CoroutineObject()
+{
+	for(auto frame:frames)
+		delete frame;
+}
+
+bool CoroutineObject::IsDone()
+{
+	return status==Done;
+}
+
+//def resume()
+Value CoroutineObject::Resume(VirtualMachine* vm,Object* self)
+{
+	return vm->Resume((CoroutineObject*)self);
+}
+
+//def done()
+Value CoroutineObject::GetDone(VirtualMachine* vm,Object* self)
+{
+	return Value::CreateBool(((CoroutineObject*)self)->IsDone());
+}
+
+/* INSTRUMENTATION */
+
+static const char* opCodeNames[] = {
+	"Add","Sub","Mul","Div","Neg",
+	"LoadConstant","LoadLocal","StoreLocal","LoadProp","StoreProp","LoadIndex","StoreIndex",
+	"LoadBool","LoadNull","Pop",
+	"IncrementLocal","LoadLocalAddConstant","Operand",
+	"CreateInstance","CreateMap","CallMethod","CallStaticMethod","CallFunction",
+	"TailCall","TailCallMethod","AddArg",
+	"IsEqual","IsLessThan","IsLessThanOrEqual","IsGreaterThan","IsGreaterThanOrEqual","IsNotEqual",
+	"Not",
+	"JumpIfTrue","JumpIfFalse","JumpIfTrueOrPop","JumpIfFalseOrPop","Jump",
+	"JumpIfEqual","JumpIfNotEqual","JumpIfLessThan","JumpIfLessThanOrEqual",
+	"JumpIfGreaterThan","JumpIfGreaterThanOrEqual","JumpIfNotLessThan","JumpIfNotLessThanOrEqual",
+	"JumpIfNotGreaterThan","JumpIfNotGreaterThanOrEqual",
+	"ForPrep","ForIterPrep","ForLoop",
+	"Return","Yield",
+	"Nop"
+};
+
+static_assert(sizeof(opCodeNames)/sizeof(opCodeNames[0])==NUM_OPCODES,"opCodeNames is missing an opcode");
+
+const char* loris::GetOpCodeName(OpCode op)
+{
+	return opCodeNames[(int)op];
+}
+
+void VMStats::Reset()
+{
+	for(int i=0;i<NUM_OPCODES;i++)
+		opCounts[i] = 0;
+
+	functions.clear();
+	allocations.clear();
+	nativeCalls = 0;
+	gcCollections = 0;
+	gcPauseTime = 0;
+	gcMaxPause = 0;
+}
+
+bool VMStats::IsEnabled()
+{
+#ifdef LORIS_INSTRUMENT
+	return true;
+#else
+	return false;
+#endif
+}
+
+static string JsonString(const string& str)
+{
+	string out = "\"";
+	for(auto c:str)
+	{
+		if(c=='"' || c=='\\')
+			out += '\\';
+		out += c;
+	}
+	out += "\"";
+
+	return out;
+}
+
+string VMStats::ToJson() const
+{
+	stringstream out;
+	out<<"{\n";
+
+	out<<"\t\"opcodes\": {";
+	bool first = true;
+	for(int i=0;i<NUM_OPCODES;i++)
+	{
+		if(opCounts[i]==0)
+			continue;
+
+		out<<(first?"":",")<<"\n\t\t"<<JsonString(opCodeNames[i])<<": "<<opCounts[i];
+		first = false;
+	}
+	out<<"\n\t},\n";
+
+	out<<"\t\"functions\": [";
+	first = true;
+	for(auto& func:functions)
+	{
+		out<<(first?"":",")<<"\n\t\t{\"name\": "<<JsonString(func.first->name)
+			<<", \"native\": "<<(func.first->isNative?"true":"false")
+			<<", \"calls\": "<<func.second.calls
+			<<", \"time_ms\": "<<func.second.time*1000<<"}";
+		first = false;
+	}
+	out<<"\n\t],\n";
+
+	out<<"\t\"allocations\": {";
+	first = true;
+	for(auto& alloc:allocations)
+	{
+		out<<(first?"":",")<<"\n\t\t"<<JsonString(alloc.first)<<": "<<alloc.second;
+		first = false;
+	}
+	out<<"\n\t},\n";
+
+	out<<"\t\"native_calls\": "<<nativeCalls<<",\n";
+	out<<"\t\"gc\": {\"collections\": "<<gcCollections
+		<<", \"pause_ms\": "<<gcPauseTime*1000
+		<<", \"max_pause_ms\": "<<gcMaxPause*1000<<"}\n";
+
+	out<<"}\n";
+
+	return out.str();
+}
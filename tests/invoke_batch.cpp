@@ -0,0 +1,85 @@
+/*
+
+Copyright (C) 2014-2018 Nicolas Brown
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is furnished
+to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+*/
+
+/*
+calls a script function that allocates once per call through InvokeBatch,
+the objects returned by earlier calls have to survive the collections the later calls trigger
+*/
+
+#include "../include/loris/loris.hpp"
+
+#include <cstdio>
+#include <vector>
+
+int main()
+{
+	loris::Loris loris;
+	loris.AddSource(R"(
+	class P
+	{
+		var x;
+
+		P(x)
+		{
+			self.x = x;
+		}
+	}
+
+	def make(x)
+	{
+		return new P(x);
+	}
+	)");
+
+	if (!loris.Compile())
+	{
+		std::printf("compile failed: %s\n", loris.GetError().message.c_str());
+		return 1;
+	}
+
+	// well past the gc threshold, so the batch collects several times
+	const size_t count = 5000;
+	std::vector<loris::Value> args(count);
+	for (size_t i = 0; i < count; i++)
+		args[i] = loris::Value::CreateNumber((double)i);
+
+	std::vector<loris::Value> results(count);
+	loris::CallSite make = loris.Prepare("make", 1);
+	if (!loris.InvokeBatch(make, args.data(), count, results.data()))
+	{
+		std::printf("batch failed: %s\n", loris.GetError().message.c_str());
+		return 1;
+	}
+
+	for (size_t i = 0; i < count; i++)
+	{
+		if (results[i].type != loris::ValueType::Object ||
+			results[i].AsObject()->GetAttrib("x").AsNumber() != (double)i)
+		{
+			std::printf("result %d doesnt hold its object\n", (int)i);
+			return 1;
+		}
+	}
+
+	return 0;
+}